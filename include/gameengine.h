@@ -2,12 +2,17 @@
 #define GAMEENGINE_H
 
 #include "rayengine.h"
+#include "spatialhash.h"
 //#include <SDL2/SDL_mixer.h>
 
 typedef struct _Player {
 	double x;
 	double y;
     double h;
+    double prevX;
+    double prevY;
+    double prevH;
+    double prevAngle;
     double groundH;
     double velX;
     double velY;
@@ -49,32 +54,146 @@ typedef struct {
 typedef struct {
     KeyPair keys[LEN_PK];
     uint8_t state[LEN_PK];
+    int32_t mouseX;
 } KeyMap;
 
+/**
+ * Standalone entity. Attach a SpatialHash with
+ * GameEngine_setEntityGrid and GameEngine_moveEntity keeps
+ * its tile up to date, see GameEngine_cullEntities.
+ */
 typedef struct _Entity {
     double x;
     double y;
     double h;
+    double prevX;
+    double prevY;
+    double prevH;
     double angle;
     uint8_t health;
     uint8_t state;
 	RaySprite shadow;
 	RaySprite sprite;
+	SpatialHash* grid;
+	uint32_t handle;
 } Entity;
 
+/**
+ * Render state of one simulated frame, so the next frame can
+ * be simulated while this one is rendered. The camera holds
+ * the interpolated pose with column tables of its own, and
+ * sprites are copies (textures are shared). Maps are shared
+ * too: mapVersion is the map->version the frame was
+ * simulated against, and maps may only be edited while no
+ * snapshot of them is being rendered (see
+ * GameEngine_isSnapshotCurrent).
+ */
 typedef struct {
-    Entity projectiles[64];
-} ProjectileList;
+    Camera camera;
+    RaySprite* sprites;
+    uint32_t numSprites;
+    uint32_t capacity;
+    uint32_t mapVersion;
+} FrameSnapshot;
+
+#define POOL_FREE 0xFFFFFFFF
+
+/**
+ * Pooled entity store, one array per component.
+ * Live entities are packed in [0, count) so update loops
+ * run straight through the arrays. Handles stay valid
+ * while entities are swapped around by despawns.
+ */
+typedef struct {
+    uint32_t count;
+    uint32_t capacity;
+    double* x;
+    double* y;
+    double* h;
+    double* prevX;
+    double* prevY;
+    double* prevH;
+    double* velX;
+    double* velY;
+    double* velH;
+    RaySprite** sprite;
+    uint8_t* frameNum;
+    uint8_t* state;
+    uint32_t* handle;
+    uint32_t* slot;
+    uint32_t* freeList;
+    uint32_t freeCount;
+    RaySprite* shadow;
+    SpatialHash* grid;
+    uint32_t* visible;
+} EntityPool;
+
+typedef struct {
+    uint64_t lastCount;
+    uint64_t frequency;
+    double stepTime;
+    double accumulator;
+    double frameTime;
+    double alpha;
+    uint32_t maxSteps;
+} GameClock;
+
+/**
+ * Dynamic resolution governor. Scales the render size by
+ * fraction (minFraction to 1) to keep frame time near budget.
+ * Drops a step once smoothed time stays over the band for
+ * holdFrames, and only climbs back when the next step up is
+ * predicted to fit under the band, so it settles instead of
+ * flipping between two sizes.
+ */
+typedef struct {
+    double budget;
+    double hysteresis;
+    double smoothed;
+    double fraction;
+    double minFraction;
+    double step;
+    uint32_t holdFrames;
+    uint32_t overFrames;
+    uint32_t underFrames;
+    uint32_t cooldown;
+} ResolutionGovernor;
 
 void GameEngine_initPlayer(Player* player, double x, double y, double angle, uint8_t usingMouse, double fov, double viewDist, uint32_t screenWidth);
+void GameEngine_delPlayer(Player* player);
 void GameEngine_initEntity(Entity* entity, double x, double y, double h, double angle, RayTex* spriteTex, RayTex* shadowTex);
-void GameEngine_initProjectiles(ProjectileList* projectiles, uint32_t numProjectile, RayTex* spriteTex, RayTex* shadowTex);
+EntityPool* GameEngine_initEntityPool(uint32_t capacity, RaySprite* shadow);
+void GameEngine_delEntityPool(EntityPool* pool);
+uint32_t GameEngine_spawnEntity(EntityPool* pool, RaySprite* sprite, double x, double y, double h, double velX, double velY, double velH);
+void GameEngine_despawnEntity(EntityPool* pool, uint32_t handle);
+void GameEngine_setEntityPoolGrid(EntityPool* pool, SpatialHash* grid);
+void GameEngine_movePoolEntity(EntityPool* pool, uint32_t handle, double x, double y, double h);
+void GameEngine_integrateEntityPool(EntityPool* pool, double dt);
+void GameEngine_drawEntityPool(DepthBuffer* buffer, Camera* camera, uint32_t width, uint32_t height, EntityPool* pool, double alpha);
+void GameEngine_setEntityGrid(Entity* entity, SpatialHash* grid, uint32_t handle);
 void GameEngine_moveEntity(Entity* entity, double x, double y, double h);
+uint32_t GameEngine_cullEntities(SpatialHash* grid, Camera* camera, uint32_t width, uint32_t height, uint32_t* visible, uint32_t maxVisible);
 void GameEngine_scaleEntity(Entity* entity, double scaleFactor);
 void GameEngine_updatePlayer(Player* player, Map* map, KeyMap* keyMap, double dt);
+void GameEngine_interpolatePlayer(Player* player, double alpha);
+void GameEngine_saveEntityState(Entity* entity);
 void GameEngine_updateEntity(Entity* entity);
-void GameEngine_updateProjectile(ProjectileList* projectiles, uint32_t numProjectile, Player* player);
+void GameEngine_interpolateEntity(Entity* entity, double alpha);
+void GameEngine_initSnapshot(FrameSnapshot* snapshot);
+void GameEngine_delSnapshot(FrameSnapshot* snapshot);
+void GameEngine_beginSnapshot(FrameSnapshot* snapshot, Camera* camera, Map* map);
+void GameEngine_addSnapshotSprite(FrameSnapshot* snapshot, RaySprite* sprite);
+uint8_t GameEngine_isSnapshotCurrent(FrameSnapshot* snapshot, Map* map);
+void GameEngine_updateProjectile(EntityPool* projectiles, RaySprite* projectileSprite, Player* player, KeyMap* keyMap, double dt);
 void GameEngine_bindKeys(KeyMap* keyMap, uint8_t* keyList);
 void GameEngine_updateKeys(KeyMap* keyMap);
+void GameEngine_seedRandom(uint32_t seed);
+uint32_t GameEngine_random(void);
+void GameEngine_initClock(GameClock* clock, double stepRate, uint32_t maxSteps);
+uint32_t GameEngine_advanceClock(GameClock* clock, double frameTime);
+uint32_t GameEngine_tickClock(GameClock* clock);
+void GameEngine_initGovernor(ResolutionGovernor* governor, double budget, double minFraction);
+uint8_t GameEngine_updateGovernor(ResolutionGovernor* governor, double frameTime);
+void GameEngine_governRenderSize(ResolutionGovernor* governor, RenderConfig* target, RenderConfig* render);
 
 #endif //GAMEENGINE_H
\ No newline at end of file
@@ -0,0 +1,73 @@
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+#include "rayengine.h"
+
+#define MAP_FILE_MAGIC "RMAP"
+#define MAP_FILE_VERSION 3
+// Chunk directory entry flag, low 16 bits then hold the fill tile
+#define MAP_FILE_UNIFORM 0x8000000000000000ull
+
+/**
+ * Binary map file. Every section is 8 byte aligned and
+ * stored in native (little endian) layout, so a loaded
+ * file is used in place: Map chunks point straight into
+ * the mapping, nothing is parsed or copied.
+ * 
+ * header | chunk directory | chunk index | chunks | floor | ceiling | spawns
+ * The directory holds one uint64 per chunk (row major), either
+ * the file offset of its MAP_CHUNK_TILES tiles, or
+ * MAP_FILE_UNIFORM | tile for chunks of a single tile.
+ * The index holds the traversal bitmaps of every chunk, Map
+ * occupancy (one uint64 per chunk) then solidBits (MAP_CHUNK_SIZE
+ * uint32 rows per chunk), so loading never reads the tiles.
+ * Floor/ceiling offsets are 0 when the layer is absent.
+ */
+typedef struct {
+	char magic[4];
+	uint16_t version;
+	uint16_t headerSize;
+	uint32_t width;
+	uint32_t height;
+	uint32_t border;
+	uint32_t numSpawns;
+	uint32_t chunksX;
+	uint32_t chunksY;
+	uint64_t chunkOffset;
+	uint64_t indexOffset;
+	uint64_t floorOffset;
+	uint64_t ceilingOffset;
+	uint64_t spawnOffset;
+	uint64_t fileSize;
+} MapFileHeader;
+
+enum MapSpawnType {
+	MS_PLAYER,
+	MS_ENTITY,
+	MS_ITEM
+};
+
+typedef struct {
+	double x;
+	double y;
+	double h;
+	double angle;
+	uint32_t type;
+	uint32_t param;
+} MapSpawn;
+
+typedef struct {
+	Map map;
+	MapFileHeader* header;
+	MapSpawn* spawns;
+	uint32_t numSpawns;
+	void* fileData;
+	size_t fileSize;
+} MapFile;
+
+MapFile* MapFile_load(const char* path);
+void MapFile_del(MapFile* mapFile);
+int MapFile_save(const char* path, Map* map, MapSpawn* spawns, uint32_t numSpawns);
+MapSpawn* MapFile_findSpawn(MapFile* mapFile, uint32_t type);
+
+#endif//MAPFILE_H
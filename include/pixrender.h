@@ -22,6 +22,7 @@ typedef struct _RayTex {
 
 PixBuffer* PixBuffer_initPixBuffer(uint32_t width, uint32_t height);
 void PixBuffer_delPixBuffer(PixBuffer* buffer);
+void PixBuffer_resizePixBuffer(PixBuffer* buffer, uint32_t width, uint32_t height);
 void PixBuffer_drawColumn(PixBuffer* buffer, uint32_t x, int32_t y, int32_t h, SDL_Color color);
 void PixBuffer_drawTexColumn(PixBuffer* buffer, uint32_t x, int32_t y, int32_t h, RayTex* texture, uint8_t tileNum, double alphaNum, uint32_t column, double fadePercent, SDL_Color targetColor);
 void PixBuffer_drawRect(PixBuffer* buffer, SDL_Rect* rect, SDL_Color color);
@@ -42,6 +43,8 @@ uint32_t PixBuffer_getTex(RayTex* texture, uint8_t tileNum, uint32_t x, uint32_t
 void PixBuffer_drawPix(PixBuffer* buffer, uint32_t x, uint32_t y, uint32_t color);
 void PixBuffer_drawPixAlpha(PixBuffer* buffer, uint32_t x, uint32_t y, uint32_t color, double alphaNum);
 void PixBuffer_drawPixDouble(PixBuffer* buffer, double x, double y, uint32_t color, double alphaNum);
+int PixBuffer_writePPM(PixBuffer* buffer, const char* path);
+PixBuffer* PixBuffer_readPPM(const char* path);
 
 RayTex* RayTex_initFromRGBA(uint8_t* rgbaData, uint32_t tileWidth, uint32_t tileHeight, uint8_t numTiles);
 void RayTex_delRayTex(RayTex* tex);
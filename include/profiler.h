@@ -0,0 +1,63 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "pixrender.h"
+
+/**
+ * Frame profiler. Only built with -DRAY_PROFILE,
+ * otherwise the PROFILE_ macros expand to nothing
+ * and none of this is compiled in.
+ */
+
+#define PROFILE_RING_SIZE 8192
+#define PROFILE_HISTORY 60
+#define PROFILE_MAX_THREADS 32
+
+enum ProfileStage {
+	PS_FRAME,
+	PS_SIM,
+	PS_RESET,
+	PS_FLOOR,
+	PS_WALLS,
+	PS_SPRITES,
+	PS_COMPOSITE,
+	PS_POST,
+	PS_UPLOAD,
+	PS_PRESENT,
+	LEN_PS
+};
+
+#ifdef RAY_PROFILE
+
+typedef struct {
+	uint8_t stage;
+	uint64_t start;
+	uint64_t end;
+} ProfileEvent;
+
+typedef struct {
+	ProfileEvent events[PROFILE_RING_SIZE];
+	uint32_t head;
+	uint32_t count;
+	uint32_t threadId;
+} ProfileRing;
+
+#define PROFILE_BEGIN(stage) uint64_t profileStart_##stage = SDL_GetPerformanceCounter()
+#define PROFILE_END(stage) Profiler_record(stage, profileStart_##stage, SDL_GetPerformanceCounter())
+#define PROFILE_FRAME() Profiler_endFrame()
+
+void Profiler_record(uint8_t stage, uint64_t start, uint64_t end);
+void Profiler_endFrame(void);
+double Profiler_getAverage(uint8_t stage);
+void Profiler_drawOverlay(PixBuffer* buffer);
+int Profiler_writeTrace(const char* path);
+
+#else
+
+#define PROFILE_BEGIN(stage)
+#define PROFILE_END(stage)
+#define PROFILE_FRAME()
+
+#endif//RAY_PROFILE
+
+#endif//PROFILER_H
@@ -3,6 +3,22 @@
 
 #include "pixrender.h"
 
+/**
+ * Column rays are the view direction (cos/sin of angle)
+ * plus columnTan times the camera plane (the direction
+ * turned 90 degrees), scaled by columnCos to unit length.
+ * columnCos is also the fisheye factor. The column tables
+ * are rebuilt by RayEngine_updateCameraColumns when the
+ * width or fov changes, and grow to any width.
+ * columnStep > 1 turns on column LOD: RayEngine_raycastRender
+ * traces every columnStep-th column, then fills the columns
+ * between two that hit the same wall plane (depths within
+ * lodDepthRatio of each other) or both hit nothing, and
+ * traces the rest. columnHits holds the traced first hits.
+ */
+struct _RayHit;
+struct _RayCoherence;
+struct _RayInterlace;
 typedef struct _Camera {
 	double x;
 	double y;
@@ -10,11 +26,101 @@ typedef struct _Camera {
 	double angle;
 	double dist;
 	double fov;
-	double angleValues[WIDDERSHINS];
+	uint32_t columnWidth;
+	uint32_t columnCapacity;
+	double columnFov;
+	double focalLength;
+	double* columnTan;
+	double* columnCos;
+	uint32_t columnStep;
+	double lodDepthRatio;
+	struct _RayHit* columnHits;
+	struct _RayCoherence* coherence;
+	struct _RayInterlace* interlace;
 } Camera;
 
+/**
+ * Runtime render resolution. width/height are the internal
+ * render size, scale is window pixels per render pixel
+ * (the window is width * scale by height * scale).
+ */
+typedef struct {
+	uint32_t width;
+	uint32_t height;
+	uint32_t scale;
+} RenderConfig;
+
+// Columns either side a coherent ray checks (at least), the distance
+// traced normally after big moves, and the safety margin
+#define RAY_COHERENCE_WINDOW 4
+#define RAY_COHERENCE_NEAR 2.0
+#define RAY_COHERENCE_EPSILON 1e-6
+
+#define MAP_CHUNK_SHIFT 5
+#define MAP_CHUNK_SIZE (1 << MAP_CHUNK_SHIFT)
+#define MAP_CHUNK_MASK (MAP_CHUNK_SIZE - 1)
+#define MAP_CHUNK_TILES (MAP_CHUNK_SIZE * MAP_CHUNK_SIZE)
+#define MAP_MAX_FILL 16
+// Occupancy blocks, 8x8 per chunk so a chunk's bits fit a uint64_t
+#define MAP_BLOCK_SHIFT 2
+#define MAP_BLOCK_SIZE (1 << MAP_BLOCK_SHIFT)
+#define MAP_BLOCKS_SHIFT (MAP_CHUNK_SHIFT - MAP_BLOCK_SHIFT)
+
+typedef uint16_t MapTile;
+#define MAP_TILE_IDS 65536
+
+enum MapChunkFlags {
+	MCF_LOADED = 1,		// Holds real tiles (unloaded chunks read as empty)
+	MCF_OWNED = 2,		// Allocated by the map, freed on evict/delete
+	MCF_WRITABLE = 4,	// May be edited in place (owned or file backed)
+	MCF_DIRTY = 8,		// Edited since load, never evicted
+	MCF_FAILED = 16		// Loader failed, not retried until evicted
+};
+
+struct _Map;
+typedef uint8_t (*MapChunkLoader)(struct _Map* map, int32_t chunkX, int32_t chunkY, MapTile* tiles, void* loaderData);
+
+/**
+ * Tiles are stored in MAP_CHUNK_SIZE square chunks behind
+ * a chunk directory. Uniform chunks (all empty, or all one
+ * tile) are shared, and chunks are copied on first edit.
+ * Use RayEngine_getTile/RayEngine_setTile for cell access.
+ * version changes whenever tiles change, so caches can
+ * tell when to rebuild.
+ * occupancy holds a bit per MAP_BLOCK_SIZE square block of
+ * each chunk, set if the block has any tile. Rays skip
+ * blocks (and whole chunks) whose bits are clear.
+ * solidBits and alphaBits hold a bit per tile (a uint32_t
+ * per chunk row, so MAP_CHUNK_SIZE must stay 32): set if
+ * the tile is non-empty, and if its texture has any alpha
+ * (see translucentTiles). The traversal only reads these,
+ * tile ids are fetched on a hit.
+ * wrapX/wrapY map a tile coordinate up to one tile outside
+ * the map + border back into it (the world is a torus of
+ * width + border * 2 by height + border * 2 tiles), see
+ * RayEngine_wrapX/RayEngine_wrapY.
+ */
 typedef struct _Map {
-	unsigned char* data;
+	MapTile** chunks;
+	uint8_t* chunkFlags;
+	uint64_t* occupancy;
+	uint32_t* solidBits;
+	uint32_t* alphaBits;
+	uint32_t translucentTiles[MAP_TILE_IDS >> 5];
+	int32_t* wrapX;
+	int32_t* wrapY;
+	int32_t chunksX;
+	int32_t chunksY;
+	MapTile* fillChunks[MAP_MAX_FILL];
+	MapTile fillTiles[MAP_MAX_FILL];
+	uint32_t numFill;
+	uint32_t* resident;
+	uint32_t numResident;
+	MapChunkLoader loadChunk;
+	void* loaderData;
+	uint32_t version;
+	unsigned char* floorData;
+	unsigned char* ceilingData;
 	SDL_Color* colorData;
 	int numColor;
 	int width;
@@ -27,13 +133,224 @@ enum BufferLayer {
 	BL_ALPHA
 };
 
+enum RenderStatsView {
+	RSV_OVERDRAW,
+	RSV_RAYSTEPS
+};
+
+/**
+ * Per-frame work counters. Only counted in builds with
+ * -DRAY_STATS, and only while attached to a DepthBuffer
+ * (buffer->stats), reset by RayEngine_resetDepthBuffer
+ */
+typedef struct {
+	uint32_t width;
+	uint32_t height;
+	uint64_t rays;
+	uint64_t rayHits;
+	uint64_t cellsVisited;
+	uint64_t pixWritten;
+	uint64_t pixRejected;
+	uint64_t alphaPix;
+	uint64_t spritesDrawn;
+	uint64_t spritesCulled;
+	uint32_t* pixWrites;
+	uint32_t* columnSteps;
+} RenderStats;
+
+#ifdef RAY_STATS
+#define RAY_STAT_ADD(stats, field, n) do { if (stats) { __atomic_fetch_add(&(stats)->field, (n), __ATOMIC_RELAXED); } } while (0)
+#else
+#define RAY_STAT_ADD(stats, field, n) do {} while (0)
+#endif
+
+// Materials a GBuffer can tell apart, and the shading tile size
+#define GBUFFER_MAX_MATERIALS 255
+#define GBUFFER_TILE 32
+
+/**
+ * One G-buffer pixel: texel u/v of tile in material (a
+ * registered RayTex, 0 for none) and its fog amount (0-1).
+ * Depth stays in the DepthBuffer.
+ */
+typedef struct {
+	float fog;
+	uint16_t u;
+	uint16_t v;
+	uint8_t material;
+	uint8_t tile;
+} GBufferPixel;
+
+/**
+ * Deferred shading, attach to buffer->gbuffer (NULL for
+ * shading as drawn). While attached, opaque wall and sprite
+ * pixels that pass the depth test store a GBufferPixel
+ * instead of a color, RayEngine_deferFloor stores the floor
+ * wherever nothing opaque was drawn, and
+ * RayEngine_shadeGBuffer resolves every stored pixel once,
+ * fading it fogScale times its fog amount towards fogColor
+ * (set to the engine's fog by RayEngine_initGBuffer).
+ * Translucent pixels are still shaded as drawn, into the
+ * alpha layer. Textures are registered as materials on first
+ * use and stay registered until the GBuffer is deleted.
+ */
+typedef struct {
+	uint32_t width;
+	uint32_t height;
+	SDL_Color fogColor;
+	double fogScale;
+	GBufferPixel* pixels;
+	RayTex* materials[GBUFFER_MAX_MATERIALS + 1];
+	uint32_t numMaterials;
+} GBuffer;
+
+// Most translucent fragments a KBuffer keeps per pixel, and its empty list
+#define KBUFFER_MAX_LAYERS 16
+#define KBUFFER_NONE UINT32_MAX
+
+/**
+ * One k-buffer fragment: a translucent color (alpha already
+ * scaled), its depth and the next fragment further away.
+ */
+typedef struct {
+	double depth;
+	uint32_t color;
+	uint32_t next;
+} KBufferFragment;
+
+/**
+ * Order independent transparency, attach to buffer->kbuffer
+ * (NULL for the single alpha layer). While attached,
+ * translucent pixels in front of the opaque layer are kept as
+ * fragments, up to layers per pixel in near to far lists, and
+ * RayEngine_renderBuffer blends them back to front. Fragments
+ * come from a pool of capacity allocated once; a pixel past
+ * layers evicts its furthest fragment and that, or anything
+ * that finds the pool empty, falls back to the alpha layer,
+ * which is blended in depth order with the rest.
+ * numOverflow counts those since the last reset.
+ */
+typedef struct {
+	uint32_t width;
+	uint32_t height;
+	uint8_t layers;
+	uint32_t* heads;
+	uint8_t* counts;
+	KBufferFragment* fragments;
+	uint32_t capacity;
+	uint32_t numFragments;
+	uint32_t numOverflow;
+} KBuffer;
+
+struct _RaySpans;
 typedef struct {
 	PixBuffer* pixelBuffer;
 	PixBuffer* alphaBuffer;
 	double* pixelDepth;
 	double* alphaDepth;
+	RenderStats* stats;
+	GBuffer* gbuffer;
+	struct _RaySpans* spans;
+	KBuffer* kbuffer;
 } DepthBuffer;
 
+enum RayFace {
+	RF_LEFT,
+	RF_RIGHT,
+	RF_TOP,
+	RF_BOTTOM,
+	RF_INSIDE
+};
+
+typedef struct {
+	double x;
+	double y;
+	double dirX;
+	double dirY;
+	double maxDist;
+} RayQuery;
+
+typedef struct _RayHit {
+	int32_t tileX;
+	int32_t tileY;
+	MapTile tile;
+	uint8_t face;
+	double dist;
+	double x;
+	double y;
+} RayHit;
+
+typedef struct {
+	int32_t mapX;
+	int32_t mapY;
+	int32_t stepX;
+	int32_t stepY;
+	int32_t offX;
+	int32_t offY;
+	double originX;
+	double originY;
+	double dirX;
+	double dirY;
+	double sideX;
+	double sideY;
+	double deltaX;
+	double deltaY;
+	double maxDist;
+	uint32_t steps;
+	uint8_t started;
+} RayTrace;
+
+/**
+ * Frame to frame ray coherence, attach to camera->coherence
+ * (NULL for none). clearDist holds, for the wedge between
+ * each traced column and the next, a radius around the last
+ * frame's camera position that is known to hold no tiles.
+ * Rays of the next frame that stay inside it trace their
+ * first few cells, then jump to where they leave it. Dropped
+ * (full traces) when the camera moves more than maxMove, the
+ * width or fov changes, or the map or its version changes.
+ */
+typedef struct _RayCoherence {
+	double x;
+	double y;
+	double angle;
+	double fov;
+	double maxMove;
+	uint32_t width;
+	uint32_t capacity;
+	struct _Map* map;
+	uint32_t version;
+	uint8_t valid;
+	double* clearDist;
+	double* nextClear;
+} RayCoherence;
+
+/**
+ * Interlaced rendering, attach to camera->interlace (NULL
+ * for none). While active, walls, floor and sprites only
+ * draw columns of one parity (field) each frame, and
+ * RayEngine_reconstructInterlace fills the other half from
+ * the last frame, reprojected through its depth. Pixels
+ * whose reprojected depth disagrees (more than depthRatio)
+ * are interpolated from their rendered neighbours instead.
+ */
+typedef struct _RayInterlace {
+	uint32_t width;
+	uint32_t height;
+	uint32_t field;
+	uint8_t active;
+	double depthRatio;
+	double x;
+	double y;
+	double h;
+	double angle;
+	double dirX;
+	double dirY;
+	double fov;
+	uint32_t* pixels;
+	double* depth;
+} RayInterlace;
+
 typedef struct _RaySprite {
 	RayTex* texture;
 	uint8_t frameNum;
@@ -44,6 +361,51 @@ typedef struct _RaySprite {
 	double h;
 } RaySprite;
 
+// Translucent wall slices kept per column, as many as a wall ray draws (without a deeper KBuffer)
+#define RAY_SPAN_LAYERS 3
+
+typedef struct {
+	double depth;
+	double fade;
+	int32_t y;
+	int32_t h;
+	uint32_t texCoord;
+	uint8_t tile;
+} RaySpanLayer;
+
+typedef struct {
+	RaySprite sprite;
+	double depth;
+	uint32_t order;
+} RaySpanSprite;
+
+/**
+ * Span clipping, attach to buffer->spans (NULL for per-pixel
+ * depth testing). While attached nothing reads or writes the
+ * DepthBuffer's depth or alpha layers. Each column's opaque
+ * wall slice is written straight to the pixel buffer, keeping
+ * its rows [top, bottom) and depth. Translucent wall slices in
+ * front of it (layers, near to far) and 3D sprites are kept
+ * instead of drawn, and RayEngine_drawSpans paints them back
+ * to front, clipping anything behind a column's wall to the
+ * rows outside it. RayEngine_deferFloor draws the floor
+ * outside the walls. Takes the place of an attached GBuffer,
+ * and can't be used with interlacing (which needs depth).
+ */
+typedef struct _RaySpans {
+	uint32_t width;
+	int32_t* top;
+	int32_t* bottom;
+	double* depth;
+	uint8_t* numLayers;
+	uint8_t* numDrawn;
+	RaySpanLayer* layers;
+	RayTex* wallTex;
+	RaySpanSprite* sprites;
+	uint32_t numSprites;
+	uint32_t spriteCapacity;
+} RaySpans;
+
 DepthBuffer* RayEngine_initDepthBuffer(uint32_t width, uint32_t height);
 double RayEngine_getDepth(DepthBuffer* buffer, uint32_t x, uint32_t y, uint8_t layer);
 void RayEngine_setDepth(DepthBuffer* buffer, uint32_t x, uint32_t y, uint8_t layer, double depth);
@@ -51,15 +413,127 @@ void RayEngine_drawPix(DepthBuffer* buffer, uint32_t x, uint32_t y, uint32_t col
 void RayEngine_drawTexColumn(DepthBuffer* buffer, uint32_t x, int32_t y, int32_t h, double depth, RayTex* texture, uint8_t tileNum, double alphaNum, uint32_t column, double fadePercent, SDL_Color targetColor);
 void RayEngine_renderBuffer(DepthBuffer* buffer);
 void RayEngine_resetDepthBuffer(DepthBuffer* buffer);
+void RayEngine_resizeDepthBuffer(DepthBuffer* buffer, uint32_t width, uint32_t height);
 void RayEngine_delDepthBuffer(DepthBuffer* buffer);
+RenderStats* RayEngine_initRenderStats(uint32_t width, uint32_t height);
+void RayEngine_resetRenderStats(RenderStats* stats);
+void RayEngine_delRenderStats(RenderStats* stats);
+void RayEngine_drawStatsView(PixBuffer* buffer, RenderStats* stats, uint8_t view);
+GBuffer* RayEngine_initGBuffer(uint32_t width, uint32_t height);
+void RayEngine_delGBuffer(GBuffer* gbuffer);
+void RayEngine_shadeGBuffer(DepthBuffer* buffer);
+KBuffer* RayEngine_initKBuffer(uint32_t width, uint32_t height, uint8_t layers, uint32_t capacity);
+void RayEngine_delKBuffer(KBuffer* kbuffer);
+RaySpans* RayEngine_initSpans(uint32_t width);
+void RayEngine_delSpans(RaySpans* spans);
+void RayEngine_initMap(Map* newMap, int width, int height, int border);
 void RayEngine_generateMap(Map* newMap, unsigned char* charList, int width, int height, int border, SDL_Color* colorData, int numColor);
+void RayEngine_delMap(Map* map);
+MapTile* RayEngine_getFillChunk(Map* map, MapTile tile);
+void RayEngine_setTile(Map* map, int32_t x, int32_t y, MapTile tile);
+void RayEngine_compactMap(Map* map);
+void RayEngine_updateOccupancy(Map* map, uint32_t chunk);
+void RayEngine_setTileTranslucency(Map* map, RayTex* texData);
+void RayEngine_setMapLoader(Map* map, MapChunkLoader loadChunk, void* loaderData);
+uint32_t RayEngine_streamMap(Map* map, double x, double y, double radius);
 void RayEngine_initSprite(RaySprite* newSprite, RayTex* texture, double scaleFactor, double alphaNum, double x, double y, double h);
 void RayEngine_draw2DSprite(PixBuffer* buffer, RaySprite sprite, double angle);
-void RayEngine_generateAngleValues(uint32_t width, Camera* camera);
+void RayEngine_initCamera(Camera* newCamera, double x, double y, double angle, double fov, double dist);
+void RayEngine_delCamera(Camera* camera);
+void RayEngine_updateCameraColumns(Camera* camera, uint32_t width);
+RayCoherence* RayEngine_initCoherence(double maxMove);
+void RayEngine_delCoherence(RayCoherence* coherence);
+RayInterlace* RayEngine_initInterlace(double depthRatio);
+void RayEngine_delInterlace(RayInterlace* interlace);
+void RayEngine_reconstructInterlace(DepthBuffer* buffer, Camera* camera);
 void RayEngine_draw3DSprite(DepthBuffer* rayBuffer, Camera* camera, uint32_t width, uint32_t height, double resolution, RaySprite sprite);
+void RayEngine_drawSpans(DepthBuffer* buffer, Camera* camera, uint32_t width, uint32_t height);
+void RayEngine_initTrace(RayTrace* trace, Map* map, double x, double y, double dirX, double dirY, double maxDist);
+uint8_t RayEngine_nextHit(RayTrace* trace, Map* map, RayHit* hit);
+void RayEngine_castRays(Map* map, RayTex* texData, RayQuery* queries, RayHit* hits, uint32_t numQueries);
+uint8_t RayEngine_lineOfSight(Map* map, RayTex* texData, double x0, double y0, double x1, double y1);
 void RayEngine_raycastRender(DepthBuffer* rayBuffer, Camera* camera, uint32_t width, uint32_t height, Map* map, double resolution, RayTex* texData);
 void RayEngine_texRenderFloor(PixBuffer* buffer, Camera* camera, uint32_t width, uint32_t height, Map* groundMap, double resolution, RayTex* texData, uint8_t tileNum);
+void RayEngine_deferFloor(DepthBuffer* buffer, Camera* camera, uint32_t width, uint32_t height, Map* groundMap, RayTex* texData, uint8_t tileNum);
 void RayEngine_texRenderCeiling(PixBuffer* buffer, Camera* camera, uint32_t width, uint32_t height, Map* ceilingMap, RayTex* texData, uint8_t tileNum);
 
 
+/** RayEngine_getTile
+ * @brief Reads a map cell, O(1) through the chunk directory
+ * ! x and y must be inside the map (not the border)
+ * @param map Map to read
+ * @param x Tile x coordinate
+ * @param y Tile y coordinate
+ * @return MapTile Tile id, 0 if empty
+ */
+static inline MapTile RayEngine_getTile(Map* map, int32_t x, int32_t y)
+{
+	return map->chunks[(y >> MAP_CHUNK_SHIFT) * map->chunksX + (x >> MAP_CHUNK_SHIFT)]
+		[((y & MAP_CHUNK_MASK) << MAP_CHUNK_SHIFT) | (x & MAP_CHUNK_MASK)];
+}
+
+/** RayEngine_isColumnSkipped
+ * @brief Checks if interlacing leaves a screen column out this frame
+ * 
+ * @param camera Camera being rendered
+ * @param column Screen column
+ * @return uint8_t 1 if the column is reconstructed instead of drawn
+ */
+static inline uint8_t RayEngine_isColumnSkipped(Camera* camera, uint32_t column)
+{
+	return camera->interlace && camera->interlace->active && (column & 1) != camera->interlace->field;
+}
+
+/** RayEngine_wrapX
+ * @brief Wraps a tile x coordinate around the map, no branches
+ * ! x must be within one tile of the map + border area
+ * @param map Map to wrap around
+ * @param x Tile x coordinate, -border - 1 to width + border
+ * @return int32_t Same tile inside -border to width + border - 1
+ */
+static inline int32_t RayEngine_wrapX(Map* map, int32_t x)
+{
+	return map->wrapX[x];
+}
+
+/** RayEngine_wrapY
+ * @brief Wraps a tile y coordinate around the map, no branches
+ * ! y must be within one tile of the map + border area
+ * @param map Map to wrap around
+ * @param y Tile y coordinate, -border - 1 to height + border
+ * @return int32_t Same tile inside -border to height + border - 1
+ */
+static inline int32_t RayEngine_wrapY(Map* map, int32_t y)
+{
+	return map->wrapY[y];
+}
+
+/** RayEngine_isSolid
+ * @brief Checks a map cell through the solid bitmap
+ * ! x and y must be inside the map (not the border)
+ * @param map Map to read
+ * @param x Tile x coordinate
+ * @param y Tile y coordinate
+ * @return uint8_t 1 if the cell holds a tile, 0 if empty
+ */
+static inline uint8_t RayEngine_isSolid(Map* map, int32_t x, int32_t y)
+{
+	uint32_t c = (y >> MAP_CHUNK_SHIFT) * map->chunksX + (x >> MAP_CHUNK_SHIFT);
+	return (map->solidBits[(c << MAP_CHUNK_SHIFT) | (y & MAP_CHUNK_MASK)] >> (x & MAP_CHUNK_MASK)) & 1;
+}
+
+/** RayEngine_isTranslucent
+ * @brief Checks if a map cell's texture may let rays through
+ * ! x and y must be inside the map (not the border)
+ * @param map Map to read
+ * @param x Tile x coordinate
+ * @param y Tile y coordinate
+ * @return uint8_t 1 if the tile has alpha somewhere, 0 if opaque or empty
+ */
+static inline uint8_t RayEngine_isTranslucent(Map* map, int32_t x, int32_t y)
+{
+	uint32_t c = (y >> MAP_CHUNK_SHIFT) * map->chunksX + (x >> MAP_CHUNK_SHIFT);
+	return (map->alphaBits[(c << MAP_CHUNK_SHIFT) | (y & MAP_CHUNK_MASK)] >> (x & MAP_CHUNK_MASK)) & 1;
+}
+
 #endif//RAYENGINE_H
\ No newline at end of file
@@ -0,0 +1,32 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "gameengine.h"
+
+#define REPLAY_MAGIC "RREC"
+#define REPLAY_VERSION 1
+
+/**
+ * Per-tick input log. Recording stores the KeyMap state
+ * (one bit per key) and the mouse motion each simulation
+ * step consumes, playback feeds them back in at the same
+ * step so the simulation repeats exactly.
+ */
+typedef struct {
+	uint32_t seed;
+	uint32_t stepRate;
+	uint32_t numTicks;
+	uint32_t capacity;
+	uint32_t tick;
+	uint16_t* keyBits;
+	int16_t* mouseX;
+} Replay;
+
+Replay* Replay_init(uint32_t seed, uint32_t stepRate);
+void Replay_del(Replay* replay);
+void Replay_record(Replay* replay, KeyMap* keyMap);
+uint8_t Replay_play(Replay* replay, KeyMap* keyMap);
+int Replay_save(Replay* replay, const char* path);
+Replay* Replay_load(const char* path);
+
+#endif//REPLAY_H
@@ -0,0 +1,40 @@
+#ifndef SPATIALHASH_H
+#define SPATIALHASH_H
+
+#include "rayengine.h"
+
+#define HASH_NONE 0xFFFFFFFF
+
+/**
+ * Uniform grid over the map tiles (border included),
+ * one bucket per tile. Each bucket is an intrusive
+ * doubly linked list of entity handles, so moving an
+ * entity between tiles is O(1).
+ */
+typedef struct {
+	int32_t width;
+	int32_t height;
+	int32_t border;
+	uint32_t* cellHead;
+	uint32_t* cellStamp;
+	uint32_t stamp;
+	uint32_t capacity;
+	uint32_t* next;
+	uint32_t* prev;
+	uint32_t* cell;
+	double* x;
+	double* y;
+} SpatialHash;
+
+SpatialHash* SpatialHash_init(Map* map, uint32_t capacity);
+void SpatialHash_del(SpatialHash* hash);
+void SpatialHash_reserve(SpatialHash* hash, uint32_t capacity);
+void SpatialHash_insert(SpatialHash* hash, uint32_t handle, double x, double y);
+void SpatialHash_remove(SpatialHash* hash, uint32_t handle);
+void SpatialHash_move(SpatialHash* hash, uint32_t handle, double x, double y);
+uint32_t SpatialHash_queryTiles(SpatialHash* hash, int32_t x0, int32_t y0, int32_t x1, int32_t y1, uint32_t* out, uint32_t maxOut);
+uint32_t SpatialHash_queryRadius(SpatialHash* hash, double x, double y, double radius, uint32_t* out, uint32_t maxOut);
+uint32_t SpatialHash_queryCorridor(SpatialHash* hash, double x, double y, double dirX, double dirY, double length, double halfWidth, uint32_t* out, uint32_t maxOut);
+uint32_t SpatialHash_queryView(SpatialHash* hash, Camera* camera, double viewDist, double margin, uint32_t* out, uint32_t maxOut);
+
+#endif//SPATIALHASH_H
@@ -0,0 +1,26 @@
+#ifndef TESTSCENE_H
+#define TESTSCENE_H
+
+#include "rayengine.h"
+
+#define TEST_SCENE_SEED 0x2545F491
+
+/**
+ * Wall tiles of the procedural test textures, map value n
+ * draws wall texture tile n - 1 (see TestScene_generateTextures)
+ */
+enum TestTile {
+	TT_EMPTY,
+	TT_BRICK,
+	TT_STRIPE,
+	TT_GLASS,
+	TT_FLOOR
+};
+
+void TestScene_seedRandom(uint32_t seed);
+uint32_t TestScene_random(void);
+void TestScene_generateTextures(RayTex* wallTex, RayTex* spriteTex, uint32_t size);
+void TestScene_delTextures(RayTex* wallTex, RayTex* spriteTex);
+PixBuffer* TestScene_initBackground(uint32_t width, uint32_t height);
+
+#endif//TESTSCENE_H
@@ -0,0 +1,634 @@
+/**
+ * Deterministic benchmark for the RayEngine render
+ * pipeline. Renders fixed, procedurally built scenes
+ * along scripted camera paths at several internal
+ * resolutions, and reports frame time and per-stage
+ * timing as JSON so engine versions can be compared.
+ *
+ * Usage: engine_bench [--frames N] [--scene NAME]
+ *                     [--res WxH]... [--lod N] [--coherence]
+ *                     [--interlace] [--deferred | --spans]
+ *                     [--kbuffer K] [--out FILE]
+ *
+ * @date 19/10/2026
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "gameengine.h"
+#include "testscene.h"
+
+#define TEX_SIZE 32
+#define WARMUP_FRAMES 10
+#define MAX_RES 8
+#define CROWD_SIZE 1000
+#define NUM_SCENES 6
+// Fragment pool for --kbuffer, in bytes
+#define KBUFFER_BUDGET (8 * 1024 * 1024)
+
+enum BenchStage {
+	BS_RESET,
+	BS_FLOOR,
+	BS_WALLS,
+	BS_SPRITES,
+	BS_COMPOSITE,
+	BS_POST,
+	LEN_BS
+};
+
+static const char* stageNames[LEN_BS] = {
+	"reset", "floor", "walls", "sprites", "composite", "post"
+};
+
+typedef struct {
+	double x;
+	double y;
+} PathPoint;
+
+typedef struct {
+	const char* name;
+	Map map;
+	unsigned char* mapData;
+	PathPoint* path;
+	uint32_t pathLen;
+	double viewDist;
+	uint32_t numSprites;
+	uint8_t post;
+} BenchScene;
+
+static uint64_t Bench_now(void)
+{
+	return SDL_GetPerformanceCounter();
+}
+
+static double Bench_toMs(uint64_t ticks)
+{
+	return 1000.0 * (double)ticks / (double)SDL_GetPerformanceFrequency();
+}
+
+/** Bench_initScene
+ * @brief Allocates an empty scene map with a solid perimeter
+ * * Builders edit mapData, Bench_finishScene turns it into the Map
+ */
+static void Bench_initScene(BenchScene* scene, const char* name, int width, int height, double viewDist)
+{
+	memset(scene, 0, sizeof(BenchScene));
+	scene->name = name;
+	scene->viewDist = viewDist;
+	scene->mapData = (unsigned char*)calloc(width * height, 1);
+	for (int i = 0; i < width; i++)
+	{
+		scene->mapData[i] = TT_BRICK;
+		scene->mapData[(height - 1) * width + i] = TT_BRICK;
+	}
+	for (int i = 0; i < height; i++)
+	{
+		scene->mapData[i * width] = TT_BRICK;
+		scene->mapData[i * width + width - 1] = TT_BRICK;
+	}
+	scene->map.width = width;
+	scene->map.height = height;
+}
+
+/** Bench_finishScene
+ * @brief Builds the scene Map from its finished mapData
+ */
+static void Bench_finishScene(BenchScene* scene)
+{
+	RayEngine_generateMap(&scene->map, scene->mapData, scene->map.width, scene->map.height, 2, NULL, 0);
+	free(scene->mapData);
+	scene->mapData = NULL;
+}
+
+/** Bench_circlePath
+ * @brief Scripted path around a circle (camera looks along it)
+ */
+static void Bench_circlePath(BenchScene* scene, double cx, double cy, double radius, uint32_t numPoints)
+{
+	scene->pathLen = numPoints;
+	scene->path = (PathPoint*)malloc(sizeof(PathPoint) * numPoints);
+	for (uint32_t i = 0; i < numPoints; i++)
+	{
+		double angle = 2 * M_PI * i / (numPoints - 1);
+		scene->path[i].x = cx + radius * cos(angle);
+		scene->path[i].y = cy + radius * sin(angle);
+	}
+}
+
+/** Bench_buildOpenField
+ * @brief Large open map with sparse pillars and a long view distance
+ */
+static void Bench_buildOpenField(BenchScene* scene, const char* name, uint8_t post)
+{
+	Bench_initScene(scene, name, 64, 64, 20);
+	for (int y = 8; y < 64; y += 12)
+	{
+		for (int x = 8; x < 64; x += 12)
+		{
+			scene->mapData[y * 64 + x] = TT_STRIPE;
+		}
+	}
+	scene->post = post;
+	Bench_circlePath(scene, 32.5, 32.5, 18, 64);
+}
+
+/** Bench_buildLongView
+ * @brief Huge sparse field viewed out to 64 tiles, mostly empty space
+ */
+static void Bench_buildLongView(BenchScene* scene)
+{
+	const int size = 256;
+	Bench_initScene(scene, "long_view", size, size, 64);
+	for (int y = 16; y < size; y += 48)
+	{
+		for (int x = 16; x < size; x += 48)
+		{
+			scene->mapData[y * size + x] = TT_STRIPE;
+			scene->mapData[y * size + x + 1] = TT_BRICK;
+		}
+	}
+	Bench_circlePath(scene, 128.5, 128.5, 80, 64);
+}
+
+/** Bench_buildMaze
+ * @brief Dense maze, camera follows the carving path
+ */
+static void Bench_buildMaze(BenchScene* scene)
+{
+	const int size = 63;
+	const int cells = size / 2;
+	Bench_initScene(scene, "maze", size, size, 8);
+	memset(scene->mapData, TT_BRICK, size * size);
+	// Iterative backtracker over odd coordinates
+	int* stack = (int*)malloc(sizeof(int) * cells * cells);
+	uint8_t* visited = (uint8_t*)calloc(cells * cells, 1);
+	scene->path = (PathPoint*)malloc(sizeof(PathPoint) * cells * cells);
+	int top = 0;
+	stack[top++] = 0;
+	visited[0] = 1;
+	scene->mapData[size + 1] = TT_EMPTY;
+	uint8_t recording = 1;
+	scene->path[scene->pathLen].x = 1.5;
+	scene->path[scene->pathLen++].y = 1.5;
+	while (top)
+	{
+		int cell = stack[top - 1];
+		int cx = cell % cells;
+		int cy = cell / cells;
+		int options[4];
+		int numOptions = 0;
+		const int dirs[4][2] = {{1,0},{-1,0},{0,1},{0,-1}};
+		for (int d = 0; d < 4; d++)
+		{
+			int nx = cx + dirs[d][0];
+			int ny = cy + dirs[d][1];
+			if (nx >= 0 && ny >= 0 && nx < cells && ny < cells && !visited[ny * cells + nx])
+			{
+				options[numOptions++] = d;
+			}
+		}
+		if (!numOptions)
+		{
+			// First dead end ends the camera path
+			recording = 0;
+			top--;
+			continue;
+		}
+		int d = options[TestScene_random() % numOptions];
+		int nx = cx + dirs[d][0];
+		int ny = cy + dirs[d][1];
+		visited[ny * cells + nx] = 1;
+		scene->mapData[(cy * 2 + 1 + dirs[d][1]) * size + cx * 2 + 1 + dirs[d][0]] = TT_EMPTY;
+		scene->mapData[(ny * 2 + 1) * size + nx * 2 + 1] = TT_EMPTY;
+		if (recording)
+		{
+			scene->path[scene->pathLen].x = nx * 2 + 1.5;
+			scene->path[scene->pathLen++].y = ny * 2 + 1.5;
+		}
+		stack[top++] = ny * cells + nx;
+	}
+	// Vary wall textures
+	for (int i = 0; i < size * size; i++)
+	{
+		if (scene->mapData[i] && (TestScene_random() % 3) == 0)
+		{
+			scene->mapData[i] = TT_STRIPE;
+		}
+	}
+	free(stack);
+	free(visited);
+}
+
+/** Bench_buildGallery
+ * @brief Rows of glass panes so rays pass through several translucent layers
+ */
+static void Bench_buildGallery(BenchScene* scene)
+{
+	Bench_initScene(scene, "glass_gallery", 40, 40, 10);
+	for (int y = 6; y < 34; y += 4)
+	{
+		for (int x = 4; x < 36; x++)
+		{
+			if (x % 6 != 0)
+			{
+				scene->mapData[y * 40 + x] = TT_GLASS;
+			}
+		}
+	}
+	scene->pathLen = 5;
+	scene->path = (PathPoint*)malloc(sizeof(PathPoint) * scene->pathLen);
+	const PathPoint points[5] = {{2.5, 2.5}, {2.5, 36.5}, {18.5, 36.5}, {18.5, 4.5}, {36.5, 4.5}};
+	memcpy(scene->path, points, sizeof(points));
+}
+
+/** Bench_buildCrowd
+ * @brief Open arena filled with CROWD_SIZE pooled sprites
+ */
+static void Bench_buildCrowd(BenchScene* scene)
+{
+	Bench_initScene(scene, "sprite_crowd", 48, 48, 10);
+	scene->numSprites = CROWD_SIZE;
+	Bench_circlePath(scene, 24.5, 24.5, 14, 64);
+}
+
+/** Bench_pathPose
+ * @brief Samples camera position and heading along a scene path
+ */
+static void Bench_pathPose(BenchScene* scene, uint32_t frame, uint32_t numFrames, Camera* camera)
+{
+	double pos = (double)frame / (double)(numFrames > 1 ? numFrames - 1 : 1) * (scene->pathLen - 1);
+	uint32_t seg = (uint32_t)pos;
+	if (seg >= scene->pathLen - 1)
+	{
+		seg = scene->pathLen - 2;
+	}
+	double part = pos - seg;
+	PathPoint a = scene->path[seg];
+	PathPoint b = scene->path[seg + 1];
+	camera->x = a.x + (b.x - a.x) * part;
+	camera->y = a.y + (b.y - a.y) * part;
+	camera->angle = atan2(b.y - a.y, b.x - a.x);
+}
+
+static int Bench_compareDouble(const void* a, const void* b)
+{
+	double da = *(const double*)a;
+	double db = *(const double*)b;
+	return (da > db) - (da < db);
+}
+
+/** Bench_writeStats
+ * @brief Writes mean/p50/p99 of a sample set as a JSON object
+ */
+static void Bench_writeStats(FILE* out, double* samples, uint32_t count)
+{
+	double sum = 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		sum += samples[i];
+	}
+	qsort(samples, count, sizeof(double), Bench_compareDouble);
+	fprintf(out, "{\"mean\": %.4f, \"p50\": %.4f, \"p99\": %.4f}",
+		sum / count, samples[count / 2], samples[(uint32_t)((count - 1) * 0.99)]);
+}
+
+/** Bench_runScene
+ * @brief Renders a scene along its path and writes timings as JSON
+ */
+static void Bench_runScene(FILE* out, BenchScene* scene, uint32_t width, uint32_t height, uint32_t numFrames, uint32_t columnStep, uint8_t coherent, uint8_t interlaced, uint8_t deferred, uint8_t spans, uint8_t kbufferLayers, RayTex* wallTex, RayTex* spriteTex)
+{
+	DepthBuffer* buffer = RayEngine_initDepthBuffer(width, height);
+	if (deferred)
+	{
+		buffer->gbuffer = RayEngine_initGBuffer(width, height);
+	}
+	if (spans)
+	{
+		buffer->spans = RayEngine_initSpans(width);
+	}
+	if (kbufferLayers)
+	{
+		buffer->kbuffer = RayEngine_initKBuffer(width, height, kbufferLayers, KBUFFER_BUDGET / sizeof(KBufferFragment));
+	}
+	PixBuffer* background = TestScene_initBackground(width, height);
+
+	Camera camera;
+	RayEngine_initCamera(&camera, 0, 0, 0, M_PI / 2, scene->viewDist);
+	camera.columnStep = columnStep;
+	if (coherent)
+	{
+		camera.coherence = RayEngine_initCoherence(0.5);
+	}
+	if (interlaced)
+	{
+		camera.interlace = RayEngine_initInterlace(0.05);
+	}
+	RayEngine_updateCameraColumns(&camera, width);
+
+	// Crowd
+	RaySprite crowdSprite;
+	RayEngine_initSprite(&crowdSprite, spriteTex, 1.0, 1.0, 0, 0, 0);
+	EntityPool* pool = NULL;
+	SpatialHash* grid = NULL;
+	if (scene->numSprites)
+	{
+		TestScene_seedRandom(TEST_SCENE_SEED);
+		pool = GameEngine_initEntityPool(scene->numSprites, NULL);
+		grid = SpatialHash_init(&scene->map, scene->numSprites);
+		GameEngine_setEntityPoolGrid(pool, grid);
+		for (uint32_t s = 0; s < scene->numSprites; s++)
+		{
+			double x = 1.5 + (TestScene_random() % 10000) / 10000.0 * (scene->map.width - 3);
+			double y = 1.5 + (TestScene_random() % 10000) / 10000.0 * (scene->map.height - 3);
+			GameEngine_spawnEntity(pool, &crowdSprite, x, y, 0, 0, 0, 0);
+		}
+	}
+
+	double* frameMs = (double*)malloc(sizeof(double) * numFrames);
+	uint64_t kbufferOverflow = 0;
+	double* stageMs[LEN_BS];
+	for (int s = 0; s < LEN_BS; s++)
+	{
+		stageMs[s] = (double*)malloc(sizeof(double) * numFrames);
+	}
+#ifdef RAY_STATS
+	// Work counters, summed over measured frames
+	RenderStats* stats = RayEngine_initRenderStats(width, height);
+	RenderStats statTotals = {0};
+	buffer->stats = stats;
+#endif
+	SDL_Color sepia = {221, 153, 153, 255};
+	uint64_t stamps[LEN_BS + 1];
+	for (uint32_t f = 0; f < numFrames + WARMUP_FRAMES; f++)
+	{
+		uint32_t frame = f < WARMUP_FRAMES ? 0 : f - WARMUP_FRAMES;
+		Bench_pathPose(scene, frame, numFrames, &camera);
+
+		stamps[BS_RESET] = Bench_now();
+		RayEngine_resetDepthBuffer(buffer);
+		memcpy(buffer->pixelBuffer->pixels, background->pixels, sizeof(uint32_t) * width * height);
+		stamps[BS_FLOOR] = Bench_now();
+		if (!deferred && !spans)
+		{
+			RayEngine_texRenderFloor(buffer->pixelBuffer, &camera, width, height, NULL, 0, wallTex, TT_FLOOR - 1);
+		}
+		stamps[BS_WALLS] = Bench_now();
+		RayEngine_raycastRender(buffer, &camera, width, height, &scene->map, 0.01, wallTex);
+		stamps[BS_SPRITES] = Bench_now();
+		if (pool)
+		{
+			GameEngine_drawEntityPool(buffer, &camera, width, height, pool, 1.0);
+		}
+		stamps[BS_COMPOSITE] = Bench_now();
+		if (deferred)
+		{
+			// Deferred floor and shading count as composite
+			RayEngine_deferFloor(buffer, &camera, width, height, NULL, wallTex, TT_FLOOR - 1);
+			RayEngine_shadeGBuffer(buffer);
+		}
+		if (spans)
+		{
+			// So do floor and back to front sprites with spans
+			RayEngine_deferFloor(buffer, &camera, width, height, NULL, wallTex, TT_FLOOR - 1);
+			RayEngine_drawSpans(buffer, &camera, width, height);
+		}
+		RayEngine_renderBuffer(buffer);
+		if (camera.interlace)
+		{
+			RayEngine_reconstructInterlace(buffer, &camera);
+		}
+		stamps[BS_POST] = Bench_now();
+		if (scene->post)
+		{
+			PixBuffer_monochromeFilter(buffer->pixelBuffer, sepia, 0.5);
+			PixBuffer_fillBuffer(buffer->pixelBuffer, PixBuffer_toPixColor(150, 0, 20, 255), 0.2);
+			PixBuffer_orderDither256(buffer->pixelBuffer, 5);
+		}
+		stamps[LEN_BS] = Bench_now();
+
+		if (f >= WARMUP_FRAMES)
+		{
+			for (int s = 0; s < LEN_BS; s++)
+			{
+				stageMs[s][frame] = Bench_toMs(stamps[s + 1] - stamps[s]);
+			}
+			frameMs[frame] = Bench_toMs(stamps[LEN_BS] - stamps[BS_RESET]);
+			kbufferOverflow += buffer->kbuffer ? buffer->kbuffer->numOverflow : 0;
+#ifdef RAY_STATS
+			statTotals.rays += stats->rays;
+			statTotals.rayHits += stats->rayHits;
+			statTotals.cellsVisited += stats->cellsVisited;
+			statTotals.pixWritten += stats->pixWritten;
+			statTotals.pixRejected += stats->pixRejected;
+			statTotals.alphaPix += stats->alphaPix;
+			statTotals.spritesDrawn += stats->spritesDrawn;
+			statTotals.spritesCulled += stats->spritesCulled;
+#endif
+		}
+	}
+
+	fprintf(out, "    {\"scene\": \"%s\", \"width\": %u, \"height\": %u, \"frames\": %u, \"column_step\": %u, \"coherence\": %u, \"interlace\": %u, \"deferred\": %u, \"spans\": %u, \"kbuffer\": %u,\n", scene->name, width, height, numFrames, columnStep, coherent, interlaced, deferred, spans, kbufferLayers);
+	fprintf(out, "     \"frame_ms\": ");
+	Bench_writeStats(out, frameMs, numFrames);
+	fprintf(out, ",\n     \"stages_ms\": {");
+	for (int s = 0; s < LEN_BS; s++)
+	{
+		fprintf(out, "%s\n       \"%s\": ", s ? "," : "", stageNames[s]);
+		Bench_writeStats(out, stageMs[s], numFrames);
+	}
+	fprintf(out, "}");
+	if (buffer->kbuffer)
+	{
+		fprintf(out, ",\n     \"kbuffer_overflow_per_frame\": %.1f", (double)kbufferOverflow / numFrames);
+	}
+#ifdef RAY_STATS
+	fprintf(out, ",\n     \"counters_per_frame\": {\"rays\": %.1f, \"ray_hits\": %.1f, \"cells_visited\": %.1f, "
+		"\"pix_written\": %.1f, \"pix_rejected\": %.1f, \"alpha_pix\": %.1f, \"sprites_drawn\": %.1f, \"sprites_culled\": %.1f}",
+		(double)statTotals.rays / numFrames, (double)statTotals.rayHits / numFrames,
+		(double)statTotals.cellsVisited / numFrames, (double)statTotals.pixWritten / numFrames,
+		(double)statTotals.pixRejected / numFrames, (double)statTotals.alphaPix / numFrames,
+		(double)statTotals.spritesDrawn / numFrames, (double)statTotals.spritesCulled / numFrames);
+	buffer->stats = NULL;
+	RayEngine_delRenderStats(stats);
+#endif
+	fprintf(out, "}");
+
+	for (int s = 0; s < LEN_BS; s++)
+	{
+		free(stageMs[s]);
+	}
+	free(frameMs);
+	if (pool)
+	{
+		GameEngine_delEntityPool(pool);
+		SpatialHash_del(grid);
+	}
+	PixBuffer_delPixBuffer(background);
+	if (buffer->gbuffer)
+	{
+		RayEngine_delGBuffer(buffer->gbuffer);
+	}
+	if (buffer->spans)
+	{
+		RayEngine_delSpans(buffer->spans);
+	}
+	if (buffer->kbuffer)
+	{
+		RayEngine_delKBuffer(buffer->kbuffer);
+	}
+	RayEngine_delDepthBuffer(buffer);
+	if (camera.coherence)
+	{
+		RayEngine_delCoherence(camera.coherence);
+	}
+	if (camera.interlace)
+	{
+		RayEngine_delInterlace(camera.interlace);
+	}
+	RayEngine_delCamera(&camera);
+}
+
+int main(int argc, char* argv[])
+{
+	uint32_t numFrames = 240;
+	const char* sceneFilter = NULL;
+	const char* outPath = NULL;
+	uint32_t resolutions[MAX_RES][2] = {{256, 224}, {512, 448}, {1024, 896}};
+	uint32_t numRes = 3;
+	uint8_t customRes = 0;
+	uint32_t columnStep = 1;
+	uint8_t coherent = 0;
+	uint8_t interlaced = 0;
+	uint8_t deferred = 0;
+	uint8_t spans = 0;
+	uint8_t kbufferLayers = 0;
+	for (int a = 1; a < argc; a++)
+	{
+		if (!strcmp(argv[a], "--frames") && a + 1 < argc)
+		{
+			numFrames = (uint32_t)strtoul(argv[++a], NULL, 10);
+		}
+		else if (!strcmp(argv[a], "--scene") && a + 1 < argc)
+		{
+			sceneFilter = argv[++a];
+		}
+		else if (!strcmp(argv[a], "--out") && a + 1 < argc)
+		{
+			outPath = argv[++a];
+		}
+		else if (!strcmp(argv[a], "--lod") && a + 1 < argc)
+		{
+			columnStep = (uint32_t)strtoul(argv[++a], NULL, 10);
+		}
+		else if (!strcmp(argv[a], "--coherence"))
+		{
+			coherent = 1;
+		}
+		else if (!strcmp(argv[a], "--interlace"))
+		{
+			interlaced = 1;
+		}
+		else if (!strcmp(argv[a], "--deferred"))
+		{
+			deferred = 1;
+		}
+		else if (!strcmp(argv[a], "--spans"))
+		{
+			spans = 1;
+		}
+		else if (!strcmp(argv[a], "--kbuffer") && a + 1 < argc)
+		{
+			kbufferLayers = (uint8_t)strtoul(argv[++a], NULL, 10);
+		}
+		else if (!strcmp(argv[a], "--res") && a + 1 < argc)
+		{
+			if (!customRes)
+			{
+				numRes = 0;
+				customRes = 1;
+			}
+			if (numRes < MAX_RES && sscanf(argv[++a], "%ux%u", &resolutions[numRes][0], &resolutions[numRes][1]) == 2 && \
+				resolutions[numRes][0] && resolutions[numRes][1])
+			{
+				numRes++;
+			}
+			else
+			{
+				fprintf(stderr, "ERROR: Bad resolution %s\n", argv[a]);
+				return -1;
+			}
+		}
+		else
+		{
+			fprintf(stderr, "Usage: %s [--frames N] [--scene NAME] [--res WxH]... [--lod N] [--coherence] [--interlace] [--deferred | --spans] [--kbuffer K] [--out FILE]\n", argv[0]);
+			return -1;
+		}
+	}
+	if (spans && (deferred || interlaced || kbufferLayers))
+	{
+		fprintf(stderr, "ERROR: --spans can't be combined with --deferred, --interlace or --kbuffer\n");
+		return -1;
+	}
+	if (!numFrames)
+	{
+		numFrames = 1;
+	}
+	FILE* out = outPath ? fopen(outPath, "w") : stdout;
+	if (!out)
+	{
+		fprintf(stderr, "ERROR: Could not open %s\n", outPath);
+		return -1;
+	}
+
+	RayTex wallTex;
+	RayTex spriteTex;
+	TestScene_generateTextures(&wallTex, &spriteTex, TEX_SIZE);
+
+	BenchScene scenes[NUM_SCENES];
+	Bench_buildOpenField(&scenes[0], "open_field", 0);
+	Bench_buildMaze(&scenes[1]);
+	Bench_buildGallery(&scenes[2]);
+	Bench_buildCrowd(&scenes[3]);
+	Bench_buildOpenField(&scenes[4], "post_process", 1);
+	Bench_buildLongView(&scenes[5]);
+	for (int s = 0; s < NUM_SCENES; s++)
+	{
+		Bench_finishScene(&scenes[s]);
+		RayEngine_setTileTranslucency(&scenes[s].map, &wallTex);
+	}
+
+	fprintf(out, "{\n  \"benchmark\": \"rayengine\",\n  \"results\": [\n");
+	uint8_t first = 1;
+	for (int s = 0; s < NUM_SCENES; s++)
+	{
+		if (sceneFilter && strcmp(sceneFilter, scenes[s].name))
+		{
+			continue;
+		}
+		for (uint32_t r = 0; r < numRes; r++)
+		{
+			if (!first)
+			{
+				fprintf(out, ",\n");
+			}
+			first = 0;
+			Bench_runScene(out, &scenes[s], resolutions[r][0], resolutions[r][1], numFrames, columnStep, coherent, interlaced, deferred, spans, kbufferLayers, &wallTex, &spriteTex);
+			fflush(out);
+		}
+	}
+	fprintf(out, "\n  ]\n}\n");
+
+	for (int s = 0; s < NUM_SCENES; s++)
+	{
+		RayEngine_delMap(&scenes[s].map);
+		free(scenes[s].path);
+	}
+	TestScene_delTextures(&wallTex, &spriteTex);
+	if (out != stdout)
+	{
+		fclose(out);
+	}
+	return 0;
+}
@@ -1,19 +1,23 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
 #include "gameengine.h"
 #include "pixrender.h"
+#include "profiler.h"
+#include "replay.h"
+#include "mapfile.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #include "../assets/asset_list.h" // DEPRECATED
 //#include "private_assets/private_asset_list.h"
 
-#define SCALE 4
-const unsigned int WIDTH = WIDDERSHINS/SCALE;
-const unsigned int HEIGHT = TURNWISE/SCALE;
+// Default window pixels per render pixel
+#define DEFAULT_SCALE 4
 #define MAP_SCALE 1
-#define MAP_WIDTH 10
-#define MAP_HEIGHT 13
+// Fixed simulation rate (steps per second)
+#define SIM_RATE 120
+#define MAX_SIM_STEPS 8
 
 // Test renderer
 SDL_Renderer* renderer = NULL;
@@ -23,48 +27,385 @@ SDL_Event event;
 
 SDL_Color BLACK = {0,0,0,255};
 
+/** Demo_drawBackground
+ * @brief Draws the sky gradient, ground and horizon fog for a buffer size
+ * @param background PixBuffer to draw to
+ * @param depth View depth, sets the fog band height
+ */
+static void Demo_drawBackground(PixBuffer* background, double depth)
+{
+	uint32_t width = background->width;
+	uint32_t height = background->height;
+	SDL_Color nightHorizon = {50,20,50,255};
+	SDL_Color eveningSky =  {0x5c,0x57,0xff,255};
+	SDL_Color eveningHorizon = {0xff,0x40,0x00,255};
+	SDL_Rect gradientRectTop = {0,0,width,height/2};
+	//SDL_Color colorTop1 = {189,255,255,255};//{255,100,100,255};
+	//SDL_Color colorTop2 = {77,150,154,255};//{0,0,100,255};
+	SDL_Color colorTop1 = eveningSky;//{0x5c,0x57,0xff,255};
+	SDL_Color colorTop2 = eveningHorizon;//{0xff,0x40,0x00,255};
+	SDL_Rect gradientRectBottom = {0,height/2,width,height/2};
+	//SDL_Color colorBottom1 = {159,197,182,255};
+	//SDL_Color colorBottom2 = {79,172,135,255};
+	SDL_Color colorBottom1 = {50,50,80,255};
+	SDL_Color colorBottom2 = {150,150,190,255};
+	// Fog gradient
+	SDL_Color fogFade = {50,20,50,0};//{50,50,80,0};
+	SDL_Color fogPrimary = nightHorizon;//{50,50,80,255};
+	SDL_Rect fogRectBottom = {0,height/2+(int)floor((double)height/(depth*10)),width,(int)floor((double)height/(depth*10))};
+	SDL_Rect fogRectCenter = {0, height/2-(int)floor((double)height/(depth*10)),width, (int)floor((double)height/(depth*10))*2};
+	SDL_Rect fogRectTop = {0,height/2-(int)floor((double)height/(depth*10))*2,width,(int)floor((double)height/(depth*10))};
+	PixBuffer_clearBuffer(background);
+	PixBuffer_drawHorizGradient(background,&gradientRectTop, colorTop1, colorTop2);
+	//PixBuffer_drawHorizGradient(&buffer,&gradientRectBottom, colorBottom1, colorBottom2);
+	PixBuffer_drawRect(background, &gradientRectBottom, colorBottom1);
+	// Render fog
+	PixBuffer_drawRect(background, &fogRectCenter, fogPrimary);
+	PixBuffer_drawHorizGradient(background,&fogRectTop, fogFade, fogPrimary);
+	PixBuffer_drawHorizGradient(background,&fogRectBottom, fogPrimary, fogFade);
+}
+
+/**
+ * One simulated frame: the render snapshot plus the game
+ * state the post effects need
+ */
+typedef struct {
+	FrameSnapshot snapshot;
+	uint8_t playerState;
+	double playerTimer;
+	double simTime;
+	uint8_t paused;
+} DemoFrame;
+
+/**
+ * Simulation side of the frame loop. Only touched by
+ * whoever runs Demo_simulate: the main thread, or with
+ * --pipeline the sim thread between start and done
+ */
+typedef struct {
+	Player* player;
+	Map* map;
+	KeyMap* keys;
+	Entity* entities;
+	uint8_t numEntities;
+	SpatialHash* grid;
+	uint32_t* visible;
+	GameClock* clock;
+	Replay* replay;
+	Replay* recording;
+	MapSpawn* spawn;
+	double depth;
+	// Set before each call
+	uint32_t steps;
+	uint8_t paused;
+	int8_t saturationInput;
+	uint32_t width;
+	uint32_t height;
+	DemoFrame* frame;
+	// Game state
+	double simTime;
+	double toggleSaturation;
+	uint8_t ended;
+	// Sim thread handshake
+	SDL_sem* start;
+	SDL_sem* done;
+	uint8_t exit;
+} DemoSim;
+
+/** Demo_simulate
+ * @brief Runs sim->steps fixed steps and snapshots the result into sim->frame
+ * * Sets sim->ended once a replay runs out
+ */
+static void Demo_simulate(DemoSim* sim)
+{
+	Player* player = sim->player;
+	double dt = sim->clock->stepTime;
+	PROFILE_BEGIN(PS_SIM);
+	if (player->state == 2)
+	{
+		// Respawn once the last frame has shown the dead player
+		GameEngine_delPlayer(player);
+		GameEngine_initPlayer(player, sim->spawn->x, sim->spawn->y, sim->spawn->angle, 1, M_PI/2, sim->depth, sim->width);
+	}
+	// Update if not paused
+	if (!sim->paused)
+	{
+		for (uint32_t step = 0; step < sim->steps; step++)
+		{
+			if (sim->replay && !Replay_play(sim->replay, sim->keys))
+			{
+				sim->ended = 1;
+				break;
+			}
+			else if (sim->recording)
+			{
+				Replay_record(sim->recording, sim->keys);
+			}
+			GameEngine_updatePlayer(player, sim->map, sim->keys, dt);
+			// Sprite movement
+			for (int s = 0; s < sim->numEntities; s++)
+			{
+				GameEngine_saveEntityState(&sim->entities[s]);
+			}
+			sim->simTime += dt;
+			for (int s = 1; s < 9; s++)
+			{
+				GameEngine_moveEntity(&sim->entities[s], 2.5 + cos(sim->simTime+(s-1)*M_PI/4), 7.5 + sin(sim->simTime+(s-1)*M_PI/4), 0);
+				sim->entities[s].sprite.frameNum = (uint32_t)(sim->simTime*1000)%30;
+			}
+			sim->entities[0].sprite.frameNum = 29-((uint32_t)(sim->simTime*10))%30;
+
+			// Saturation test
+			sim->toggleSaturation += sim->saturationInput * dt;
+		}
+		// Render between the last two steps
+		GameEngine_interpolatePlayer(player, sim->clock->alpha);
+		for (uint8_t s = 0; s < sim->numEntities; s++)
+		{
+			GameEngine_interpolateEntity(&sim->entities[s], sim->clock->alpha);
+		}
+	}
+	PROFILE_END(PS_SIM);
+	DemoFrame* frame = sim->frame;
+	GameEngine_beginSnapshot(&frame->snapshot, &player->camera, sim->map);
+	// Only entities in tiles the camera can see get sprites
+	uint32_t numVisible = GameEngine_cullEntities(sim->grid, &player->camera, sim->width, sim->height, sim->visible, sim->numEntities);
+	for (uint32_t v = 0; v < numVisible; v++)
+	{
+		GameEngine_addSnapshotSprite(&frame->snapshot, &sim->entities[sim->visible[v]].sprite);
+		GameEngine_addSnapshotSprite(&frame->snapshot, &sim->entities[sim->visible[v]].shadow);
+	}
+	frame->playerState = player->state;
+	frame->playerTimer = player->timer;
+	frame->simTime = sim->simTime;
+	frame->paused = sim->paused;
+}
+
+/** Demo_simThread
+ * @brief Sim thread for --pipeline, simulates a frame each time start is posted
+ */
+static int Demo_simThread(void* data)
+{
+	DemoSim* sim = (DemoSim*)data;
+	while (1)
+	{
+		SDL_SemWait(sim->start);
+		if (sim->exit)
+		{
+			break;
+		}
+		Demo_simulate(sim);
+		SDL_SemPost(sim->done);
+	}
+	return 0;
+}
 
+/** Demo_applyConfig
+ * @brief Reallocates every resolution dependent resource for config
+ * * Camera tables follow on the next render (RayEngine_updateCameraColumns)
+ */
+static void Demo_applyConfig(RenderConfig* config, DepthBuffer* buffer, PixBuffer* background, double depth, RaySprite* cursorSprite)
+{
+	RayEngine_resizeDepthBuffer(buffer, config->width, config->height);
+	PixBuffer_resizePixBuffer(background, config->width, config->height);
+	Demo_drawBackground(background, depth);
+	cursorSprite->x = config->width / 2;
+	cursorSprite->y = config->height / 2;
+	if (renderer)
+	{
+		if (drawTex)
+		{
+			SDL_DestroyTexture(drawTex);
+		}
+		drawTex = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, config->width, config->height);
+		SDL_SetTextureBlendMode(drawTex, SDL_BLENDMODE_BLEND);
+	}
+}
 
 int main(int argc, char* argv[])
 {
-	SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO);
+	// Command line options
+	// --headless N: render N frames without a window, as fast as possible
+	// --dump DIR: write every headless frame to DIR as a PPM image
+	// --trace FILE: write a Chrome trace on exit (RAY_PROFILE builds)
+	// --map FILE: binary map to play (see map_converter)
+	// --record FILE: save input of every simulation step on exit
+	// --replay FILE: play a recording back headlessly, one step per frame
+	// --res WxH: internal render resolution (default 256x224)
+	// --scale N: window pixels per render pixel (default 4)
+	// --budget MS: scale the render size to keep frame time near MS
+	// --min-fraction F: smallest governed render size (default 0.5)
+	// --lod N: trace every Nth wall column, fill the rest (see Camera)
+	// --coherence: start wall rays from last frame's empty space
+	// --interlace: draw alternate columns, rebuild the rest from the last frame
+	// --deferred: shade walls, sprites and floor once per pixel from a GBuffer
+	// --spans: clip against each column's wall instead of depth testing
+	// --kbuffer K: keep K sorted translucent fragments per pixel
+	// --kbuffer-budget MB: fragment pool size for --kbuffer (default 8)
+	// --pipeline: simulate the next frame on a second thread while rendering
+	uint8_t headless = 0;
+	uint32_t headlessFrames = 0;
+	const char* dumpDir = NULL;
+	const char* tracePath = NULL;
+	const char* recordPath = NULL;
+	const char* mapPath = "assets/demo_map.rmap";
+	Replay* replay = NULL;
+	Replay* recording = NULL;
+	RenderConfig config = {WIDDERSHINS / DEFAULT_SCALE, TURNWISE / DEFAULT_SCALE, DEFAULT_SCALE};
+	double frameBudget = 0;
+	double minFraction = 0.5;
+	uint32_t columnStep = 1;
+	RayCoherence* coherence = NULL;
+	RayInterlace* interlace = NULL;
+	uint8_t deferred = 0;
+	uint8_t spans = 0;
+	uint8_t kbufferLayers = 0;
+	double kbufferBudget = 8;
+	uint8_t pipelined = 0;
+	for (int a = 1; a < argc; a++)
+	{
+		if (!strcmp(argv[a], "--headless") && a + 1 < argc)
+		{
+			headless = 1;
+			headlessFrames = (uint32_t)strtoul(argv[++a], NULL, 10);
+		}
+		else if (!strcmp(argv[a], "--dump") && a + 1 < argc)
+		{
+			dumpDir = argv[++a];
+		}
+		else if (!strcmp(argv[a], "--trace") && a + 1 < argc)
+		{
+			tracePath = argv[++a];
+		}
+		else if (!strcmp(argv[a], "--map") && a + 1 < argc)
+		{
+			mapPath = argv[++a];
+		}
+		else if (!strcmp(argv[a], "--res") && a + 1 < argc && \
+			sscanf(argv[a + 1], "%ux%u", &config.width, &config.height) == 2 && config.width && config.height)
+		{
+			a++;
+		}
+		else if (!strcmp(argv[a], "--scale") && a + 1 < argc && (config.scale = (uint32_t)strtoul(argv[a + 1], NULL, 10)))
+		{
+			a++;
+		}
+		else if (!strcmp(argv[a], "--budget") && a + 1 < argc && (frameBudget = strtod(argv[a + 1], NULL) / 1000) > 0)
+		{
+			a++;
+		}
+		else if (!strcmp(argv[a], "--min-fraction") && a + 1 < argc && (minFraction = strtod(argv[a + 1], NULL)) > 0)
+		{
+			a++;
+		}
+		else if (!strcmp(argv[a], "--lod") && a + 1 < argc && (columnStep = (uint32_t)strtoul(argv[a + 1], NULL, 10)))
+		{
+			a++;
+		}
+		else if (!strcmp(argv[a], "--coherence") && !coherence)
+		{
+			coherence = RayEngine_initCoherence(0.5);
+		}
+		else if (!strcmp(argv[a], "--interlace") && !interlace)
+		{
+			interlace = RayEngine_initInterlace(0.05);
+		}
+		else if (!strcmp(argv[a], "--deferred"))
+		{
+			deferred = 1;
+		}
+		else if (!strcmp(argv[a], "--spans"))
+		{
+			spans = 1;
+		}
+		else if (!strcmp(argv[a], "--kbuffer") && a + 1 < argc && (kbufferLayers = (uint8_t)strtoul(argv[a + 1], NULL, 10)))
+		{
+			a++;
+		}
+		else if (!strcmp(argv[a], "--kbuffer-budget") && a + 1 < argc && (kbufferBudget = strtod(argv[a + 1], NULL)) > 0)
+		{
+			a++;
+		}
+		else if (!strcmp(argv[a], "--pipeline"))
+		{
+			pipelined = 1;
+		}
+		else if (!strcmp(argv[a], "--record") && a + 1 < argc)
+		{
+			recordPath = argv[++a];
+		}
+		else if (!strcmp(argv[a], "--replay") && a + 1 < argc && !replay)
+		{
+			replay = Replay_load(argv[++a]);
+			if (!replay)
+			{
+				fprintf(stderr, "FATAL: Could not load replay %s\n", argv[a]);
+				return -1;
+			}
+			if (replay->stepRate != SIM_RATE)
+			{
+				fprintf(stderr, "FATAL: Replay was recorded at %u steps/s, expected %u\n", replay->stepRate, SIM_RATE);
+				return -1;
+			}
+		}
+		else
+		{
+			fprintf(stderr, "Usage: %s [--map FILE] [--res WxH] [--scale N] [--budget MS] [--min-fraction F] [--lod N] [--coherence] [--interlace] [--deferred | --spans] [--kbuffer K] [--kbuffer-budget MB] [--pipeline] [--headless FRAMES] [--dump DIR] [--trace FILE] [--record FILE | --replay FILE]\n", argv[0]);
+			return -1;
+		}
+	}
+	if (spans && (deferred || interlace || kbufferLayers))
+	{
+		fprintf(stderr, "FATAL: --spans can't be combined with --deferred, --interlace or --kbuffer\n");
+		return -1;
+	}
+	if (replay)
+	{
+		// Whole recording unless --headless asks for fewer frames
+		if (!headless || headlessFrames > replay->numTicks)
+		{
+			headlessFrames = replay->numTicks;
+		}
+		headless = 1;
+		recordPath = NULL;
+		GameEngine_seedRandom(replay->seed);
+	}
+	else
+	{
+		uint32_t seed = (uint32_t)SDL_GetPerformanceCounter();
+		GameEngine_seedRandom(seed);
+		if (recordPath)
+		{
+			recording = Replay_init(seed, SIM_RATE);
+		}
+	}
 
-	const uint8_t* keys = SDL_GetKeyboardState(NULL);
+	if (headless)
+	{
+		SDL_Init(SDL_INIT_TIMER);
+	}
+	else
+	{
+		SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO);
+		window = SDL_CreateWindow(
+			"Raycaster Thing",
+			30, 30,
+			config.width*config.scale, config.height*config.scale,
+			SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE
+		);
+	}
+
+	// Render size is the configured size, scaled down by the governor
+	// when a frame budget is set. The texture is stretched to the window.
+	RenderConfig render = config;
+	ResolutionGovernor governor;
+	GameEngine_initGovernor(&governor, frameBudget, minFraction);
 
-	window = SDL_CreateWindow(
-		"Raycaster Thing",
-		30, 30,
-		WIDTH*SCALE, HEIGHT*SCALE,
-		SDL_WINDOW_OPENGL
-	);
+	const uint8_t* keys = SDL_GetKeyboardState(NULL);
 
 	//Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, 2, 2048);
 	const char testAudioFile[] = "assets/step.wav";
 
-	unsigned char testMapChar[MAP_WIDTH*MAP_HEIGHT] = {
-		3,1,1,1,3,4,5,5,5,4,
-		1,0,0,0,1,5,0,0,0,5,
-		1,0,2,0,1,5,0,0,0,5,
-		1,0,0,0,0,0,0,0,0,5,
-		3,1,1,1,3,4,5,0,5,4,
-		6,6,6,6,6,0,3,0,4,0,
-		6,0,0,0,6,0,3,0,4,0,
-		6,0,0,0,6,0,3,0,4,0,
-		0,0,0,0,6,3,3,0,3,3,
-		6,0,0,0,6,3,0,0,0,3,
-		0,0,0,0,0,0,0,0,0,3,
-		6,0,0,0,6,3,0,0,0,3,
-		6,6,0,6,6,3,3,3,3,3
-	};
-
-	/*unsigned char testMapChar[MAP_WIDTH*MAP_HEIGHT] = {
-		1,0,0,0,0,
-		0,0,0,0,0,
-		0,0,0,0,0,
-		0,0,0,0,0,
-		0,0,0,0,0
-	};*/
-
 	SDL_Color colorKey[4] = {
 		{255, 255, 255, 255},
 		{220,50,50,255},	// Light red
@@ -155,8 +496,21 @@ int main(int argc, char* argv[])
 
 
 	//Demo map
-	Map testMap;
-	RayEngine_generateMap(&testMap, testMapChar, MAP_WIDTH, MAP_HEIGHT, 2, colorKey, 4);
+	MapFile* demoMap = MapFile_load(mapPath);
+	if (!demoMap)
+	{
+		fprintf(stderr, "FATAL: Could not load map. Exiting...\n");
+		return -1;
+	}
+	Map* testMap = &demoMap->map;
+	testMap->colorData = colorKey;
+	testMap->numColor = 4;
+	MapSpawn defaultSpawn = {1.5, 1.5, 0, 0, MS_PLAYER, 0};
+	MapSpawn* playerSpawn = MapFile_findSpawn(demoMap, MS_PLAYER);
+	if (!playerSpawn)
+	{
+		playerSpawn = &defaultSpawn;
+	}
 
 	// Demo texture
 	int32_t mPixWidth;
@@ -169,6 +523,7 @@ int main(int argc, char* argv[])
 	}
 	RayTex* worldTex = RayTex_initFromRGBA(mapPixDat, (uint32_t)mPixWidth, (uint32_t)mPixWidth, mPixHeight/mPixWidth);
 	stbi_image_free(mapPixDat);
+	RayEngine_setTileTranslucency(testMap, worldTex);
 	RayTex mapTex;
 	mapTex.pixData = (uint32_t*)blox_data;
 	mapTex.tileCount = 9;
@@ -201,9 +556,8 @@ int main(int argc, char* argv[])
 	// View depth
 	double depth = 3;
 	// Demo player
-	double angleValues[WIDTH];
 	Player testPlayer;
-	GameEngine_initPlayer(&testPlayer, 1.5, 1.5, 0, 1, M_PI/2, depth, WIDTH);
+	GameEngine_initPlayer(&testPlayer, playerSpawn->x, playerSpawn->y, playerSpawn->angle, 1, M_PI/2, depth, render.width);
 
 	// Init keymapping
 	KeyMap testKeys;
@@ -237,83 +591,108 @@ int main(int argc, char* argv[])
 	GameEngine_scaleEntity(&entityList[9], 0.25); //0.25
 	entityList[9].sprite.alphaNum = 0.7;
 	GameEngine_moveEntity(&entityList[0], 2.5, 7.5, 0); // Big Thonk
+	// Sprites are culled with a grid, handles are list indices
+	SpatialHash* entityGrid = SpatialHash_init(testMap, numEntities);
+	uint32_t visibleEntities[10];
+	for (uint8_t s = 0; s < numEntities; s++)
+	{
+		GameEngine_setEntityGrid(&entityList[s], entityGrid, s);
+	}
 
 	// Test cursor sprite
 	RaySprite cursorSprite;
-	RayEngine_initSprite(&cursorSprite, &spriteTexs[9], 1, 0.3, WIDTH/2, HEIGHT/2, 0);
-
-	// SDL renderer initialization
-	renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-	SDL_RenderSetScale(renderer, SCALE, SCALE);
-	SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
-
-	// Render target initialization
-	drawTex = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, WIDTH, HEIGHT);
-	SDL_SetTextureBlendMode(drawTex, SDL_BLENDMODE_BLEND);
+	RayEngine_initSprite(&cursorSprite, &spriteTexs[9], 1, 0.3, render.width/2, render.height/2, 0);
 
-	// Depth buffer initialization
-	uint32_t pixels[WIDTH * HEIGHT];
-	DepthBuffer* buffer = RayEngine_initDepthBuffer(WIDTH, HEIGHT);
-	SDL_Rect screenRect = {0,0,WIDTH,HEIGHT};
+	if (!headless)
+	{
+		// SDL renderer initialization
+		renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+		SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+	}
 
-	SDL_Color nightSky = {20,0,20,255};
-	SDL_Color nightHorizon = {50,20,50,255};
-	SDL_Color eveningSky =  {0x5c,0x57,0xff,255};
-	SDL_Color eveningHorizon = {0xff,0x40,0x00,255};
+	// Depth buffer, background and render target, sized from config
+	DepthBuffer* buffer = RayEngine_initDepthBuffer(render.width, render.height);
+	if (deferred)
+	{
+		buffer->gbuffer = RayEngine_initGBuffer(render.width, render.height);
+	}
+	if (spans)
+	{
+		buffer->spans = RayEngine_initSpans(render.width);
+	}
+	if (kbufferLayers)
+	{
+		buffer->kbuffer = RayEngine_initKBuffer(render.width, render.height, kbufferLayers, (uint32_t)(kbufferBudget * 1024 * 1024 / sizeof(KBufferFragment)));
+	}
+#ifdef RAY_STATS
+	buffer->stats = RayEngine_initRenderStats(render.width, render.height);
+	RenderStats statTotals = {0};
+#endif
+	PixBuffer* background = PixBuffer_initPixBuffer(render.width, render.height);
+	Demo_applyConfig(&render, buffer, background, depth, &cursorSprite);
 	SDL_Color white = {0xff,0xff,0xff,0xff};
-
-	// Generate background texture
-	uint32_t* texPixels = (uint32_t*)calloc(sizeof(uint32_t), WIDTH * HEIGHT);
-	PixBuffer background;
-	background.pixels = texPixels;
-	background.width = WIDTH;
-	background.height = HEIGHT;
-	SDL_Rect gradientRectTop = {0,0,WIDTH,HEIGHT/2};
-	//SDL_Color colorTop1 = {189,255,255,255};//{255,100,100,255};
-	//SDL_Color colorTop2 = {77,150,154,255};//{0,0,100,255};
-	SDL_Color colorTop1 = eveningSky;//{0x5c,0x57,0xff,255};
-	SDL_Color colorTop2 = eveningHorizon;//{0xff,0x40,0x00,255};
-	SDL_Rect gradientRectBottom = {0,HEIGHT/2,WIDTH,HEIGHT/2};
-	//SDL_Color colorBottom1 = {159,197,182,255};
-	//SDL_Color colorBottom2 = {79,172,135,255};
-	SDL_Color colorBottom1 = {50,50,80,255};
-	SDL_Color colorBottom2 = {150,150,190,255};
-	// Fog gradient
-	SDL_Color fogFade = {50,20,50,0};//{50,50,80,0};
-	SDL_Color fogPrimary = nightHorizon;//{50,50,80,255};
-	SDL_Rect fogRectBottom = {0,HEIGHT/2+(int)floor((double)HEIGHT/(depth*10)),WIDTH,(int)floor((double)HEIGHT/(depth*10))};
-	SDL_Rect fogRectCenter = {0, HEIGHT/2-(int)floor((double)HEIGHT/(depth*10)),WIDTH, (int)floor((double)HEIGHT/(depth*10))*2};
-	SDL_Rect fogRectTop = {0,HEIGHT/2-(int)floor((double)HEIGHT/(depth*10))*2,WIDTH,(int)floor((double)HEIGHT/(depth*10))};
-	PixBuffer_clearBuffer(&background);
-	PixBuffer_drawHorizGradient(&background,&gradientRectTop, colorTop1, colorTop2);
-	//PixBuffer_drawHorizGradient(&buffer,&gradientRectBottom, colorBottom1, colorBottom2);
-	PixBuffer_drawRect(&background, &gradientRectBottom, colorBottom1);
-	// Render fog
-	PixBuffer_drawRect(&background, &fogRectCenter, fogPrimary);
-	PixBuffer_drawHorizGradient(&background,&fogRectTop, fogFade, fogPrimary);
-	PixBuffer_drawHorizGradient(&background,&fogRectBottom, fogPrimary, fogFade);
 	
 	// State variables
 	uint8_t quit = 0;
 	uint8_t paused = 0;
 	uint8_t pauseKeyPressed = 0;
+	uint8_t showProfiler = 0;
+	uint8_t statsView = 0;
 	uint8_t frameCounter = 0;
-	uint32_t realRunTime = 0;
-	double realRunTimeF = 0;
-	double dt = 0;
-	uint32_t runTime = SDL_GetTicks();
-	double runTimeF = (double)runTime/1000;
-
-	double toggleSaturation = 0;
-	SDL_SetRelativeMouseMode(SDL_TRUE);
+	GameClock simClock;
+	GameEngine_initClock(&simClock, SIM_RATE, MAX_SIM_STEPS);
+
+	// Frames are simulated into a snapshot, then rendered from it. With
+	// --pipeline the next one is simulated on the sim thread meanwhile.
+	DemoFrame frames[2];
+	uint8_t front = 0;
+	GameEngine_initSnapshot(&frames[0].snapshot);
+	GameEngine_initSnapshot(&frames[1].snapshot);
+	DemoSim sim = {
+		.player = &testPlayer,
+		.map = testMap,
+		.keys = &testKeys,
+		.entities = entityList,
+		.numEntities = numEntities,
+		.grid = entityGrid,
+		.visible = visibleEntities,
+		.clock = &simClock,
+		.replay = replay,
+		.recording = recording,
+		.spawn = playerSpawn,
+		.depth = depth
+	};
+	SDL_Thread* simThread = NULL;
+	if (pipelined)
+	{
+		sim.start = SDL_CreateSemaphore(0);
+		sim.done = SDL_CreateSemaphore(0);
+		simThread = SDL_CreateThread(Demo_simThread, "sim", &sim);
+		// First frame up front, from then on the sim runs a frame ahead
+		sim.steps = headless ? GameEngine_advanceClock(&simClock, simClock.stepTime) : GameEngine_tickClock(&simClock);
+		sim.width = render.width;
+		sim.height = render.height;
+		sim.frame = &frames[front];
+		Demo_simulate(&sim);
+	}
+
+	uint32_t framesRendered = 0;
+	uint64_t startCount = SDL_GetPerformanceCounter();
+	if (!headless)
+	{
+		SDL_SetRelativeMouseMode(SDL_TRUE);
+	}
 	while(!quit)
 	{
-		GameEngine_updateKeys(&testKeys);
+		PROFILE_BEGIN(PS_FRAME);
+		uint64_t frameStart = SDL_GetPerformanceCounter();
+		if (!replay)
+		{
+			GameEngine_updateKeys(&testKeys);
+		}
 		const uint8_t* keys = SDL_GetKeyboardState(NULL);
 		// **Update Routine**
-		realRunTime = SDL_GetTicks();		
-		realRunTimeF = (double)realRunTime/1000;
-		while (SDL_PollEvent(&event))
+		while (!headless && SDL_PollEvent(&event))
 		{
 			if (event.type == SDL_QUIT || (event.type == SDL_KEYDOWN && event.key.keysym.scancode == SDL_SCANCODE_ESCAPE))
 			{
@@ -330,64 +709,113 @@ int main(int argc, char* argv[])
 			{
 				pauseKeyPressed = 0;
 			}
-		}
-		// Update if not paused
-		if (!paused)
-		{
-			GameEngine_updatePlayer(&testPlayer, &testMap, &testKeys, dt);
-			// Sprite movement
-			for (int s = 1; s < 9; s++)
+			else if (event.type == SDL_KEYDOWN && event.key.keysym.scancode == SDL_SCANCODE_F3 && !event.key.repeat)
 			{
-				GameEngine_moveEntity(&entityList[s], 2.5 + cos(runTimeF+(s-1)*M_PI/4), 7.5 + sin(runTimeF+(s-1)*M_PI/4), 0);
-				entityList[s].sprite.frameNum = (runTime)%30;
+				showProfiler = !showProfiler;
 			}
-			entityList[0].sprite.frameNum = 29-(runTime/100)%30;
-
-			// Saturation test
-			if (keys[SDL_SCANCODE_UP])
+			else if (event.type == SDL_KEYDOWN && event.key.keysym.scancode == SDL_SCANCODE_F4 && !event.key.repeat)
+			{
+				// Off, overdraw, ray steps
+				statsView = (statsView + 1) % 3;
+			}
+			else if (event.type == SDL_KEYDOWN && event.key.keysym.scancode == SDL_SCANCODE_F5 && !event.key.repeat)
 			{
-				toggleSaturation -= dt;
+				// Column LOD off, every 2nd, every 4th
+				columnStep = columnStep >= 4 ? 1 : columnStep * 2;
 			}
-			else if (keys[SDL_SCANCODE_DOWN])
+			else if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
 			{
-				toggleSaturation += dt;
+				// Keep the pixel scale, render size follows the window
+				config.width = event.window.data1 / config.scale > 0 ? event.window.data1 / config.scale : 1;
+				config.height = event.window.data2 / config.scale > 0 ? event.window.data2 / config.scale : 1;
+				GameEngine_governRenderSize(&governor, &config, &render);
+				Demo_applyConfig(&render, buffer, background, depth, &cursorSprite);
 			}
 		}
+		// Run as many fixed steps as real time calls for
+		// (headless runs exactly one step per frame)
+		if (headless)
+		{
+			sim.steps = GameEngine_advanceClock(&simClock, simClock.stepTime);
+		}
+		else
+		{
+			sim.steps = GameEngine_tickClock(&simClock);
+		}
+		sim.paused = paused;
+		sim.saturationInput = keys[SDL_SCANCODE_UP] ? -1 : (keys[SDL_SCANCODE_DOWN] ? 1 : 0);
+		sim.width = render.width;
+		sim.height = render.height;
+		uint8_t simulating = 0;
+		if (!pipelined)
+		{
+			sim.frame = &frames[front];
+			Demo_simulate(&sim);
+		}
+		else if (!sim.ended && !(headless && framesRendered + 1 >= headlessFrames))
+		{
+			// Next frame simulates while this one renders
+			sim.frame = &frames[!front];
+			SDL_SemPost(sim.start);
+			simulating = 1;
+		}
+		DemoFrame* frame = &frames[front];
+		Camera* camera = &frame->snapshot.camera;
 
 		// **Render Routine**
-		// Clear, draw line and update
-		SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0x00, 0xFF);
-		SDL_RenderClear(renderer);
-		SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
 
-		////PixBuffer_drawBuffOffset(&buffer, &background, WIDTH, HEIGHT, testPlayer.angle*scrollConst);
+		////PixBuffer_drawBuffOffset(&buffer, &background, render.width, render.height, testPlayer.angle*scrollConst);
+		PROFILE_BEGIN(PS_RESET);
 		RayEngine_resetDepthBuffer(buffer);
-		memcpy(buffer->pixelBuffer->pixels, background.pixels, sizeof(uint32_t)*WIDTH*HEIGHT);
-		RayEngine_texRenderFloor(buffer->pixelBuffer, &testPlayer.camera, WIDTH, HEIGHT, NULL, 0, worldTex, 6);
-		RayEngine_raycastRender(buffer, &(testPlayer.camera), WIDTH, HEIGHT, &testMap, 0.01, worldTex);
-		////RayEngine_raycastCompute(rayBuffer, &(testPlayer.camera), WIDTH, HEIGHT, &testMap, 0.01, worldTex);
+		memcpy(buffer->pixelBuffer->pixels, background->pixels, sizeof(uint32_t)*render.width*render.height);
+		PROFILE_END(PS_RESET);
+		camera->columnStep = columnStep;
+		camera->coherence = coherence;
+		camera->interlace = interlace;
+		PROFILE_BEGIN(PS_FLOOR);
+		if (!buffer->gbuffer && !buffer->spans)
+		{
+			RayEngine_texRenderFloor(buffer->pixelBuffer, camera, render.width, render.height, testMap, 0, worldTex, 6);
+		}
+		PROFILE_END(PS_FLOOR);
+		PROFILE_BEGIN(PS_WALLS);
+		RayEngine_raycastRender(buffer, camera, render.width, render.height, testMap, 0.01, worldTex);
+		PROFILE_END(PS_WALLS);
+		////RayEngine_raycastCompute(rayBuffer, &(testPlayer.camera), render.width, render.height, testMap, 0.01, worldTex);
 		// Update & draw sprites
-		for (uint8_t s = 0; s < numEntities; s++)
+		PROFILE_BEGIN(PS_SPRITES);
+		for (uint32_t s = 0; s < frame->snapshot.numSprites; s++)
 		{
-			if (!paused)
-			{
-				GameEngine_updateEntity(&entityList[s]);
-			}
-			RayEngine_draw3DSprite(buffer, &(testPlayer.camera), WIDTH, HEIGHT, 0.01, entityList[s].sprite);
-			RayEngine_draw3DSprite(buffer, &(testPlayer.camera), WIDTH, HEIGHT, 0.01, entityList[s].shadow);
+			RayEngine_draw3DSprite(buffer, camera, render.width, render.height, 0.01, frame->snapshot.sprites[s]);
+		}
+		PROFILE_END(PS_SPRITES);
+		PROFILE_BEGIN(PS_COMPOSITE);
+		if (buffer->gbuffer)
+		{
+			// Floor only where walls and sprites left it visible
+			RayEngine_deferFloor(buffer, camera, render.width, render.height, testMap, worldTex, 6);
+			RayEngine_shadeGBuffer(buffer);
+		}
+		if (buffer->spans)
+		{
+			// Floor below each column's wall, then sprites and glass back to front
+			RayEngine_deferFloor(buffer, camera, render.width, render.height, testMap, worldTex, 6);
+			RayEngine_drawSpans(buffer, camera, render.width, render.height);
 		}
 		RayEngine_renderBuffer(buffer);
-		////RayEngine_texRenderCeiling(&buffer, &testPlayer.camera, WIDTH, HEIGHT, NULL, worldTex, 7);
-		// Player death animation
-		if (!testPlayer.state && testPlayer.timer < 2)
+		if (interlace)
 		{
-			PixBuffer_fillBuffer(buffer->pixelBuffer, PixBuffer_toPixColor(150, 0, 20, 255), 1-(testPlayer.timer/2));
+			RayEngine_reconstructInterlace(buffer, camera);
 		}
-		else if (testPlayer.state == 2)
+		PROFILE_END(PS_COMPOSITE);
+		PROFILE_BEGIN(PS_POST);
+		////RayEngine_texRenderCeiling(&buffer, &testPlayer.camera, render.width, render.height, NULL, worldTex, 7);
+		// Player death animation
+		if (!frame->playerState && frame->playerTimer < 2)
 		{
-			GameEngine_initPlayer(&testPlayer, 1.5, 1.5, 0, 1, M_PI/2, depth, WIDTH);
+			PixBuffer_fillBuffer(buffer->pixelBuffer, PixBuffer_toPixColor(150, 0, 20, 255), 1-(frame->playerTimer/2));
 		}
-		RayEngine_draw2DSprite(buffer->pixelBuffer, cursorSprite, 2*runTimeF);
+		RayEngine_draw2DSprite(buffer->pixelBuffer, cursorSprite, 2*frame->simTime);
 		////PixBuffer_fillBuffer(&buffer, PixBuffer_toPixColor(50, 50, 50, 255), 0.2);
 
 		////PixBuffer_fillBuffer(&buffer, PixBuffer_toPixColor(150,0,20,255), 1);
@@ -395,7 +823,7 @@ int main(int argc, char* argv[])
 		SDL_Color sepiaPink = {221,153,153,255};
 		////PixBuffer_monochromeFilter(&buffer, sepiaPink, 1);
 		////PixBuffer_monochromeFilter(&buffer, white, 4.442);
-		if (paused)
+		if (frame->paused)
 		{
 			SDL_Color monoGrey = {233,214,255,255};//{153, 140, 168, 255};
 			PixBuffer_monochromeFilter(buffer->pixelBuffer, sepiaPink, 1);
@@ -404,24 +832,169 @@ int main(int argc, char* argv[])
 		////PixBuffer_orderDither(&buffer, gameboyColorPalette, 4, 5);
 		// Note: between 4 & 10 is good for 16 color palette
 		PixBuffer_orderDither256(buffer->pixelBuffer, 5);
-		SDL_UpdateTexture(drawTex, NULL, buffer->pixelBuffer->pixels, sizeof(uint32_t) * WIDTH);
-		SDL_RenderCopy(renderer, drawTex, NULL, NULL);
-		SDL_RenderPresent(renderer);
-		dt = 0.001 * (double)(SDL_GetTicks() - realRunTime);
-		if (!paused)
+		PROFILE_END(PS_POST);
+#ifdef RAY_STATS
+		if (statsView)
+		{
+			RayEngine_drawStatsView(buffer->pixelBuffer, buffer->stats, statsView - 1);
+		}
+		statTotals.rays += buffer->stats->rays;
+		statTotals.cellsVisited += buffer->stats->cellsVisited;
+		statTotals.pixWritten += buffer->stats->pixWritten;
+		statTotals.pixRejected += buffer->stats->pixRejected;
+		statTotals.alphaPix += buffer->stats->alphaPix;
+		statTotals.spritesDrawn += buffer->stats->spritesDrawn;
+		statTotals.spritesCulled += buffer->stats->spritesCulled;
+#endif
+#ifdef RAY_PROFILE
+		if (showProfiler)
+		{
+			Profiler_drawOverlay(buffer->pixelBuffer);
+		}
+#endif
+		framesRendered++;
+		// Render time before upload/present, vsync waits don't count
+		double renderTime = (double)(SDL_GetPerformanceCounter() - frameStart) / (double)SDL_GetPerformanceFrequency();
+		if (headless)
+		{
+			if (dumpDir)
+			{
+				char framePath[4096];
+				snprintf(framePath, sizeof(framePath), "%s/frame_%05u.ppm", dumpDir, framesRendered - 1);
+				if (PixBuffer_writePPM(buffer->pixelBuffer, framePath))
+				{
+					fprintf(stderr, "ERROR: Could not write %s\n", framePath);
+					quit = 1;
+				}
+			}
+			if (framesRendered >= headlessFrames)
+			{
+				quit = 1;
+			}
+		}
+		else
 		{
-			runTimeF += dt;
-			runTime += SDL_GetTicks() - realRunTime;
+			// Clear, draw line and update
+			SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0x00, 0xFF);
+			SDL_RenderClear(renderer);
+			PROFILE_BEGIN(PS_UPLOAD);
+			SDL_UpdateTexture(drawTex, NULL, buffer->pixelBuffer->pixels, sizeof(uint32_t) * render.width);
+			PROFILE_END(PS_UPLOAD);
+			PROFILE_BEGIN(PS_PRESENT);
+			SDL_RenderCopy(renderer, drawTex, NULL, NULL);
+			SDL_RenderPresent(renderer);
+			PROFILE_END(PS_PRESENT);
 		}
+		if (simulating)
+		{
+			SDL_SemWait(sim.done);
+			if (!GameEngine_isSnapshotCurrent(&frame->snapshot, testMap))
+			{
+				// The sim edited the map under the renderer, stop overlapping them
+				fprintf(stderr, "Map changed while a frame was rendered, turning off --pipeline\n");
+				pipelined = 0;
+			}
+			front = !front;
+		}
+		if (sim.ended && !simulating)
+		{
+			quit = 1;
+		}
+		if (frameBudget > 0 && GameEngine_updateGovernor(&governor, renderTime))
+		{
+			GameEngine_governRenderSize(&governor, &config, &render);
+			Demo_applyConfig(&render, buffer, background, depth, &cursorSprite);
+		}
+		PROFILE_END(PS_FRAME);
+		PROFILE_FRAME();
+	}
+	if (simThread)
+	{
+		sim.exit = 1;
+		SDL_SemPost(sim.start);
+		SDL_WaitThread(simThread, NULL);
+		SDL_DestroySemaphore(sim.start);
+		SDL_DestroySemaphore(sim.done);
+	}
+	GameEngine_delSnapshot(&frames[0].snapshot);
+	GameEngine_delSnapshot(&frames[1].snapshot);
+	if (recording)
+	{
+		if (Replay_save(recording, recordPath))
+		{
+			fprintf(stderr, "ERROR: Could not write %s\n", recordPath);
+		}
+		Replay_del(recording);
+	}
+	if (replay)
+	{
+		Replay_del(replay);
+	}
+	if (tracePath)
+	{
+#ifdef RAY_PROFILE
+		if (Profiler_writeTrace(tracePath))
+		{
+			fprintf(stderr, "ERROR: Could not write %s\n", tracePath);
+		}
+#else
+		fprintf(stderr, "WARNING: --trace needs a RAY_PROFILE build (make linux-profile)\n");
+#endif
+	}
+	if (headless)
+	{
+		double runSeconds = (double)(SDL_GetPerformanceCounter() - startCount) / (double)SDL_GetPerformanceFrequency();
+		printf("Rendered %u frames in %.3f s (%.1f fps)\n", framesRendered, runSeconds, framesRendered / runSeconds);
+		if (frameBudget > 0)
+		{
+			printf("Governed render size %ux%u (%.3f of %ux%u)\n", render.width, render.height, governor.fraction, config.width, config.height);
+		}
+#ifdef RAY_STATS
+		printf("Per frame: %.0f rays, %.0f cells, %.0f pixels written, %.0f depth rejected, %.0f alpha, %.1f sprites drawn, %.1f culled\n",
+			(double)statTotals.rays / framesRendered, (double)statTotals.cellsVisited / framesRendered,
+			(double)statTotals.pixWritten / framesRendered, (double)statTotals.pixRejected / framesRendered,
+			(double)statTotals.alphaPix / framesRendered, (double)statTotals.spritesDrawn / framesRendered,
+			(double)statTotals.spritesCulled / framesRendered);
+#endif
 	}
 
 
 	// Clean up and quit
+#ifdef RAY_STATS
+	RayEngine_delRenderStats(buffer->stats);
+#endif
+	if (buffer->gbuffer)
+	{
+		RayEngine_delGBuffer(buffer->gbuffer);
+	}
+	if (buffer->spans)
+	{
+		RayEngine_delSpans(buffer->spans);
+	}
+	if (buffer->kbuffer)
+	{
+		RayEngine_delKBuffer(buffer->kbuffer);
+	}
 	RayEngine_delDepthBuffer(buffer);
 	RayTex_delRayTex(worldTex);
-	free(background.pixels);
-	SDL_DestroyRenderer(renderer);
-	SDL_DestroyWindow(window);
+	SpatialHash_del(entityGrid);
+	MapFile_del(demoMap);
+	PixBuffer_delPixBuffer(background);
+	GameEngine_delPlayer(&testPlayer);
+	if (coherence)
+	{
+		RayEngine_delCoherence(coherence);
+	}
+	if (interlace)
+	{
+		RayEngine_delInterlace(interlace);
+	}
+	if (!headless)
+	{
+		SDL_DestroyTexture(drawTex);
+		SDL_DestroyRenderer(renderer);
+		SDL_DestroyWindow(window);
+	}
 	renderer = NULL;
 	window = NULL;
 	SDL_Quit();
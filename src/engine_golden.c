@@ -0,0 +1,427 @@
+/**
+ * Golden-frame regression harness for the RayEngine
+ * render pipeline. Renders a fixed scene from a set of
+ * camera poses and compares every frame against stored
+ * golden images, then re-renders each pose through every
+ * registered render path (threaded, and later fast paths)
+ * and compares those against the scalar reference.
+ * Differences above tolerance write the rendered frame
+ * and a diff image, and the exit code is non-zero.
+ *
+ * Usage: engine_golden [--update] [--golden DIR]
+ *                      [--out DIR] [--tolerance N]
+ *
+ * @date 19/10/2026
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "gameengine.h"
+#include "testscene.h"
+
+#define GOLDEN_WIDTH 128
+#define GOLDEN_HEIGHT 112
+#define TEX_SIZE 16
+#define MAP_SIZE 24
+#define NUM_SPRITES 40
+// Share of pixels allowed past the channel tolerance
+#define MAX_BAD_FRACTION 0.002
+// Reconstructed columns land on neighbouring texels, see RayInterlace
+#define INTERLACE_BAD_FRACTION 0.06
+// Stacked glass is blended in depth order instead of through the alpha layer,
+// see RaySpans and KBuffer
+#define SORTED_BAD_FRACTION 0.06
+
+typedef struct {
+	const char* name;
+	double x;
+	double y;
+	double h;
+	double angle;
+	uint8_t post;
+} GoldenPose;
+
+/**
+ * A way of rendering the same frame. The first entry is
+ * the scalar reference that goldens are stored from, every
+ * other entry must match it. The remaining fields pick the
+ * renderer features Golden_render turns on (0 for off).
+ * begin/end only switch the OpenMP thread count around a
+ * render (NULL if nothing to switch).
+ * maxBadFraction is the share of pixels allowed past the
+ * channel tolerance.
+ */
+typedef struct {
+	const char* name;
+	void (*begin)(void);
+	void (*end)(void);
+	uint32_t columnStep;
+	uint8_t coherent;
+	uint8_t interlaced;
+	uint8_t deferred;
+	uint8_t spans;
+	uint8_t kbufferLayers;
+	double maxBadFraction;
+} GoldenPath;
+
+typedef struct {
+	Map map;
+	unsigned char* mapData;
+	RayTex wallTex;
+	RayTex spriteTex;
+	EntityPool* pool;
+	SpatialHash* grid;
+	RaySprite crowdSprite;
+	RaySprite glassSprite;
+	PixBuffer* background;
+} GoldenScene;
+
+static const GoldenPose poses[] = {
+	{"spawn", 3.5, 3.5, 0, 0.6, 0},
+	{"wall_close", 1.2, 5.5, 0, M_PI, 0},
+	{"through_glass", 12.5, 3.5, 0, M_PI / 2, 0},
+	{"crowd", 4.5, 18.5, 0, 0.1, 0},
+	{"corner", 20.5, 20.5, 0, M_PI / 4, 0},
+	{"raised", 8.5, 12.5, 0.3, 2.2, 0},
+	{"outside_map", -1.5, 10.5, 0, 0.3, 0},
+	{"inside_wall", 0.5, 0.5, 0, 1.0, 0},
+	{"post_dither", 12.5, 12.5, 0, 4.0, 1}
+};
+#define NUM_POSES (sizeof(poses) / sizeof(GoldenPose))
+
+#ifdef _OPENMP
+static void Golden_beginScalar(void)
+{
+	omp_set_num_threads(1);
+}
+
+static void Golden_beginThreaded(void)
+{
+	omp_set_num_threads(omp_get_num_procs() > 1 ? omp_get_num_procs() : 2);
+}
+#endif
+
+static const GoldenPath paths[] = {
+#ifdef _OPENMP
+	{.name = "scalar", .begin = Golden_beginScalar, .maxBadFraction = MAX_BAD_FRACTION},
+	{.name = "threaded", .begin = Golden_beginThreaded, .end = Golden_beginScalar, .maxBadFraction = MAX_BAD_FRACTION},
+#else
+	{.name = "scalar", .maxBadFraction = MAX_BAD_FRACTION},
+#endif
+	{.name = "column_lod", .columnStep = 4, .maxBadFraction = MAX_BAD_FRACTION},
+	{.name = "coherence", .coherent = 1, .maxBadFraction = MAX_BAD_FRACTION},
+	{.name = "interlace", .interlaced = 1, .maxBadFraction = INTERLACE_BAD_FRACTION},
+	{.name = "deferred", .deferred = 1, .maxBadFraction = MAX_BAD_FRACTION},
+	{.name = "spans", .spans = 1, .maxBadFraction = SORTED_BAD_FRACTION},
+	{.name = "kbuffer", .kbufferLayers = 4, .maxBadFraction = SORTED_BAD_FRACTION},
+};
+#define NUM_PATHS (sizeof(paths) / sizeof(GoldenPath))
+
+/** Golden_buildScene
+ * @brief Walled map with pillars, a glass row and a sprite crowd
+ */
+static void Golden_buildScene(GoldenScene* scene)
+{
+	TestScene_generateTextures(&scene->wallTex, &scene->spriteTex, TEX_SIZE);
+	scene->mapData = (unsigned char*)calloc(MAP_SIZE * MAP_SIZE, 1);
+	for (int i = 0; i < MAP_SIZE; i++)
+	{
+		scene->mapData[i] = TT_BRICK;
+		scene->mapData[(MAP_SIZE - 1) * MAP_SIZE + i] = TT_BRICK;
+		scene->mapData[i * MAP_SIZE] = TT_BRICK;
+		scene->mapData[i * MAP_SIZE + MAP_SIZE - 1] = TT_BRICK;
+	}
+	for (int y = 8; y < MAP_SIZE - 4; y += 6)
+	{
+		for (int x = 6; x < MAP_SIZE - 4; x += 6)
+		{
+			scene->mapData[y * MAP_SIZE + x] = TT_STRIPE;
+		}
+	}
+	for (int x = 4; x < MAP_SIZE - 4; x++)
+	{
+		scene->mapData[6 * MAP_SIZE + x] = TT_GLASS;
+	}
+	RayEngine_generateMap(&scene->map, scene->mapData, MAP_SIZE, MAP_SIZE, 2, NULL, 0);
+	RayEngine_setTileTranslucency(&scene->map, &scene->wallTex);
+
+	RayEngine_initSprite(&scene->crowdSprite, &scene->spriteTex, 0.8, 1.0, 0, 0, 0);
+	RayEngine_initSprite(&scene->glassSprite, &scene->spriteTex, 1.0, 0.6, 0, 0, 0);
+	scene->pool = GameEngine_initEntityPool(NUM_SPRITES + 1, NULL);
+	scene->grid = SpatialHash_init(&scene->map, NUM_SPRITES + 1);
+	GameEngine_setEntityPoolGrid(scene->pool, scene->grid);
+	for (uint32_t s = 0; s < NUM_SPRITES; s++)
+	{
+		double x = 1.5 + (TestScene_random() % 10000) / 10000.0 * (MAP_SIZE - 3);
+		double y = 14.5 + (TestScene_random() % 10000) / 10000.0 * (MAP_SIZE - 17);
+		double h = (TestScene_random() % 100) / 100.0 * 0.4 - 0.2;
+		GameEngine_spawnEntity(scene->pool, &scene->crowdSprite, x, y, h, 0, 0, 0);
+	}
+	GameEngine_spawnEntity(scene->pool, &scene->glassSprite, 12.5, 8.5, 0, 0, 0, 0);
+
+	scene->background = TestScene_initBackground(GOLDEN_WIDTH, GOLDEN_HEIGHT);
+}
+
+static void Golden_delScene(GoldenScene* scene)
+{
+	GameEngine_delEntityPool(scene->pool);
+	SpatialHash_del(scene->grid);
+	RayEngine_delMap(&scene->map);
+	PixBuffer_delPixBuffer(scene->background);
+	TestScene_delTextures(&scene->wallTex, &scene->spriteTex);
+	free(scene->mapData);
+}
+
+/** Golden_render
+ * @brief Renders one pose through the full frame pipeline
+ * * Paths that reuse the last frame render a step behind the pose,
+ * * turned slightly, first
+ * @param path Renderer features to turn on for this frame
+ */
+static void Golden_render(GoldenScene* scene, const GoldenPose* pose, const GoldenPath* path, DepthBuffer* buffer)
+{
+	Camera camera;
+	RayEngine_initCamera(&camera, pose->x, pose->y, pose->angle, M_PI / 2, 10);
+	camera.h = pose->h;
+	if (path->columnStep)
+	{
+		camera.columnStep = path->columnStep;
+	}
+	RayEngine_updateCameraColumns(&camera, GOLDEN_WIDTH);
+	if (path->coherent)
+	{
+		camera.coherence = RayEngine_initCoherence(0.5);
+	}
+	if (path->interlaced)
+	{
+		camera.interlace = RayEngine_initInterlace(0.05);
+	}
+	if (path->deferred)
+	{
+		buffer->gbuffer = RayEngine_initGBuffer(GOLDEN_WIDTH, GOLDEN_HEIGHT);
+	}
+	if (path->spans)
+	{
+		buffer->spans = RayEngine_initSpans(GOLDEN_WIDTH);
+	}
+	if (path->kbufferLayers)
+	{
+		buffer->kbuffer = RayEngine_initKBuffer(GOLDEN_WIDTH, GOLDEN_HEIGHT, path->kbufferLayers, GOLDEN_WIDTH * GOLDEN_HEIGHT * path->kbufferLayers);
+	}
+	for (int frame = camera.coherence || camera.interlace ? 0 : 1; frame < 2; frame++)
+	{
+		camera.x = pose->x - (frame ? 0 : cos(pose->angle) * 0.1);
+		camera.y = pose->y - (frame ? 0 : sin(pose->angle) * 0.1);
+		camera.angle = pose->angle - (frame ? 0 : 0.02);
+		RayEngine_resetDepthBuffer(buffer);
+		memcpy(buffer->pixelBuffer->pixels, scene->background->pixels, sizeof(uint32_t) * GOLDEN_WIDTH * GOLDEN_HEIGHT);
+		if (!buffer->gbuffer && !buffer->spans)
+		{
+			RayEngine_texRenderFloor(buffer->pixelBuffer, &camera, GOLDEN_WIDTH, GOLDEN_HEIGHT, NULL, 0, &scene->wallTex, TT_FLOOR - 1);
+		}
+		RayEngine_raycastRender(buffer, &camera, GOLDEN_WIDTH, GOLDEN_HEIGHT, &scene->map, 0.01, &scene->wallTex);
+		GameEngine_drawEntityPool(buffer, &camera, GOLDEN_WIDTH, GOLDEN_HEIGHT, scene->pool, 1.0);
+		if (buffer->gbuffer)
+		{
+			RayEngine_deferFloor(buffer, &camera, GOLDEN_WIDTH, GOLDEN_HEIGHT, NULL, &scene->wallTex, TT_FLOOR - 1);
+			RayEngine_shadeGBuffer(buffer);
+		}
+		if (buffer->spans)
+		{
+			RayEngine_deferFloor(buffer, &camera, GOLDEN_WIDTH, GOLDEN_HEIGHT, NULL, &scene->wallTex, TT_FLOOR - 1);
+			RayEngine_drawSpans(buffer, &camera, GOLDEN_WIDTH, GOLDEN_HEIGHT);
+		}
+		RayEngine_renderBuffer(buffer);
+		if (camera.interlace)
+		{
+			RayEngine_reconstructInterlace(buffer, &camera);
+		}
+	}
+	if (pose->post)
+	{
+		SDL_Color sepia = {221, 153, 153, 255};
+		PixBuffer_monochromeFilter(buffer->pixelBuffer, sepia, 0.5);
+		PixBuffer_orderDither256(buffer->pixelBuffer, 5);
+	}
+	if (camera.coherence)
+	{
+		RayEngine_delCoherence(camera.coherence);
+	}
+	if (camera.interlace)
+	{
+		RayEngine_delInterlace(camera.interlace);
+	}
+	if (buffer->gbuffer)
+	{
+		RayEngine_delGBuffer(buffer->gbuffer);
+		buffer->gbuffer = NULL;
+	}
+	if (buffer->spans)
+	{
+		RayEngine_delSpans(buffer->spans);
+		buffer->spans = NULL;
+	}
+	if (buffer->kbuffer)
+	{
+		RayEngine_delKBuffer(buffer->kbuffer);
+		buffer->kbuffer = NULL;
+	}
+	RayEngine_delCamera(&camera);
+}
+
+/** Golden_compare
+ * @brief Counts pixels whose color differs by more than tolerance
+ * * Alpha is ignored, goldens are stored as RGB
+ * @param diff Optional PixBuffer to draw a diff image into
+ *        (reference dimmed, differing pixels red)
+ * @return uint32_t Number of differing pixels
+ */
+static uint32_t Golden_compare(PixBuffer* actual, PixBuffer* expected, int32_t tolerance, PixBuffer* diff)
+{
+	uint32_t numBad = 0;
+	for (uint32_t i = 0; i < actual->width * actual->height; i++)
+	{
+		SDL_Color a = PixBuffer_toSDLColor(actual->pixels[i]);
+		SDL_Color e = PixBuffer_toSDLColor(expected->pixels[i]);
+		uint8_t bad = abs(a.r - e.r) > tolerance || abs(a.g - e.g) > tolerance || abs(a.b - e.b) > tolerance;
+		numBad += bad;
+		if (diff)
+		{
+			uint8_t grey = (uint8_t)((e.r + e.g + e.b) / 12);
+			diff->pixels[i] = bad ? PixBuffer_toPixColor(255, 0, 0, 255) : PixBuffer_toPixColor(grey, grey, grey, 255);
+		}
+	}
+	return numBad;
+}
+
+/** Golden_check
+ * @brief Compares a frame, writing it and a diff image if over budget
+ * @return int 0 if within tolerance, 1 otherwise
+ */
+static int Golden_check(PixBuffer* actual, PixBuffer* expected, int32_t tolerance, double maxBadFraction, const char* outDir, const char* poseName, const char* against)
+{
+	uint32_t numBad = Golden_compare(actual, expected, tolerance, NULL);
+	uint32_t maxBad = (uint32_t)(actual->width * actual->height * maxBadFraction);
+	if (numBad <= maxBad)
+	{
+		return 0;
+	}
+	char path[4096];
+	PixBuffer* diff = PixBuffer_initPixBuffer(actual->width, actual->height);
+	Golden_compare(actual, expected, tolerance, diff);
+	snprintf(path, sizeof(path), "%s/%s_%s_diff.ppm", outDir, poseName, against);
+	PixBuffer_writePPM(diff, path);
+	snprintf(path, sizeof(path), "%s/%s_%s_actual.ppm", outDir, poseName, against);
+	PixBuffer_writePPM(actual, path);
+	PixBuffer_delPixBuffer(diff);
+	printf("FAIL %-14s %-10s %u pixels differ (allowed %u), see %s\n", poseName, against, numBad, maxBad, path);
+	return 1;
+}
+
+int main(int argc, char* argv[])
+{
+	const char* goldenDir = "golden";
+	const char* outDir = "build/golden";
+	int32_t tolerance = 8;
+	uint8_t update = 0;
+	for (int a = 1; a < argc; a++)
+	{
+		if (!strcmp(argv[a], "--update"))
+		{
+			update = 1;
+		}
+		else if (!strcmp(argv[a], "--golden") && a + 1 < argc)
+		{
+			goldenDir = argv[++a];
+		}
+		else if (!strcmp(argv[a], "--out") && a + 1 < argc)
+		{
+			outDir = argv[++a];
+		}
+		else if (!strcmp(argv[a], "--tolerance") && a + 1 < argc)
+		{
+			tolerance = atoi(argv[++a]);
+		}
+		else
+		{
+			fprintf(stderr, "Usage: %s [--update] [--golden DIR] [--out DIR] [--tolerance N]\n", argv[0]);
+			return -1;
+		}
+	}
+
+	GoldenScene scene;
+	Golden_buildScene(&scene);
+	DepthBuffer* buffer = RayEngine_initDepthBuffer(GOLDEN_WIDTH, GOLDEN_HEIGHT);
+	PixBuffer* reference = PixBuffer_initPixBuffer(GOLDEN_WIDTH, GOLDEN_HEIGHT);
+	uint32_t numFailed = 0;
+	uint32_t numChecked = 0;
+	char path[4096];
+	for (uint32_t p = 0; p < NUM_POSES; p++)
+	{
+		for (uint32_t r = 0; r < NUM_PATHS; r++)
+		{
+			if (paths[r].begin)
+			{
+				paths[r].begin();
+			}
+			Golden_render(&scene, &poses[p], &paths[r], buffer);
+			if (paths[r].end)
+			{
+				paths[r].end();
+			}
+			if (r == 0)
+			{
+				// Scalar reference against stored golden
+				memcpy(reference->pixels, buffer->pixelBuffer->pixels, sizeof(uint32_t) * GOLDEN_WIDTH * GOLDEN_HEIGHT);
+				snprintf(path, sizeof(path), "%s/%s.ppm", goldenDir, poses[p].name);
+				if (update)
+				{
+					if (PixBuffer_writePPM(reference, path))
+					{
+						fprintf(stderr, "ERROR: Could not write %s\n", path);
+						numFailed++;
+					}
+					continue;
+				}
+				PixBuffer* golden = PixBuffer_readPPM(path);
+				numChecked++;
+				if (!golden || golden->width != GOLDEN_WIDTH || golden->height != GOLDEN_HEIGHT)
+				{
+					printf("FAIL %-14s missing or bad golden %s (run with --update)\n", poses[p].name, path);
+					numFailed++;
+				}
+				else
+				{
+					numFailed += Golden_check(reference, golden, tolerance, MAX_BAD_FRACTION, outDir, poses[p].name, "golden");
+				}
+				if (golden)
+				{
+					PixBuffer_delPixBuffer(golden);
+				}
+			}
+			else
+			{
+				numChecked++;
+				numFailed += Golden_check(buffer->pixelBuffer, reference, tolerance, paths[r].maxBadFraction, outDir, poses[p].name, paths[r].name);
+			}
+		}
+	}
+	if (update)
+	{
+		printf("Wrote %u goldens to %s\n", (uint32_t)NUM_POSES, goldenDir);
+	}
+	else
+	{
+		printf("%u/%u checks passed (%u poses, %u render paths)\n", numChecked - numFailed, numChecked, (uint32_t)NUM_POSES, (uint32_t)NUM_PATHS);
+	}
+
+	PixBuffer_delPixBuffer(reference);
+	RayEngine_delDepthBuffer(buffer);
+	Golden_delScene(&scene);
+	return numFailed ? 1 : 0;
+}
@@ -12,24 +12,84 @@
 #include <math.h>
 #include "gameengine.h"
 
+// Turn rate per relative mouse count (radians)
+#define MOUSE_SENSITIVITY 0.004
+
+// Gameplay random state, see GameEngine_seedRandom
+static uint32_t randomState = 0x2545F491;
+
+/** GameEngine_reserveEntityPool
+ * @brief Grows pool component arrays to hold at least capacity entities
+ * 
+ * @param pool EntityPool to grow
+ * @param capacity New capacity
+ */
+static void GameEngine_reserveEntityPool(EntityPool* pool, uint32_t capacity)
+{
+	if (capacity <= pool->capacity)
+	{
+		return;
+	}
+	pool->x = (double*)realloc(pool->x, sizeof(double) * capacity);
+	pool->y = (double*)realloc(pool->y, sizeof(double) * capacity);
+	pool->h = (double*)realloc(pool->h, sizeof(double) * capacity);
+	pool->prevX = (double*)realloc(pool->prevX, sizeof(double) * capacity);
+	pool->prevY = (double*)realloc(pool->prevY, sizeof(double) * capacity);
+	pool->prevH = (double*)realloc(pool->prevH, sizeof(double) * capacity);
+	pool->velX = (double*)realloc(pool->velX, sizeof(double) * capacity);
+	pool->velY = (double*)realloc(pool->velY, sizeof(double) * capacity);
+	pool->velH = (double*)realloc(pool->velH, sizeof(double) * capacity);
+	pool->sprite = (RaySprite**)realloc(pool->sprite, sizeof(RaySprite*) * capacity);
+	pool->frameNum = (uint8_t*)realloc(pool->frameNum, sizeof(uint8_t) * capacity);
+	pool->state = (uint8_t*)realloc(pool->state, sizeof(uint8_t) * capacity);
+	pool->handle = (uint32_t*)realloc(pool->handle, sizeof(uint32_t) * capacity);
+	pool->slot = (uint32_t*)realloc(pool->slot, sizeof(uint32_t) * capacity);
+	pool->freeList = (uint32_t*)realloc(pool->freeList, sizeof(uint32_t) * capacity);
+	pool->visible = (uint32_t*)realloc(pool->visible, sizeof(uint32_t) * capacity);
+	if (pool->grid)
+	{
+		SpatialHash_reserve(pool->grid, capacity);
+	}
+	// New handles go on the free list, lowest handle handed out first
+	for (uint32_t handle = capacity; handle-- > pool->capacity;)
+	{
+		pool->slot[handle] = POOL_FREE;
+		pool->freeList[pool->freeCount++] = handle;
+	}
+	pool->capacity = capacity;
+}
+
 void GameEngine_initPlayer(Player* player, double x, double y, double angle, uint8_t usingMouse, double fov, double viewDist, uint32_t screenWidth)
 {
 	player->x = x;
 	player->y = y;
 	player->h = 0;
+	player->groundH = 0;
+	player->velX = 0;
+	player->velY = 0;
+	player->velH = 0;
 	player->angle = angle;
+	player->prevX = x;
+	player->prevY = y;
+	player->prevH = 0;
+	player->prevAngle = angle;
 	player->health = 100; //PLACEHOLDER
 	player->state = 1; //PLACEHOLDER
 	player->usingMouse = usingMouse;
 	player->spacePressed = 0;
 	player->timer = 0;
-	player->camera.x = player->x;
-	player->camera.y = player->y;
-	player->camera.angle = player->angle;
-	player->camera.dist = viewDist;
-	player->camera.fov = fov;
-	player->camera.h = player->h;
-	RayEngine_generateAngleValues(screenWidth, &(player->camera));
+	RayEngine_initCamera(&(player->camera), x, y, angle, fov, viewDist);
+	RayEngine_updateCameraColumns(&(player->camera), screenWidth);
+}
+
+/** GameEngine_delPlayer
+ * @brief Frees memory held by a Player (camera tables)
+ * 
+ * @param player Player to free
+ */
+void GameEngine_delPlayer(Player* player)
+{
+	RayEngine_delCamera(&(player->camera));
 }
 
 void GameEngine_initEntity(Entity* entity, double x, double y, double h, double angle, RayTex* spriteTex, RayTex* shadowTex)
@@ -37,19 +97,37 @@ void GameEngine_initEntity(Entity* entity, double x, double y, double h, double
 	entity->x = x;
 	entity->y = y;
 	entity->h = h;
+	entity->prevX = x;
+	entity->prevY = y;
+	entity->prevH = h;
 	entity->angle = angle;
 	entity->health = 0; //PLACEHOLDER
 	entity->state = 0; //PLACEHOLDER
 	RayEngine_initSprite(&(entity->sprite), spriteTex, 1.0, 1.0, x, y, h);
 	RayEngine_initSprite(&(entity->shadow), shadowTex, 0, 0.5, x, y, -0.5);
+	entity->grid = NULL;
+	entity->handle = HASH_NONE;
 }
 
-void GameEngine_initProjectiles(ProjectileList* projectiles, uint32_t numProjectile, RayTex* spriteTex, RayTex* shadowTex)
+/** GameEngine_setEntityGrid
+ * @brief Tracks an entity in a SpatialHash under the given handle
+ * GameEngine_moveEntity then keeps its tile up to date
+ * @param entity Entity to track
+ * @param grid SpatialHash to use (NULL to detach)
+ * @param handle Handle to file entity under, unique within grid
+ */
+void GameEngine_setEntityGrid(Entity* entity, SpatialHash* grid, uint32_t handle)
 {
-	for (int i = 0; i < numProjectile; i++)
+	if (entity->grid)
+	{
+		SpatialHash_remove(entity->grid, entity->handle);
+	}
+	entity->grid = grid;
+	entity->handle = grid ? handle : HASH_NONE;
+	if (grid)
 	{
-		GameEngine_initEntity(&projectiles->projectiles[i], -1000, -1000, -0.5, 0, spriteTex, shadowTex);
-		projectiles->projectiles[i].sprite.scaleFactor = 0.1;
+		SpatialHash_reserve(grid, handle + 1);
+		SpatialHash_insert(grid, handle, entity->x, entity->y);
 	}
 }
 
@@ -58,6 +136,43 @@ void GameEngine_moveEntity(Entity* entity, double x, double y, double h)
 	entity->x = x;
 	entity->y = y;
 	entity->h = h;
+	if (entity->grid)
+	{
+		SpatialHash_move(entity->grid, entity->handle, x, y);
+	}
+}
+
+/** GameEngine_compareHandles
+ * @brief qsort comparison, ascending entity handles
+ */
+static int GameEngine_compareHandles(const void* a, const void* b)
+{
+	uint32_t handleA = *(const uint32_t*)a;
+	uint32_t handleB = *(const uint32_t*)b;
+	return (handleA > handleB) - (handleA < handleB);
+}
+
+/** GameEngine_cullEntities
+ * @brief Finds the entities in tiles a camera can see
+ * Same view test as GameEngine_drawEntityPool. Handles come out
+ * in ascending order, so sprites keep their list draw order
+ * @param grid SpatialHash the entities are tracked in
+ * @param camera Camera to test against
+ * @param width Width of render in pixels
+ * @param height Height of render in pixels
+ * @param visible Array to write handles of visible entities to
+ * @param maxVisible Length of visible
+ * @return uint32_t Number of visible entities
+ */
+uint32_t GameEngine_cullEntities(SpatialHash* grid, Camera* camera, uint32_t width, uint32_t height, uint32_t* visible, uint32_t maxVisible)
+{
+	double viewDist = camera->dist * ((double)width / (double)height * 2.4);
+	uint32_t numVisible = SpatialHash_queryView(grid, camera, viewDist, 1.0, visible, maxVisible);
+	if (numVisible > 1)
+	{
+		qsort(visible, numVisible, sizeof(uint32_t), GameEngine_compareHandles);
+	}
+	return numVisible;
 }
 
 void GameEngine_scaleEntity(Entity* entity, double scaleFactor)
@@ -65,10 +180,22 @@ void GameEngine_scaleEntity(Entity* entity, double scaleFactor)
 	entity->sprite.scaleFactor = scaleFactor;
 }
 
+/** GameEngine_updatePlayer
+ * @brief Advances player by one simulation step
+ * Previous state is kept for GameEngine_interpolatePlayer
+ * @param player Player to update
+ * @param map Map to collide against
+ * @param keyMap Input state for this step (mouse delta is consumed)
+ * @param dt Step length in seconds
+ */
 void GameEngine_updatePlayer(Player* player, Map* map, KeyMap* keyMap, double dt)
 {
 	int borderWidth = 2;
 	uint8_t* keys = keyMap->state;
+	player->prevX = player->x;
+	player->prevY = player->y;
+	player->prevH = player->h;
+	player->prevAngle = player->angle;
 	// Death test
 	if ((keys[PK_KILL] && player->state))
 	{
@@ -180,43 +307,31 @@ void GameEngine_updatePlayer(Player* player, Map* map, KeyMap* keyMap, double dt
 				newY = (int)floor(player->y-dy);
 				changeY = -dy;
 			}
-			if (newX < -map->border)
-			{
-				newX += map->width + map->border * 2;
-				changeX += map->width + map->border * 2;
-			}
-			else if (newX >= map->width + map->border)
-			{
-				newX -= map->width + map->border * 2;
-				changeX -= map->width + map->border * 2;
-			}
-			if (newY < -map->border)
-			{
-				newY += map->height + map->border*2;
-				changeY += map->height + map->border*2;
-			}
-			else if (newY >= map->height + map->border)
-			{
-				newY -= map->height + map->border*2;
-				changeY -= map->height + map->border*2;
-			}
+			// Wrap around the map, same tables as the ray traversal
+			int wrapX = RayEngine_wrapX(map, newX);
+			int wrapY = RayEngine_wrapY(map, newY);
+			changeX += wrapX - newX;
+			changeY += wrapY - newY;
 			player->velX = changeX;
 			player->velY = changeY;
-			if (((newX < 0 || newX >= map->width) || (oldY < 0 || oldY >= map->height)) || map->data[oldY*map->width+newX] == 0)
+			// Shift the previous position across the seam too, so interpolation
+			// only sees the step and not the wrap jump
+			if (((wrapX < 0 || wrapX >= map->width) || (oldY < 0 || oldY >= map->height)) || RayEngine_getTile(map, wrapX, oldY) == 0)
+			{
 				player->x += player->velX;
-			if (((newY < 0 || newY >= map->height) || (oldX < 0 || oldX >= map->width)) || map->data[newY*map->width+oldX] == 0)
+				player->prevX += wrapX - newX;
+			}
+			if (((wrapY < 0 || wrapY >= map->height) || (oldX < 0 || oldX >= map->width)) || RayEngine_getTile(map, oldX, wrapY) == 0)
+			{
 				player->y += player->velY;
+				player->prevY += wrapY - newY;
+			}
 		}
 		if (player->usingMouse)
 		{
-			if (SDL_GetRelativeMouseMode())
-			{
-				// Get mouse change since last frame
-				int32_t mouseX;
-				SDL_GetRelativeMouseState(&mouseX, NULL);
-				// Update player
-				player->angle += 0.25 * dt * mouseX;
-			}
+			// Mouse change since last step, see GameEngine_updateKeys
+			player->angle += MOUSE_SENSITIVITY * keyMap->mouseX;
+			keyMap->mouseX = 0;
 		}
 		else
 		{
@@ -244,64 +359,417 @@ void GameEngine_updatePlayer(Player* player, Map* map, KeyMap* keyMap, double dt
 	player->camera.angle = player->angle;
 }
 
+/** GameEngine_interpolatePlayer
+ * @brief Places player camera between the last two simulation steps
+ * 
+ * @param player Player to update camera of
+ * @param alpha Fraction of a step elapsed since the last update (0-1)
+ */
+void GameEngine_interpolatePlayer(Player* player, double alpha)
+{
+	double dAngle = player->angle - player->prevAngle;
+	// Take the short way around
+	if (dAngle > M_PI)
+	{
+		dAngle -= 2 * M_PI;
+	}
+	else if (dAngle < -M_PI)
+	{
+		dAngle += 2 * M_PI;
+	}
+	player->camera.x = player->prevX + (player->x - player->prevX) * alpha;
+	player->camera.y = player->prevY + (player->y - player->prevY) * alpha;
+	player->camera.h = player->prevH + (player->h - player->prevH) * alpha;
+	player->camera.angle = player->prevAngle + dAngle * alpha;
+}
+
+/** GameEngine_saveEntityState
+ * @brief Stores entity position as the start of a simulation step
+ * Call before moving the entity each step
+ * @param entity Entity to store
+ */
+void GameEngine_saveEntityState(Entity* entity)
+{
+	entity->prevX = entity->x;
+	entity->prevY = entity->y;
+	entity->prevH = entity->h;
+}
+
 void GameEngine_updateEntity(Entity* entity)
 {
-	entity->sprite.x = entity->x;
-	entity->sprite.y = entity->y;
-	entity->sprite.h = entity->h;
-	entity->shadow.x = entity->x;
-	entity->shadow.y = entity->y;
-	entity->shadow.scaleFactor = exp(-(entity->h+0.5))*(entity->sprite.scaleFactor);
+	GameEngine_interpolateEntity(entity, 1.0);
 }
 
-void GameEngine_updateProjectile(ProjectileList* projectiles, uint32_t numProjectile, Player* player)
+/** GameEngine_interpolateEntity
+ * @brief Places entity sprites between the last two simulation steps
+ * 
+ * @param entity Entity to update sprites of
+ * @param alpha Fraction of a step elapsed since the last update (0-1)
+ */
+void GameEngine_interpolateEntity(Entity* entity, double alpha)
 {
-	double velocity = 0.1;
-	// First, see if space key pressed
-	const uint8_t* keys = SDL_GetKeyboardState(NULL);
-	// Hasn't yet fired
-	if (keys[SDL_SCANCODE_SPACE] && !player->spacePressed)
+	double x = entity->prevX + (entity->x - entity->prevX) * alpha;
+	double y = entity->prevY + (entity->y - entity->prevY) * alpha;
+	double h = entity->prevH + (entity->h - entity->prevH) * alpha;
+	entity->sprite.x = x;
+	entity->sprite.y = y;
+	entity->sprite.h = h;
+	entity->shadow.x = x;
+	entity->shadow.y = y;
+	entity->shadow.scaleFactor = exp(-(h+0.5))*(entity->sprite.scaleFactor);
+}
+
+/** GameEngine_initSnapshot
+ * @brief Initializes an empty FrameSnapshot
+ * 
+ * @param snapshot FrameSnapshot to initialize
+ */
+void GameEngine_initSnapshot(FrameSnapshot* snapshot)
+{
+	memset(snapshot, 0, sizeof(FrameSnapshot));
+	RayEngine_initCamera(&(snapshot->camera), 0, 0, 0, M_PI/2, 1);
+}
+
+/** GameEngine_delSnapshot
+ * @brief Frees memory held by a FrameSnapshot (camera tables, sprites)
+ * 
+ * @param snapshot FrameSnapshot to free
+ */
+void GameEngine_delSnapshot(FrameSnapshot* snapshot)
+{
+	RayEngine_delCamera(&(snapshot->camera));
+	free(snapshot->sprites);
+	snapshot->sprites = NULL;
+	snapshot->capacity = 0;
+}
+
+/** GameEngine_beginSnapshot
+ * @brief Starts a new frame in a snapshot: camera pose, no sprites
+ * * Render settings (columnStep, coherence, interlace) are left
+ * * to the renderer
+ * @param snapshot FrameSnapshot to fill
+ * @param camera Camera, already interpolated
+ * @param map Map the frame was simulated against
+ */
+void GameEngine_beginSnapshot(FrameSnapshot* snapshot, Camera* camera, Map* map)
+{
+	snapshot->camera.x = camera->x;
+	snapshot->camera.y = camera->y;
+	snapshot->camera.h = camera->h;
+	snapshot->camera.angle = camera->angle;
+	snapshot->camera.dist = camera->dist;
+	snapshot->camera.fov = camera->fov;
+	snapshot->camera.lodDepthRatio = camera->lodDepthRatio;
+	snapshot->mapVersion = map->version;
+	snapshot->numSprites = 0;
+}
+
+/** GameEngine_addSnapshotSprite
+ * @brief Copies a sprite into a snapshot, in draw order
+ * 
+ * @param snapshot FrameSnapshot to add to
+ * @param sprite Sprite, already interpolated
+ */
+void GameEngine_addSnapshotSprite(FrameSnapshot* snapshot, RaySprite* sprite)
+{
+	if (snapshot->numSprites == snapshot->capacity)
+	{
+		snapshot->capacity = snapshot->capacity ? snapshot->capacity * 2 : 32;
+		snapshot->sprites = (RaySprite*)realloc(snapshot->sprites, sizeof(RaySprite) * snapshot->capacity);
+	}
+	snapshot->sprites[snapshot->numSprites++] = *sprite;
+}
+
+/** GameEngine_isSnapshotCurrent
+ * @brief Checks the map is unchanged since a snapshot was taken
+ * * Call once the snapshot is rendered (and any sim running
+ * * meanwhile has finished) to catch edits made during the render
+ * @param snapshot FrameSnapshot that was rendered
+ * @param map Map it was simulated against
+ * @return uint8_t 1 if map->version still matches
+ */
+uint8_t GameEngine_isSnapshotCurrent(FrameSnapshot* snapshot, Map* map)
+{
+	return snapshot->mapVersion == map->version;
+}
+
+/** GameEngine_initEntityPool
+ * @brief Allocates a new EntityPool
+ * * Pool grows on demand, capacity is just the starting size
+ * @param capacity Number of entities to reserve space for
+ * @param shadow Shadow sprite drawn under every entity (NULL for none)
+ * @return EntityPool* New pool
+ */
+EntityPool* GameEngine_initEntityPool(uint32_t capacity, RaySprite* shadow)
+{
+	EntityPool* pool = (EntityPool*)calloc(1, sizeof(EntityPool));
+	pool->shadow = shadow;
+	GameEngine_reserveEntityPool(pool, capacity ? capacity : 16);
+	return pool;
+}
+
+/** GameEngine_delEntityPool
+ * @brief Deallocates EntityPool memory
+ * ! Will destroy pool
+ * @param pool Pool to free
+ */
+void GameEngine_delEntityPool(EntityPool* pool)
+{
+	free(pool->x);
+	free(pool->y);
+	free(pool->h);
+	free(pool->prevX);
+	free(pool->prevY);
+	free(pool->prevH);
+	free(pool->velX);
+	free(pool->velY);
+	free(pool->velH);
+	free(pool->sprite);
+	free(pool->frameNum);
+	free(pool->state);
+	free(pool->handle);
+	free(pool->slot);
+	free(pool->freeList);
+	free(pool->visible);
+	free(pool);
+}
+
+/** GameEngine_spawnEntity
+ * @brief Adds an entity to the pool in O(1)
+ * 
+ * @param pool EntityPool to spawn into
+ * @param sprite Sprite the entity is drawn with (shared, not copied)
+ * @param x Map x coordinate
+ * @param y Map y coordinate
+ * @param h Map h coordinate
+ * @param velX x velocity (units per second)
+ * @param velY y velocity (units per second)
+ * @param velH h velocity (units per second)
+ * @return uint32_t Handle of new entity
+ */
+uint32_t GameEngine_spawnEntity(EntityPool* pool, RaySprite* sprite, double x, double y, double h, double velX, double velY, double velH)
+{
+	if (!pool->freeCount)
+	{
+		GameEngine_reserveEntityPool(pool, pool->capacity * 2);
+	}
+	uint32_t handle = pool->freeList[--pool->freeCount];
+	uint32_t i = pool->count++;
+	pool->slot[handle] = i;
+	pool->handle[i] = handle;
+	pool->x[i] = x;
+	pool->y[i] = y;
+	pool->h[i] = h;
+	pool->prevX[i] = x;
+	pool->prevY[i] = y;
+	pool->prevH[i] = h;
+	pool->velX[i] = velX;
+	pool->velY[i] = velY;
+	pool->velH[i] = velH;
+	pool->sprite[i] = sprite;
+	pool->frameNum[i] = sprite->frameNum;
+	pool->state[i] = 0;
+	if (pool->grid)
+	{
+		SpatialHash_insert(pool->grid, handle, x, y);
+	}
+	return handle;
+}
+
+/** GameEngine_despawnEntity
+ * @brief Removes an entity from the pool in O(1)
+ * * Last live entity is moved into the hole, so dense
+ * * indices change but handles do not
+ * @param pool EntityPool to remove from
+ * @param handle Handle of entity to remove
+ */
+void GameEngine_despawnEntity(EntityPool* pool, uint32_t handle)
+{
+	uint32_t i = pool->slot[handle];
+	uint32_t last = --pool->count;
+	if (pool->grid)
 	{
-		for (int i = 0; i < numProjectile; i++)
+		SpatialHash_remove(pool->grid, handle);
+	}
+	if (i != last)
+	{
+		pool->x[i] = pool->x[last];
+		pool->y[i] = pool->y[last];
+		pool->h[i] = pool->h[last];
+		pool->prevX[i] = pool->prevX[last];
+		pool->prevY[i] = pool->prevY[last];
+		pool->prevH[i] = pool->prevH[last];
+		pool->velX[i] = pool->velX[last];
+		pool->velY[i] = pool->velY[last];
+		pool->velH[i] = pool->velH[last];
+		pool->sprite[i] = pool->sprite[last];
+		pool->frameNum[i] = pool->frameNum[last];
+		pool->state[i] = pool->state[last];
+		pool->handle[i] = pool->handle[last];
+		pool->slot[pool->handle[i]] = i;
+	}
+	pool->slot[handle] = POOL_FREE;
+	pool->freeList[pool->freeCount++] = handle;
+}
+
+/** GameEngine_setEntityPoolGrid
+ * @brief Attaches a SpatialHash that tracks every entity in the pool
+ * Spawns, despawns and moves then keep the hash up to date, and
+ * GameEngine_drawEntityPool uses it to cull sprites
+ * @param pool EntityPool to attach to
+ * @param grid SpatialHash to use (NULL to detach)
+ */
+void GameEngine_setEntityPoolGrid(EntityPool* pool, SpatialHash* grid)
+{
+	pool->grid = grid;
+	if (grid)
+	{
+		SpatialHash_reserve(grid, pool->capacity);
+		for (uint32_t i = 0; i < pool->count; i++)
 		{
-			if (projectiles->projectiles[i].state == 0)
-			{
-				GameEngine_moveEntity(&projectiles->projectiles[i], player->x - 0.1 * sin(player->angle), player->y + 0.1 * cos(player->angle), -0.1);
-				projectiles->projectiles[i].angle = player->angle;
-				projectiles->projectiles[i].state = 1;
-				projectiles->projectiles[i].sprite.frameNum = 1;
-				player->spacePressed = 1;
-				break;
-			}
+			SpatialHash_insert(grid, pool->handle[i], pool->x[i], pool->y[i]);
 		}
 	}
-	else if (!keys[SDL_SCANCODE_SPACE])
+}
+
+/** GameEngine_movePoolEntity
+ * @brief Moves a pooled entity, updating its grid tile if it changed
+ * 
+ * @param pool EntityPool holding entity
+ * @param handle Handle of entity to move
+ * @param x Map x coordinate
+ * @param y Map y coordinate
+ * @param h Map h coordinate
+ */
+void GameEngine_movePoolEntity(EntityPool* pool, uint32_t handle, double x, double y, double h)
+{
+	uint32_t i = pool->slot[handle];
+	pool->x[i] = x;
+	pool->y[i] = y;
+	pool->h[i] = h;
+	if (pool->grid)
+	{
+		SpatialHash_move(pool->grid, handle, x, y);
+	}
+}
+
+/** GameEngine_integrateEntityPool
+ * @brief Moves every pooled entity along its velocity for one step
+ * Previous positions are kept for interpolation
+ * @param pool EntityPool to update
+ * @param dt Step length in seconds
+ */
+void GameEngine_integrateEntityPool(EntityPool* pool, double dt)
+{
+	uint32_t count = pool->count;
+	double* restrict x = pool->x;
+	double* restrict y = pool->y;
+	double* restrict h = pool->h;
+	double* restrict prevX = pool->prevX;
+	double* restrict prevY = pool->prevY;
+	double* restrict prevH = pool->prevH;
+	const double* restrict velX = pool->velX;
+	const double* restrict velY = pool->velY;
+	const double* restrict velH = pool->velH;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		prevX[i] = x[i];
+		prevY[i] = y[i];
+		prevH[i] = h[i];
+		x[i] += velX[i] * dt;
+		y[i] += velY[i] * dt;
+		h[i] += velH[i] * dt;
+	}
+	if (pool->grid)
+	{
+		for (uint32_t i = 0; i < count; i++)
+		{
+			SpatialHash_move(pool->grid, pool->handle[i], x[i], y[i]);
+		}
+	}
+}
+
+/** GameEngine_drawEntityPool
+ * @brief Renders every pooled entity (and shadow) to a DepthBuffer
+ * 
+ * @param buffer DepthBuffer to render to
+ * @param camera Camera to render from
+ * @param width Width of buffer in pixels
+ * @param height Height of buffer in pixels
+ * @param pool EntityPool to draw
+ * @param alpha Fraction of a step elapsed since the last update (0-1)
+ */
+void GameEngine_drawEntityPool(DepthBuffer* buffer, Camera* camera, uint32_t width, uint32_t height, EntityPool* pool, double alpha)
+{
+	RaySprite sprite;
+	uint32_t numVisible = pool->count;
+	if (pool->grid)
+	{
+		// Only consider entities in tiles the camera can see
+		double viewDist = camera->dist * ((double)width / (double)height * 2.4);
+		numVisible = SpatialHash_queryView(pool->grid, camera, viewDist, 1.0, pool->visible, pool->capacity);
+		// Grid rejects count as culled sprites (and shadows)
+		RAY_STAT_ADD(buffer->stats, spritesCulled, (pool->count - numVisible) * (pool->shadow ? 2 : 1));
+	}
+	for (uint32_t v = 0; v < numVisible; v++)
+	{
+		uint32_t i = pool->grid ? pool->slot[pool->visible[v]] : v;
+		sprite = *pool->sprite[i];
+		sprite.x = pool->prevX[i] + (pool->x[i] - pool->prevX[i]) * alpha;
+		sprite.y = pool->prevY[i] + (pool->y[i] - pool->prevY[i]) * alpha;
+		sprite.h = pool->prevH[i] + (pool->h[i] - pool->prevH[i]) * alpha;
+		sprite.frameNum = pool->frameNum[i];
+		RayEngine_draw3DSprite(buffer, camera, width, height, 0.01, sprite);
+		if (pool->shadow)
+		{
+			RaySprite shadow = *pool->shadow;
+			shadow.x = sprite.x;
+			shadow.y = sprite.y;
+			shadow.scaleFactor = exp(-(sprite.h+0.5))*(sprite.scaleFactor);
+			RayEngine_draw3DSprite(buffer, camera, width, height, 0.01, shadow);
+		}
+	}
+}
+
+/** GameEngine_updateProjectile
+ * @brief Fires and advances projectiles for one simulation step
+ * 
+ * @param projectiles EntityPool holding live projectiles
+ * @param projectileSprite Sprite used for new projectiles
+ * @param player Player firing projectiles
+ * @param keyMap Input state for this step
+ * @param dt Step length in seconds
+ */
+void GameEngine_updateProjectile(EntityPool* projectiles, RaySprite* projectileSprite, Player* player, KeyMap* keyMap, double dt)
+{
+	double velocity = 6.0;
+	// First, see if fire (the jump key) is pressed
+	uint8_t* keys = keyMap->state;
+	// Hasn't yet fired
+	if (keys[PK_JUMP] && !player->spacePressed)
+	{
+		uint32_t handle = GameEngine_spawnEntity(projectiles, projectileSprite,
+			player->x - 0.1 * sin(player->angle), player->y + 0.1 * cos(player->angle), -0.1,
+			velocity * cos(player->angle), velocity * sin(player->angle), 0);
+		projectiles->frameNum[projectiles->slot[handle]] = 1;
+		projectiles->state[projectiles->slot[handle]] = 1;
+		player->spacePressed = 1;
+	}
+	else if (!keys[PK_JUMP])
 	{
 		player->spacePressed = 0;
 	}
-	//printf("spacePressed: %d\n", player->spacePressed);
 	// Update bullets
-	for (int i = 0; i < numProjectile; i++)
+	GameEngine_integrateEntityPool(projectiles, dt);
+	// Remove anything out of view range, backwards so swaps don't skip entries
+	double maxDist = player->camera.dist * player->camera.dist;
+	for (uint32_t i = projectiles->count; i-- > 0;)
 	{
-		if (projectiles->projectiles[i].state == 1)
+		double dx = projectiles->x[i] - player->x;
+		double dy = projectiles->y[i] - player->y;
+		if (dx*dx + dy*dy > maxDist)
 		{
-			projectiles->projectiles[i].x += velocity * cos(projectiles->projectiles[i].angle);
-			projectiles->projectiles[i].y += velocity * sin(projectiles->projectiles[i].angle);
-			if ((projectiles->projectiles[i].angle - player->angle > M_PI/2) || (projectiles->projectiles[i].angle - player->angle < -M_PI/2))
-			{
-				projectiles->projectiles[i].sprite.frameNum = 1;
-			}
-			else
-			{
-				projectiles->projectiles[i].sprite.frameNum = 1;
-			}
-			if (sqrt((projectiles->projectiles[i].x - player->x)*(projectiles->projectiles[i].x - player->x) + (projectiles->projectiles[i].y - player->y)*(projectiles->projectiles[i].y - player->y)) > player->camera.dist)
-			{
-				projectiles->projectiles[i].state = 0;
-				projectiles->projectiles[i].x = -1000;
-				projectiles->projectiles[i].y = -1000;
-			}
-			GameEngine_updateEntity(&projectiles->projectiles[i]);
+			GameEngine_despawnEntity(projectiles, projectiles->handle[i]);
 		}
 	}
 }
@@ -309,6 +777,7 @@ void GameEngine_updateProjectile(ProjectileList* projectiles, uint32_t numProjec
 void GameEngine_bindKeys(KeyMap* keyMap, uint8_t* keyList)
 {
 	int i = 0;
+	keyMap->mouseX = 0;
 	while (keyList[i] != TERMINATE_PK)
 	{
 		keyMap->keys[keyList[i]].primary = keyList[i+1];
@@ -317,9 +786,20 @@ void GameEngine_bindKeys(KeyMap* keyMap, uint8_t* keyList)
 	}
 }
 
+/** GameEngine_updateKeys
+ * @brief Samples keyboard and mouse into a KeyMap
+ * Relative mouse motion accumulates until a player update consumes it
+ * @param keyMap KeyMap to update
+ */
 void GameEngine_updateKeys(KeyMap* keyMap)
 {
 	const uint8_t* keys = SDL_GetKeyboardState(NULL);
+	int32_t mouseX = 0;
+	if (SDL_GetRelativeMouseMode())
+	{
+		SDL_GetRelativeMouseState(&mouseX, NULL);
+		keyMap->mouseX += mouseX;
+	}
 	for (int i = 0; i < LEN_PK; i++)
 	{
 		if (keyMap->keys[i].primary && \
@@ -333,3 +813,183 @@ void GameEngine_updateKeys(KeyMap* keyMap)
 		}
 	}
 }
+
+/** GameEngine_seedRandom
+ * @brief Seeds the gameplay random generator
+ * * Gameplay randomness must come from GameEngine_random so
+ * * recorded sessions replay identically (see Replay)
+ * @param seed Seed value (0 picks the default seed)
+ */
+void GameEngine_seedRandom(uint32_t seed)
+{
+	randomState = seed ? seed : 0x2545F491;
+}
+
+/** GameEngine_random
+ * @brief Next gameplay random number (xorshift32)
+ * 
+ * @return uint32_t Random value
+ */
+uint32_t GameEngine_random(void)
+{
+	randomState ^= randomState << 13;
+	randomState ^= randomState >> 17;
+	randomState ^= randomState << 5;
+	return randomState;
+}
+
+/** GameEngine_initClock
+ * @brief Initializes a fixed-step simulation clock
+ * 
+ * @param clock GameClock to initialize
+ * @param stepRate Simulation steps per second
+ * @param maxSteps Most steps to run per frame before dropping time
+ */
+void GameEngine_initClock(GameClock* clock, double stepRate, uint32_t maxSteps)
+{
+	clock->frequency = SDL_GetPerformanceFrequency();
+	clock->lastCount = SDL_GetPerformanceCounter();
+	clock->stepTime = 1.0 / stepRate;
+	clock->accumulator = 0;
+	clock->frameTime = 0;
+	clock->alpha = 0;
+	clock->maxSteps = maxSteps;
+}
+
+/** GameEngine_advanceClock
+ * @brief Feeds elapsed time to clock and returns steps to simulate
+ * * Use directly for fixed-rate playback, otherwise see GameEngine_tickClock
+ * @param clock GameClock to advance
+ * @param frameTime Elapsed time in seconds
+ * @return uint32_t Number of simulation steps to run this frame
+ */
+uint32_t GameEngine_advanceClock(GameClock* clock, double frameTime)
+{
+	clock->frameTime = frameTime;
+	clock->accumulator += frameTime;
+	uint32_t steps = (uint32_t)(clock->accumulator / clock->stepTime);
+	if (steps > clock->maxSteps)
+	{
+		// Too far behind to catch up, drop the backlog
+		steps = clock->maxSteps;
+		clock->accumulator = 0;
+	}
+	else
+	{
+		clock->accumulator -= steps * clock->stepTime;
+	}
+	clock->alpha = clock->accumulator / clock->stepTime;
+	return steps;
+}
+
+/** GameEngine_tickClock
+ * @brief Measures time since the last tick and advances clock by it
+ * 
+ * @param clock GameClock to tick
+ * @return uint32_t Number of simulation steps to run this frame
+ */
+uint32_t GameEngine_tickClock(GameClock* clock)
+{
+	uint64_t count = SDL_GetPerformanceCounter();
+	double frameTime = (double)(count - clock->lastCount) / (double)clock->frequency;
+	clock->lastCount = count;
+	return GameEngine_advanceClock(clock, frameTime);
+}
+
+/** GameEngine_initGovernor
+ * @brief Initializes a resolution governor at full resolution
+ * 
+ * @param governor ResolutionGovernor to initialize
+ * @param budget Target frame time in seconds
+ * @param minFraction Smallest render size as a fraction of the target,
+ *        clamped to [step, 1]
+ */
+void GameEngine_initGovernor(ResolutionGovernor* governor, double budget, double minFraction)
+{
+	governor->budget = budget;
+	governor->hysteresis = 0.1;
+	governor->smoothed = 0;
+	governor->fraction = 1;
+	governor->step = 0.125;
+	// At least one step, so the render size never reaches zero
+	governor->minFraction = minFraction < governor->step ? governor->step : minFraction < 1 ? minFraction : 1;
+	governor->holdFrames = 10;
+	governor->overFrames = 0;
+	governor->underFrames = 0;
+	governor->cooldown = 0;
+}
+
+/** GameEngine_updateGovernor
+ * @brief Feeds a measured frame time to the governor
+ * * Cost is assumed to scale with pixel count (fraction squared)
+ * when predicting whether the next step up fits
+ * @param governor ResolutionGovernor to update
+ * @param frameTime Render time of the last frame in seconds
+ * @return uint8_t 1 if fraction changed and the render size must be reapplied
+ */
+uint8_t GameEngine_updateGovernor(ResolutionGovernor* governor, double frameTime)
+{
+	// Exponential average, seeded by the first frame at a new size
+	governor->smoothed = governor->smoothed > 0 ? governor->smoothed * 0.9 + frameTime * 0.1 : frameTime;
+	if (governor->cooldown)
+	{
+		// Let caches and the average settle after a resize
+		governor->cooldown--;
+		return 0;
+	}
+	double upper = governor->budget * (1 + governor->hysteresis);
+	double lower = governor->budget * (1 - governor->hysteresis);
+	double nextUp = governor->fraction + governor->step;
+	double upCost = governor->smoothed * (nextUp * nextUp) / (governor->fraction * governor->fraction);
+	if (governor->smoothed > upper && governor->fraction > governor->minFraction)
+	{
+		governor->underFrames = 0;
+		governor->overFrames++;
+	}
+	else if (upCost < lower && governor->fraction < 1)
+	{
+		governor->overFrames = 0;
+		governor->underFrames++;
+	}
+	else
+	{
+		governor->overFrames = 0;
+		governor->underFrames = 0;
+		return 0;
+	}
+	// Climbing waits three times longer than dropping
+	if (governor->overFrames < governor->holdFrames && governor->underFrames < governor->holdFrames * 3)
+	{
+		return 0;
+	}
+	if (governor->overFrames)
+	{
+		governor->fraction -= governor->step;
+		governor->fraction = governor->fraction > governor->minFraction ? governor->fraction : governor->minFraction;
+	}
+	else
+	{
+		governor->fraction = nextUp < 1 ? nextUp : 1;
+	}
+	governor->overFrames = 0;
+	governor->underFrames = 0;
+	governor->smoothed = 0;
+	governor->cooldown = governor->holdFrames;
+	return 1;
+}
+
+/** GameEngine_governRenderSize
+ * @brief Scales a target render size by the governor's fraction
+ * * Scale is kept from target, the renderer stretches to the window
+ * @param governor ResolutionGovernor to read
+ * @param target Full render size
+ * @param render RenderConfig to write
+ */
+void GameEngine_governRenderSize(ResolutionGovernor* governor, RenderConfig* target, RenderConfig* render)
+{
+	render->width = (uint32_t)(target->width * governor->fraction + 0.5);
+	render->height = (uint32_t)(target->height * governor->fraction + 0.5);
+	render->width = render->width ? render->width : 1;
+	render->height = render->height ? render->height : 1;
+	render->scale = target->scale;
+}
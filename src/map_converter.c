@@ -0,0 +1,266 @@
+/**
+ * Converts map sources into binary map files (see
+ * include/mapfile.h).
+ *
+ * Text sources hold sections, one keyword per line:
+ *   border N          size of the wrap border (default 2)
+ *   tiles             followed by the tile grid
+ *   floor / ceiling   optional grids, same size as tiles
+ *   spawn TYPE X Y [H] [ANGLE] [PARAM]
+ *                     TYPE is player, entity or item
+ * Grid cells are one character: '.', ' ' or '0' for empty,
+ * '1'-'9' and 'a'-'z' for tiles 1-35. Lines starting with
+ * '#' are comments.
+ *
+ * PNG sources store one tile per pixel: red is the wall
+ * tile, green the floor tile and blue the ceiling tile.
+ *
+ * Usage: map_converter INPUT(.txt|.png) OUTPUT [--border N]
+ *
+ * @date 19/10/2026
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include "mapfile.h"
+
+#define LINE_SIZE 8192
+#define MAX_SPAWNS 4096
+
+enum SourceLayer {
+	SL_TILES,
+	SL_FLOOR,
+	SL_CEILING,
+	LEN_SL,
+	SL_NONE
+};
+
+typedef struct {
+	char* rows[LEN_SL][LINE_SIZE];
+	int numRows[LEN_SL];
+	int border;
+	MapSpawn spawns[MAX_SPAWNS];
+	uint32_t numSpawns;
+} MapSource;
+
+/** Convert_cellValue
+ * @brief Tile number of a grid character, -1 if invalid
+ */
+static int Convert_cellValue(char cell)
+{
+	if (cell == '.' || cell == ' ' || cell == '0')
+	{
+		return 0;
+	}
+	if (cell >= '1' && cell <= '9')
+	{
+		return cell - '0';
+	}
+	if (cell >= 'a' && cell <= 'z')
+	{
+		return cell - 'a' + 10;
+	}
+	return -1;
+}
+
+/** Convert_readText
+ * @brief Reads a text map source
+ * @return int 0 on success, -1 on error (printed)
+ */
+static int Convert_readText(const char* path, MapSource* source)
+{
+	FILE* textFile = fopen(path, "r");
+	if (!textFile)
+	{
+		fprintf(stderr, "ERROR: Could not open %s\n", path);
+		return -1;
+	}
+	char line[LINE_SIZE];
+	int section = SL_NONE;
+	int lineNum = 0;
+	while (fgets(line, LINE_SIZE, textFile))
+	{
+		lineNum++;
+		line[strcspn(line, "\r\n")] = 0;
+		char spawnType[16];
+		MapSpawn spawn;
+		memset(&spawn, 0, sizeof(spawn));
+		if (line[0] == '#' || (section == SL_NONE && line[0] == 0))
+		{
+			continue;
+		}
+		else if (!strcmp(line, "tiles"))
+		{
+			section = SL_TILES;
+		}
+		else if (!strcmp(line, "floor"))
+		{
+			section = SL_FLOOR;
+		}
+		else if (!strcmp(line, "ceiling"))
+		{
+			section = SL_CEILING;
+		}
+		else if (sscanf(line, "border %d", &source->border) == 1)
+		{
+			section = SL_NONE;
+		}
+		else if (sscanf(line, "spawn %15s %lf %lf %lf %lf %u", spawnType, &spawn.x, &spawn.y, &spawn.h, &spawn.angle, &spawn.param) >= 3)
+		{
+			section = SL_NONE;
+			if (!strcmp(spawnType, "player"))
+			{
+				spawn.type = MS_PLAYER;
+			}
+			else if (!strcmp(spawnType, "entity"))
+			{
+				spawn.type = MS_ENTITY;
+			}
+			else if (!strcmp(spawnType, "item"))
+			{
+				spawn.type = MS_ITEM;
+			}
+			else
+			{
+				fprintf(stderr, "ERROR: %s:%d: unknown spawn type %s\n", path, lineNum, spawnType);
+				fclose(textFile);
+				return -1;
+			}
+			if (source->numSpawns == MAX_SPAWNS)
+			{
+				fprintf(stderr, "ERROR: %s:%d: more than %d spawns\n", path, lineNum, MAX_SPAWNS);
+				fclose(textFile);
+				return -1;
+			}
+			source->spawns[source->numSpawns++] = spawn;
+		}
+		else if (section != SL_NONE && source->numRows[section] < LINE_SIZE)
+		{
+			for (char* cell = line; *cell; cell++)
+			{
+				if (Convert_cellValue(*cell) < 0)
+				{
+					fprintf(stderr, "ERROR: %s:%d: bad tile '%c'\n", path, lineNum, *cell);
+					fclose(textFile);
+					return -1;
+				}
+			}
+			source->rows[section][source->numRows[section]++] = strdup(line);
+		}
+		else
+		{
+			fprintf(stderr, "ERROR: %s:%d: unexpected line\n", path, lineNum);
+			fclose(textFile);
+			return -1;
+		}
+	}
+	fclose(textFile);
+	return 0;
+}
+
+/** Convert_buildLayer
+ * @brief Packs grid rows into a width*height layer, NULL if no rows
+ */
+static unsigned char* Convert_buildLayer(MapSource* source, int layer, int width, int height)
+{
+	if (!source->numRows[layer])
+	{
+		return NULL;
+	}
+	unsigned char* data = (unsigned char*)calloc(width * height, 1);
+	for (int y = 0; y < source->numRows[layer] && y < height; y++)
+	{
+		for (int x = 0; source->rows[layer][y][x] && x < width; x++)
+		{
+			data[y * width + x] = (unsigned char)Convert_cellValue(source->rows[layer][y][x]);
+		}
+	}
+	return data;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		fprintf(stderr, "Usage: %s INPUT(.txt|.png) OUTPUT [--border N]\n", argv[0]);
+		return -1;
+	}
+	MapSource* source = (MapSource*)calloc(1, sizeof(MapSource));
+	source->border = 2;
+	int borderArg = -1;
+	if (argc >= 5 && !strcmp(argv[3], "--border"))
+	{
+		borderArg = atoi(argv[4]);
+	}
+
+	Map map;
+	unsigned char* layers[LEN_SL] = {NULL, NULL, NULL};
+	int width = 0;
+	int height = 0;
+	size_t pathLen = strlen(argv[1]);
+	if (pathLen > 4 && !strcmp(argv[1] + pathLen - 4, ".png"))
+	{
+		int channels;
+		uint8_t* pixels = stbi_load(argv[1], &width, &height, &channels, 3);
+		if (!pixels)
+		{
+			fprintf(stderr, "ERROR: Could not load %s\n", argv[1]);
+			return -1;
+		}
+		uint8_t used[LEN_SL] = {0, 0, 0};
+		for (int l = 0; l < LEN_SL; l++)
+		{
+			layers[l] = (unsigned char*)malloc(width * height);
+			for (int i = 0; i < width * height; i++)
+			{
+				layers[l][i] = pixels[i * 3 + l];
+				used[l] |= layers[l][i] != 0;
+			}
+		}
+		// Drop floor/ceiling layers that are entirely empty
+		for (int l = SL_FLOOR; l < LEN_SL; l++)
+		{
+			if (!used[l])
+			{
+				free(layers[l]);
+				layers[l] = NULL;
+			}
+		}
+		stbi_image_free(pixels);
+	}
+	else
+	{
+		if (Convert_readText(argv[1], source))
+		{
+			return -1;
+		}
+		height = source->numRows[SL_TILES];
+		for (int y = 0; y < height; y++)
+		{
+			int rowLen = (int)strlen(source->rows[SL_TILES][y]);
+			width = rowLen > width ? rowLen : width;
+		}
+		if (!width || !height)
+		{
+			fprintf(stderr, "ERROR: %s has no tiles section\n", argv[1]);
+			return -1;
+		}
+		for (int l = 0; l < LEN_SL; l++)
+		{
+			layers[l] = Convert_buildLayer(source, l, width, height);
+		}
+	}
+	RayEngine_generateMap(&map, layers[SL_TILES], width, height, borderArg >= 0 ? borderArg : source->border, NULL, 0);
+	map.floorData = layers[SL_FLOOR];
+	map.ceilingData = layers[SL_CEILING];
+	if (MapFile_save(argv[2], &map, source->spawns, source->numSpawns))
+	{
+		fprintf(stderr, "ERROR: Could not write %s\n", argv[2]);
+		return -1;
+	}
+	printf("Wrote %dx%d map with %u spawns to %s\n", width, height, source->numSpawns, argv[2]);
+	return 0;
+}
@@ -0,0 +1,353 @@
+/**
+ * Loader and writer for binary map files. Files are
+ * mapped into memory (copy-on-write, so tile edits
+ * never reach the disk) and only the header and
+ * chunk directory are checked. Traversal bitmaps are
+ * stored in the file too, so loading never touches
+ * the tiles and load time stays flat for any map
+ * size. Windows builds read the file instead.
+ * 
+ * @date 19/10/2026
+ **/
+
+#include <string.h>
+#ifdef _WIN32
+#include <stdio.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "mapfile.h"
+
+#define MAP_FILE_ALIGN 8
+
+/** MapFile_align
+ * @brief Rounds a file offset up to the section alignment
+ */
+static uint64_t MapFile_align(uint64_t offset)
+{
+	return (offset + MAP_FILE_ALIGN - 1) & ~(uint64_t)(MAP_FILE_ALIGN - 1);
+}
+
+/** MapFile_checkSection
+ * @brief Checks a section lies inside the file and is aligned
+ * @return uint8_t 1 if usable, 0 otherwise
+ */
+static uint8_t MapFile_checkSection(uint64_t offset, uint64_t size, uint64_t fileSize)
+{
+	return offset % MAP_FILE_ALIGN == 0 && offset <= fileSize && size <= fileSize - offset;
+}
+
+/** MapFile_mapFile
+ * @brief Maps (or on Windows reads) a whole file into memory
+ * @return void* File contents, NULL on failure
+ */
+static void* MapFile_mapFile(const char* path, size_t* fileSize)
+{
+#ifdef _WIN32
+	FILE* mapFile = fopen(path, "rb");
+	if (!mapFile)
+	{
+		return NULL;
+	}
+	fseek(mapFile, 0, SEEK_END);
+	long size = ftell(mapFile);
+	fseek(mapFile, 0, SEEK_SET);
+	void* data = size > 0 ? malloc(size) : NULL;
+	if (!data || fread(data, 1, size, mapFile) != (size_t)size)
+	{
+		free(data);
+		fclose(mapFile);
+		return NULL;
+	}
+	fclose(mapFile);
+	*fileSize = (size_t)size;
+	return data;
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		return NULL;
+	}
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) || fileStat.st_size <= 0)
+	{
+		close(fd);
+		return NULL;
+	}
+	// Private writable mapping, pages are only copied if edited
+	void* data = mmap(NULL, (size_t)fileStat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+	{
+		return NULL;
+	}
+	*fileSize = (size_t)fileStat.st_size;
+	return data;
+#endif
+}
+
+static void MapFile_unmapFile(void* data, size_t fileSize)
+{
+#ifdef _WIN32
+	free(data);
+#else
+	munmap(data, fileSize);
+#endif
+}
+
+/** MapFile_load
+ * @brief Opens a binary map file for use in place
+ * * mapFile->map is ready to render, its layers point into the file
+ * @param path File path to load
+ * @return MapFile* Loaded map, NULL (with an error printed) if the
+ *         file is missing, truncated or the wrong version
+ */
+MapFile* MapFile_load(const char* path)
+{
+	size_t fileSize = 0;
+	uint8_t* fileData = (uint8_t*)MapFile_mapFile(path, &fileSize);
+	if (!fileData)
+	{
+		fprintf(stderr, "ERROR: Could not open map %s\n", path);
+		return NULL;
+	}
+	MapFileHeader* header = (MapFileHeader*)fileData;
+	uint8_t valid = fileSize >= sizeof(MapFileHeader) && !memcmp(header->magic, MAP_FILE_MAGIC, 4) && \
+		header->version == MAP_FILE_VERSION && header->headerSize == sizeof(MapFileHeader) && \
+		header->fileSize == fileSize;
+	uint64_t layerSize = valid ? (uint64_t)header->width * header->height : 0;
+	uint64_t numChunks = valid ? (uint64_t)header->chunksX * header->chunksY : 0;
+	uint64_t occupancySize = numChunks * sizeof(uint64_t);
+	uint64_t solidSize = numChunks * MAP_CHUNK_SIZE * sizeof(uint32_t);
+	valid = valid && header->chunksX == (header->width + MAP_CHUNK_MASK) >> MAP_CHUNK_SHIFT && \
+		header->chunksY == (header->height + MAP_CHUNK_MASK) >> MAP_CHUNK_SHIFT && \
+		MapFile_checkSection(header->chunkOffset, numChunks * sizeof(uint64_t), fileSize) && \
+		MapFile_checkSection(header->indexOffset, occupancySize + solidSize, fileSize) && \
+		(!header->floorOffset || MapFile_checkSection(header->floorOffset, layerSize, fileSize)) && \
+		(!header->ceilingOffset || MapFile_checkSection(header->ceilingOffset, layerSize, fileSize)) && \
+		MapFile_checkSection(header->spawnOffset, (uint64_t)header->numSpawns * sizeof(MapSpawn), fileSize);
+	uint64_t* directory = (uint64_t*)(fileData + (valid ? header->chunkOffset : 0));
+	for (uint64_t c = 0; valid && c < numChunks; c++)
+	{
+		valid = (directory[c] & MAP_FILE_UNIFORM) || \
+			MapFile_checkSection(directory[c], sizeof(MapTile) * MAP_CHUNK_TILES, fileSize);
+	}
+	if (!valid)
+	{
+		fprintf(stderr, "ERROR: %s is not a version %d map file (rebuild it with map_converter)\n", path, MAP_FILE_VERSION);
+		MapFile_unmapFile(fileData, fileSize);
+		return NULL;
+	}
+	MapFile* mapFile = (MapFile*)malloc(sizeof(MapFile));
+	mapFile->header = header;
+	mapFile->fileData = fileData;
+	mapFile->fileSize = fileSize;
+	mapFile->spawns = (MapSpawn*)(fileData + header->spawnOffset);
+	mapFile->numSpawns = header->numSpawns;
+	Map* map = &mapFile->map;
+	RayEngine_initMap(map, header->width, header->height, header->border);
+	for (uint64_t c = 0; c < numChunks; c++)
+	{
+		if (directory[c] & MAP_FILE_UNIFORM)
+		{
+			MapTile tile = (MapTile)(directory[c] & 0xFFFF);
+			map->chunks[c] = RayEngine_getFillChunk(map, tile);
+			if (!map->chunks[c])
+			{
+				// Out of shared fills, give it its own copy
+				map->chunks[c] = (MapTile*)malloc(sizeof(MapTile) * MAP_CHUNK_TILES);
+				for (uint32_t t = 0; t < MAP_CHUNK_TILES; t++)
+				{
+					map->chunks[c][t] = tile;
+				}
+				map->chunkFlags[c] = MCF_LOADED | MCF_OWNED | MCF_WRITABLE;
+			}
+		}
+		else
+		{
+			// Private mapping, so edits stay in memory
+			map->chunks[c] = (MapTile*)(fileData + directory[c]);
+			map->chunkFlags[c] = MCF_LOADED | MCF_WRITABLE;
+		}
+	}
+	// Traversal bitmaps are used in place like the tiles (see
+	// MapFile_del), every tile counts as translucent until
+	// RayEngine_setTileTranslucency
+	free(map->occupancy);
+	free(map->solidBits);
+	map->occupancy = (uint64_t*)(fileData + header->indexOffset);
+	map->solidBits = (uint32_t*)(fileData + header->indexOffset + occupancySize);
+	memcpy(map->alphaBits, map->solidBits, solidSize);
+	map->floorData = header->floorOffset ? fileData + header->floorOffset : NULL;
+	map->ceilingData = header->ceilingOffset ? fileData + header->ceilingOffset : NULL;
+	return mapFile;
+}
+
+/** MapFile_del
+ * @brief Closes a map file
+ * ! Its Map (and any pointers into it) becomes invalid
+ * @param mapFile MapFile to close
+ */
+void MapFile_del(MapFile* mapFile)
+{
+	// Bitmaps live in the file, not on the heap
+	mapFile->map.occupancy = NULL;
+	mapFile->map.solidBits = NULL;
+	RayEngine_delMap(&mapFile->map);
+	MapFile_unmapFile(mapFile->fileData, mapFile->fileSize);
+	free(mapFile);
+}
+
+/** MapFile_uniformTile
+ * @brief Checks whether a chunk holds a single tile
+ * @return uint8_t 1 if uniform (tile set to it), 0 otherwise
+ */
+static uint8_t MapFile_uniformTile(Map* map, uint32_t c, MapTile* tile)
+{
+	MapTile* chunk = map->chunks[c];
+	for (uint32_t t = 1; t < MAP_CHUNK_TILES; t++)
+	{
+		if (chunk[t] != chunk[0])
+		{
+			return 0;
+		}
+	}
+	*tile = chunk[0];
+	return 1;
+}
+
+/** MapFile_save
+ * @brief Writes a map (with its floor/ceiling layers) and spawn table
+ * * Unloaded chunks of streamed maps are saved as empty
+ * @param path File path to write to
+ * @param map Map to save, floorData/ceilingData may be NULL
+ * @param spawns Spawn table (may be NULL if numSpawns is 0)
+ * @param numSpawns Number of spawns
+ * @return int 0 on success, -1 if the file could not be written
+ */
+int MapFile_save(const char* path, Map* map, MapSpawn* spawns, uint32_t numSpawns)
+{
+	uint64_t layerSize = (uint64_t)map->width * map->height;
+	uint32_t numChunks = map->chunksX * map->chunksY;
+	uint64_t chunkSize = sizeof(MapTile) * MAP_CHUNK_TILES;
+	MapFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MAP_FILE_MAGIC, 4);
+	header.version = MAP_FILE_VERSION;
+	header.headerSize = sizeof(MapFileHeader);
+	header.width = map->width;
+	header.height = map->height;
+	header.border = map->border;
+	header.numSpawns = numSpawns;
+	header.chunksX = map->chunksX;
+	header.chunksY = map->chunksY;
+	header.chunkOffset = MapFile_align(sizeof(MapFileHeader));
+	header.indexOffset = header.chunkOffset + sizeof(uint64_t) * numChunks;
+	uint64_t occupancySize = sizeof(uint64_t) * numChunks;
+	uint64_t solidSize = sizeof(uint32_t) * MAP_CHUNK_SIZE * numChunks;
+	// Chunk data follows the index in directory order
+	uint64_t* directory = (uint64_t*)malloc(sizeof(uint64_t) * numChunks);
+	uint64_t offset = MapFile_align(header.indexOffset + occupancySize + solidSize);
+	for (uint32_t c = 0; c < numChunks; c++)
+	{
+		MapTile tile = 0;
+		if (!(map->chunkFlags[c] & MCF_LOADED) || MapFile_uniformTile(map, c, &tile))
+		{
+			directory[c] = MAP_FILE_UNIFORM | tile;
+		}
+		else
+		{
+			directory[c] = offset;
+			offset += chunkSize;
+		}
+	}
+	if (map->floorData)
+	{
+		header.floorOffset = offset;
+		offset = MapFile_align(offset + layerSize);
+	}
+	if (map->ceilingData)
+	{
+		header.ceilingOffset = offset;
+		offset = MapFile_align(offset + layerSize);
+	}
+	header.spawnOffset = offset;
+	header.fileSize = offset + (uint64_t)numSpawns * sizeof(MapSpawn);
+
+	FILE* mapFile = fopen(path, "wb");
+	if (!mapFile)
+	{
+		free(directory);
+		return -1;
+	}
+	const uint8_t padding[MAP_FILE_ALIGN] = {0};
+	uint64_t written = header.indexOffset + occupancySize + solidSize;
+	// Unloaded chunks already have empty bitmaps, see RayEngine_evictChunk
+	int status = fwrite(&header, sizeof(MapFileHeader), 1, mapFile) == 1 && \
+		fwrite(padding, 1, header.chunkOffset - sizeof(MapFileHeader), mapFile) == header.chunkOffset - sizeof(MapFileHeader) && \
+		fwrite(directory, sizeof(uint64_t), numChunks, mapFile) == numChunks && \
+		fwrite(map->occupancy, 1, occupancySize, mapFile) == occupancySize && \
+		fwrite(map->solidBits, 1, solidSize, mapFile) == solidSize ? 0 : -1;
+	for (uint32_t c = 0; c < numChunks && !status; c++)
+	{
+		if (directory[c] & MAP_FILE_UNIFORM)
+		{
+			continue;
+		}
+		if (fwrite(padding, 1, directory[c] - written, mapFile) != directory[c] - written || \
+			fwrite(map->chunks[c], 1, chunkSize, mapFile) != chunkSize)
+		{
+			status = -1;
+		}
+		written = directory[c] + chunkSize;
+	}
+	// Remaining sections in file order, padding written as zeros
+	uint8_t* sections[3] = {map->floorData, map->ceilingData, (uint8_t*)spawns};
+	uint64_t offsets[3] = {header.floorOffset, header.ceilingOffset, header.spawnOffset};
+	uint64_t sizes[3] = {layerSize, layerSize, (uint64_t)numSpawns * sizeof(MapSpawn)};
+	for (int s = 0; s < 3 && !status; s++)
+	{
+		if (!sections[s] || !sizes[s])
+		{
+			continue;
+		}
+		if (fwrite(padding, 1, offsets[s] - written, mapFile) != offsets[s] - written || \
+			fwrite(sections[s], 1, sizes[s], mapFile) != sizes[s])
+		{
+			status = -1;
+		}
+		written = offsets[s] + sizes[s];
+	}
+	if (!status && fwrite(padding, 1, header.fileSize - written, mapFile) != header.fileSize - written)
+	{
+		status = -1;
+	}
+	free(directory);
+	if (fclose(mapFile))
+	{
+		status = -1;
+	}
+	return status;
+}
+
+/** MapFile_findSpawn
+ * @brief Finds the first spawn of a type
+ * 
+ * @param mapFile MapFile to search
+ * @param type MapSpawnType to find
+ * @return MapSpawn* Spawn, NULL if the map has none of that type
+ */
+MapSpawn* MapFile_findSpawn(MapFile* mapFile, uint32_t type)
+{
+	for (uint32_t s = 0; s < mapFile->numSpawns; s++)
+	{
+		if (mapFile->spawns[s].type == type)
+		{
+			return &mapFile->spawns[s];
+		}
+	}
+	return NULL;
+}
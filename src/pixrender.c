@@ -40,6 +40,24 @@ void PixBuffer_delPixBuffer(PixBuffer* buffer)
     free(buffer);
 }
 
+/** PixBuffer_resizePixBuffer
+ * @brief Reallocates a PixBuffer for a new size
+ * ! Contents are undefined afterwards, redraw them
+ * @param buffer PixBuffer to resize
+ * @param width New width in pixels
+ * @param height New height in pixels
+ */
+void PixBuffer_resizePixBuffer(PixBuffer* buffer, uint32_t width, uint32_t height)
+{
+    if (width * height != buffer->width * buffer->height)
+    {
+        free(buffer->pixels);
+        buffer->pixels = (uint32_t*)malloc(sizeof(uint32_t)*width*height);
+    }
+    buffer->width = width;
+    buffer->height = height;
+}
+
 /** PixBuffer_drawColumn
  * @brief Draws a column to a pixel buffer
  * Note: drawColumn <b>does not</b> check x bound
@@ -634,6 +652,76 @@ void PixBuffer_drawPixDouble(PixBuffer* buffer, double x, double y, uint32_t col
     //PixBuffer_drawPixAlpha(buffer, baseX, baseY, color, alphaNum);
 }
 
+/** PixBuffer_writePPM
+ * @brief Saves buffer contents as a binary PPM (P6) image
+ * * Alpha channel is dropped
+ * @param buffer PixBuffer to save
+ * @param path File path to write to
+ * @return int 0 on success, -1 if the file could not be written
+ **/
+int PixBuffer_writePPM(PixBuffer* buffer, const char* path)
+{
+    FILE* imgFile = fopen(path, "wb");
+    if (!imgFile)
+    {
+        return -1;
+    }
+    fprintf(imgFile, "P6\n%u %u\n255\n", buffer->width, buffer->height);
+    uint8_t* row = (uint8_t*)malloc(buffer->width * 3);
+    for (uint32_t y = 0; y < buffer->height; y++)
+    {
+        for (uint32_t x = 0; x < buffer->width; x++)
+        {
+            uint32_t pix = buffer->pixels[y*buffer->width+x];
+            row[x*3] = (uint8_t)(pix >> 3*8);
+            row[x*3+1] = (uint8_t)((pix >> 2*8) & 0xFF);
+            row[x*3+2] = (uint8_t)((pix >> 8) & 0xFF);
+        }
+        fwrite(row, 3, buffer->width, imgFile);
+    }
+    free(row);
+    return fclose(imgFile) ? -1 : 0;
+}
+
+/** PixBuffer_readPPM
+ * @brief Loads a binary PPM (P6, 8 bit) written by PixBuffer_writePPM
+ * * Pixels come back fully opaque
+ * @param path File path to read
+ * @return PixBuffer* New buffer, NULL if missing or not a P6 image
+ **/
+PixBuffer* PixBuffer_readPPM(const char* path)
+{
+    FILE* imgFile = fopen(path, "rb");
+    if (!imgFile)
+    {
+        return NULL;
+    }
+    uint32_t width, height, maxVal;
+    if (fscanf(imgFile, "P6 %u %u %u", &width, &height, &maxVal) != 3 || maxVal != 255 || fgetc(imgFile) == EOF)
+    {
+        fclose(imgFile);
+        return NULL;
+    }
+    PixBuffer* buffer = PixBuffer_initPixBuffer(width, height);
+    uint8_t* row = (uint8_t*)malloc(width * 3);
+    for (uint32_t y = 0; y < height; y++)
+    {
+        if (fread(row, 3, width, imgFile) != width)
+        {
+            PixBuffer_delPixBuffer(buffer);
+            buffer = NULL;
+            break;
+        }
+        for (uint32_t x = 0; x < width; x++)
+        {
+            buffer->pixels[y*width+x] = PixBuffer_toPixColor(row[x*3], row[x*3+1], row[x*3+2], 255);
+        }
+    }
+    free(row);
+    fclose(imgFile);
+    return buffer;
+}
+
 // RAYTEX FUNCTIONS
 RayTex* RayTex_initFromRGBA(uint8_t* rgbaData, uint32_t tileWidth, uint32_t tileHeight, uint8_t numTiles)
 {
@@ -0,0 +1,208 @@
+/**
+ * Lightweight frame profiler. Stages are timed with
+ * the performance counter into a ring buffer per
+ * thread, summed into per-frame totals for the
+ * overlay, and can be dumped as a Chrome trace
+ * (chrome://tracing or ui.perfetto.dev).
+ * 
+ * Everything here is compiled out unless RAY_PROFILE
+ * is defined (see Makefile profile targets).
+ * 
+ * @date 19/10/2026
+ **/
+
+#include "profiler.h"
+
+#ifdef RAY_PROFILE
+
+static const char* stageNames[LEN_PS] = {
+	"frame", "sim", "reset", "floor", "walls",
+	"sprites", "composite", "post", "upload", "present"
+};
+
+static const SDL_Color stageColors[LEN_PS] = {
+	{255, 255, 255, 255},
+	{255, 220, 0, 255},
+	{120, 120, 120, 255},
+	{0, 200, 80, 255},
+	{220, 50, 50, 255},
+	{255, 120, 200, 255},
+	{80, 120, 255, 255},
+	{170, 80, 255, 255},
+	{0, 220, 220, 255},
+	{255, 140, 0, 255}
+};
+
+static ProfileRing* rings[PROFILE_MAX_THREADS];
+static uint32_t numRings = 0;
+static __thread ProfileRing* localRing = NULL;
+static __thread uint8_t localRingFull = 0;
+
+static uint64_t frameTotals[LEN_PS];
+static double history[LEN_PS][PROFILE_HISTORY];
+static uint32_t historyHead = 0;
+static uint32_t historyCount = 0;
+
+/** Profiler_getRing
+ * @brief Finds (or registers) the calling thread's ring buffer
+ * 
+ * @return ProfileRing* Ring for this thread, NULL if too many threads
+ */
+static ProfileRing* Profiler_getRing(void)
+{
+	if (!localRing && !localRingFull)
+	{
+		uint32_t id = __atomic_fetch_add(&numRings, 1, __ATOMIC_ACQ_REL);
+		if (id >= PROFILE_MAX_THREADS)
+		{
+			localRingFull = 1;
+			return NULL;
+		}
+		localRing = (ProfileRing*)calloc(1, sizeof(ProfileRing));
+		localRing->threadId = id;
+		__atomic_store_n(&rings[id], localRing, __ATOMIC_RELEASE);
+	}
+	return localRing;
+}
+
+/** Profiler_record
+ * @brief Logs one timed stage (use PROFILE_BEGIN/PROFILE_END instead)
+ * 
+ * @param stage ProfileStage being timed
+ * @param start Performance counter at stage start
+ * @param end Performance counter at stage end
+ */
+void Profiler_record(uint8_t stage, uint64_t start, uint64_t end)
+{
+	ProfileRing* ring = Profiler_getRing();
+	if (ring)
+	{
+		ProfileEvent* event = &ring->events[ring->head];
+		event->stage = stage;
+		event->start = start;
+		event->end = end;
+		ring->head = (ring->head + 1) % PROFILE_RING_SIZE;
+		if (ring->count < PROFILE_RING_SIZE)
+		{
+			ring->count++;
+		}
+	}
+	__atomic_fetch_add(&frameTotals[stage], end - start, __ATOMIC_RELAXED);
+}
+
+/** Profiler_endFrame
+ * @brief Moves this frame's stage totals into the rolling history
+ */
+void Profiler_endFrame(void)
+{
+	double msPerTick = 1000.0 / (double)SDL_GetPerformanceFrequency();
+	for (int s = 0; s < LEN_PS; s++)
+	{
+		history[s][historyHead] = msPerTick * (double)__atomic_exchange_n(&frameTotals[s], 0, __ATOMIC_RELAXED);
+	}
+	historyHead = (historyHead + 1) % PROFILE_HISTORY;
+	if (historyCount < PROFILE_HISTORY)
+	{
+		historyCount++;
+	}
+}
+
+/** Profiler_getAverage
+ * @brief Rolling average time spent in a stage per frame
+ * 
+ * @param stage ProfileStage to average
+ * @return double Average milliseconds over the last PROFILE_HISTORY frames
+ */
+double Profiler_getAverage(uint8_t stage)
+{
+	double sum = 0;
+	for (uint32_t i = 0; i < historyCount; i++)
+	{
+		sum += history[stage][i];
+	}
+	return historyCount ? sum / historyCount : 0;
+}
+
+/** Profiler_drawOverlay
+ * @brief Draws rolling stage averages as bars in the top-left corner
+ * * One bar per stage, full buffer width is 33.3ms with
+ * * tick marks every 16.7ms (60Hz frame budget)
+ * @param buffer PixBuffer to draw over
+ */
+void Profiler_drawOverlay(PixBuffer* buffer)
+{
+	const int32_t barHeight = 3;
+	double pxPerMs = (double)buffer->width / 33.3;
+	SDL_Rect backRect = {0, 0, buffer->width, LEN_PS * barHeight + 2};
+	SDL_Color backColor = {0, 0, 0, 255};
+	SDL_Color tickColor = {255, 255, 255, 255};
+	PixBuffer_drawRect(buffer, &backRect, backColor);
+	for (int s = 0; s < LEN_PS; s++)
+	{
+		SDL_Rect bar = {0, 1 + s * barHeight, (int)(Profiler_getAverage(s) * pxPerMs), barHeight - 1};
+		if (bar.w > (int)buffer->width)
+		{
+			bar.w = buffer->width;
+		}
+		PixBuffer_drawRect(buffer, &bar, stageColors[s]);
+	}
+	for (double ms = 16.7; ms < 33.3; ms += 16.7)
+	{
+		SDL_Rect tick = {(int)(ms * pxPerMs), 0, 1, backRect.h};
+		PixBuffer_drawRect(buffer, &tick, tickColor);
+	}
+}
+
+/** Profiler_writeTrace
+ * @brief Exports buffered events as Chrome trace-event JSON
+ * ! Call while no other thread is recording
+ * @param path File path to write to
+ * @return int 0 on success, -1 if the file could not be written
+ */
+int Profiler_writeTrace(const char* path)
+{
+	FILE* traceFile = fopen(path, "w");
+	if (!traceFile)
+	{
+		return -1;
+	}
+	double usPerTick = 1000000.0 / (double)SDL_GetPerformanceFrequency();
+	uint32_t ringTotal = numRings < PROFILE_MAX_THREADS ? numRings : PROFILE_MAX_THREADS;
+	// Timestamps relative to the oldest buffered event
+	uint64_t base = UINT64_MAX;
+	for (uint32_t r = 0; r < ringTotal; r++)
+	{
+		ProfileRing* ring = __atomic_load_n(&rings[r], __ATOMIC_ACQUIRE);
+		for (uint32_t e = 0; ring && e < ring->count; e++)
+		{
+			if (ring->events[e].start < base)
+			{
+				base = ring->events[e].start;
+			}
+		}
+	}
+	fprintf(traceFile, "{\"traceEvents\": [");
+	uint8_t first = 1;
+	for (uint32_t r = 0; r < ringTotal; r++)
+	{
+		ProfileRing* ring = __atomic_load_n(&rings[r], __ATOMIC_ACQUIRE);
+		if (!ring)
+		{
+			continue;
+		}
+		// Oldest first
+		uint32_t start = (ring->head + PROFILE_RING_SIZE - ring->count) % PROFILE_RING_SIZE;
+		for (uint32_t e = 0; e < ring->count; e++)
+		{
+			ProfileEvent* event = &ring->events[(start + e) % PROFILE_RING_SIZE];
+			fprintf(traceFile, "%s\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}",
+				first ? "" : ",", stageNames[event->stage], ring->threadId,
+				(double)(event->start - base) * usPerTick, (double)(event->end - event->start) * usPerTick);
+			first = 0;
+		}
+	}
+	fprintf(traceFile, "\n]}\n");
+	return fclose(traceFile) ? -1 : 0;
+}
+
+#endif//RAY_PROFILE
@@ -8,12 +8,12 @@
  * @date 11/1/2019
  **/
 
+#include <string.h>
 #include "rayengine.h"
 
 const static SDL_Color FOG_COLOR = {50,20,50,255};//{50,50,80,255}//{77,150,154,255}
 
 const uint8_t* keys;
-double getInterDist(double dx, double dy, double xi, double yi, double coordX, double coordY, double* newX, double* newY, uint8_t* side);
 
 /** RayEngine_initDepthBuffer
  * @brief Initializes a new RayEngine depth buffer
@@ -29,6 +29,10 @@ DepthBuffer* RayEngine_initDepthBuffer(uint32_t width, uint32_t height)
 	newBuffer->alphaBuffer = PixBuffer_initPixBuffer(width, height);
 	newBuffer->pixelDepth = (double*)malloc(sizeof(double) * width * height);
 	newBuffer->alphaDepth = (double*)malloc(sizeof(double) * width * height);
+	newBuffer->stats = NULL;
+	newBuffer->gbuffer = NULL;
+	newBuffer->spans = NULL;
+	newBuffer->kbuffer = NULL;
 	return newBuffer;
 }
 
@@ -70,6 +74,65 @@ void RayEngine_setDepth(DepthBuffer* buffer, uint32_t x, uint32_t y, uint8_t lay
 	
 }
 
+/** RayEngine_storeFragment
+ * @brief Keeps a translucent pixel in the KBuffer, near to far
+ * * A full pixel swaps its furthest fragment out for a nearer one
+ * @param buffer DepthBuffer with a KBuffer attached
+ * @param index Pixel index
+ * @param color Color, alpha scaled. Set to the fragment left over
+ * @param depth Depth of pixel. Set to the fragment left over
+ * @return uint8_t 1 if color/depth still need the alpha layer, 0 if not
+ */
+static uint8_t RayEngine_storeFragment(DepthBuffer* buffer, uint32_t index, uint32_t* color, double* depth)
+{
+	KBuffer* kbuffer = buffer->kbuffer;
+	if (*depth >= buffer->pixelDepth[index])
+	{
+		return 0;
+	}
+	KBufferFragment fragment = {*depth, *color, KBUFFER_NONE};
+	uint8_t spilled = 0;
+	uint32_t slot;
+	if (kbuffer->counts[index] < kbuffer->layers)
+	{
+		slot = __atomic_fetch_add(&kbuffer->numFragments, 1, __ATOMIC_RELAXED);
+		if (slot >= kbuffer->capacity)
+		{
+			__atomic_fetch_add(&kbuffer->numOverflow, 1, __ATOMIC_RELAXED);
+			return 1;
+		}
+		kbuffer->counts[index]++;
+	}
+	else
+	{
+		// Full, the furthest fragment makes way unless this one is further still
+		uint32_t* link = &kbuffer->heads[index];
+		while (kbuffer->fragments[*link].next != KBUFFER_NONE)
+		{
+			link = &kbuffer->fragments[*link].next;
+		}
+		__atomic_fetch_add(&kbuffer->numOverflow, 1, __ATOMIC_RELAXED);
+		slot = *link;
+		if (*depth >= kbuffer->fragments[slot].depth)
+		{
+			return 1;
+		}
+		*link = KBUFFER_NONE;
+		*color = kbuffer->fragments[slot].color;
+		*depth = kbuffer->fragments[slot].depth;
+		spilled = 1;
+	}
+	uint32_t* insert = &kbuffer->heads[index];
+	while (*insert != KBUFFER_NONE && kbuffer->fragments[*insert].depth <= fragment.depth)
+	{
+		insert = &kbuffer->fragments[*insert].next;
+	}
+	fragment.next = *insert;
+	kbuffer->fragments[slot] = fragment;
+	*insert = slot;
+	return spilled;
+}
+
 /** RayEngine_drawPix
  * @brief 
  * 
@@ -87,6 +150,21 @@ void RayEngine_drawPix(DepthBuffer* buffer, uint32_t x, uint32_t y, uint32_t col
 		// Keep pixel in alpha layer
 		if (alphaNum < 1 || (color & 0xff) < 255)
 		{
+			RAY_STAT_ADD(buffer->stats, alphaPix, 1);
+			RAY_STAT_ADD(buffer->stats, pixWritten, 1);
+			RAY_STAT_ADD(buffer->stats, pixWrites[buffer->pixelBuffer->width * y + x], 1);
+			if (buffer->kbuffer)
+			{
+				// Alpha goes into the fragment's color, see KBuffer
+				SDL_Color fragmentColor = PixBuffer_toSDLColor(color);
+				fragmentColor.a *= alphaNum;
+				color = PixBuffer_toPixColor(fragmentColor.r, fragmentColor.g, fragmentColor.b, fragmentColor.a);
+				alphaNum = 1.0;
+				if (!RayEngine_storeFragment(buffer, buffer->pixelBuffer->width * y + x, &color, &depth))
+				{
+					return;
+				}
+			}
 			// If new alpha in front
 			double pixDepth = RayEngine_getDepth(buffer, x, y, BL_ALPHA);
 			if (pixDepth > depth)
@@ -116,6 +194,17 @@ void RayEngine_drawPix(DepthBuffer* buffer, uint32_t x, uint32_t y, uint32_t col
 			{
 				RayEngine_setDepth(buffer, x, y, BL_BASE, depth);
 				PixBuffer_drawPix(buffer->pixelBuffer, x, y, color);
+				if (buffer->gbuffer)
+				{
+					// Already shaded, keep the shading pass off it
+					buffer->gbuffer->pixels[buffer->pixelBuffer->width * y + x].material = 0;
+				}
+				RAY_STAT_ADD(buffer->stats, pixWritten, 1);
+				RAY_STAT_ADD(buffer->stats, pixWrites[buffer->pixelBuffer->width * y + x], 1);
+			}
+			else
+			{
+				RAY_STAT_ADD(buffer->stats, pixRejected, 1);
 			}
 		}
 	}
@@ -138,6 +227,91 @@ uint32_t RayEngine_pixGradientShader(uint32_t pixel, double percent, SDL_Color t
 	return PixBuffer_toPixColor(r,g,b,a);
 }
 
+/** RayEngine_getMaterial
+ * @brief Finds or registers a texture's GBuffer material id
+ * * Safe to call from several threads at once
+ * @param gbuffer GBuffer to look in
+ * @param texture Texture of the material
+ * @return uint8_t Material id, 0 if the material table is full
+ */
+static uint8_t RayEngine_getMaterial(GBuffer* gbuffer, RayTex* texture)
+{
+	uint32_t numMaterials = __atomic_load_n(&gbuffer->numMaterials, __ATOMIC_ACQUIRE);
+	for (uint32_t m = 1; m <= numMaterials; m++)
+	{
+		if (gbuffer->materials[m] == texture)
+		{
+			return (uint8_t)m;
+		}
+	}
+	uint8_t material = 0;
+	#pragma omp critical(gbufferMaterial)
+	{
+		numMaterials = gbuffer->numMaterials;
+		for (uint32_t m = 1; m <= numMaterials && !material; m++)
+		{
+			material = gbuffer->materials[m] == texture ? (uint8_t)m : 0;
+		}
+		if (!material && numMaterials < GBUFFER_MAX_MATERIALS)
+		{
+			material = (uint8_t)(numMaterials + 1);
+			gbuffer->materials[material] = texture;
+			__atomic_store_n(&gbuffer->numMaterials, material, __ATOMIC_RELEASE);
+		}
+	}
+	return material;
+}
+
+/** RayEngine_deferPix
+ * @brief Depth tests an opaque pixel and stores it in the GBuffer
+ * 
+ * @param buffer DepthBuffer with a GBuffer attached
+ * @param x x coordinate of pixel
+ * @param y y coordinate of pixel
+ * @param depth Depth of pixel
+ * @param texel GBufferPixel to store
+ */
+static inline void RayEngine_deferPix(DepthBuffer* buffer, uint32_t x, uint32_t y, double depth, GBufferPixel texel)
+{
+	uint32_t index = buffer->pixelBuffer->width * y + x;
+	if (buffer->pixelDepth[index] > depth)
+	{
+		buffer->pixelDepth[index] = depth;
+		buffer->gbuffer->pixels[index] = texel;
+		RAY_STAT_ADD(buffer->stats, pixWritten, 1);
+		RAY_STAT_ADD(buffer->stats, pixWrites[index], 1);
+	}
+	else
+	{
+		RAY_STAT_ADD(buffer->stats, pixRejected, 1);
+	}
+}
+
+/** RayEngine_paintPix
+ * @brief Draws a pixel over what is already there, without depth
+ * * For span clipping, where everything arrives back to front
+ * @param buffer DepthBuffer to draw to
+ * @param x x coordinate of pixel
+ * @param y y coordinate of pixel
+ * @param color Shaded pixel color
+ * @param alphaNum Opacity of the pixel (0-1)
+ */
+static inline void RayEngine_paintPix(DepthBuffer* buffer, uint32_t x, uint32_t y, uint32_t color, double alphaNum)
+{
+	uint32_t index = buffer->pixelBuffer->width * y + x;
+	RAY_STAT_ADD(buffer->stats, pixWritten, 1);
+	RAY_STAT_ADD(buffer->stats, pixWrites[index], 1);
+	if (alphaNum < 1 || (color & 0xff) < 255)
+	{
+		RAY_STAT_ADD(buffer->stats, alphaPix, 1);
+		PixBuffer_drawPixAlpha(buffer->pixelBuffer, x, y, color, alphaNum);
+	}
+	else
+	{
+		buffer->pixelBuffer->pixels[index] = color;
+	}
+}
+
 void RayEngine_drawTexColumn(DepthBuffer* buffer, uint32_t x, int32_t y,
  							 int32_t h, double depth, RayTex* texture,
 							 uint8_t tileNum, double alphaNum, 
@@ -160,22 +334,99 @@ void RayEngine_drawTexColumn(DepthBuffer* buffer, uint32_t x, int32_t y,
     {
         h = buffer->pixelBuffer->height - y;
     }
+	// Opaque texels are only stored when deferred, see GBuffer
+	RaySpans* spans = buffer->spans;
+	GBufferPixel texel = {(float)fadePercent, (uint16_t)column, 0, 0, tileNum};
+	if (buffer->gbuffer && !spans && alphaNum >= 1)
+	{
+		texel.material = RayEngine_getMaterial(buffer->gbuffer, texture);
+	}
+	// Rows hidden behind this column's wall, see RaySpans
+	int32_t clipTop = 0;
+	int32_t clipBottom = 0;
+	if (spans && depth > spans->depth[x])
+	{
+		clipTop = spans->top[x];
+		clipBottom = spans->bottom[x];
+	}
 
     for (int32_t i = 0; i < h; i++)
     {
+		if (i + y >= clipTop && i + y < clipBottom)
+		{
+			i = clipBottom - y - 1;
+			continue;
+		}
         // Calculate pixel to draw from texture
+		uint32_t row = (uint32_t)floor(((double)(offY + i)/(double)offH) * (texture->tileHeight));
         uint32_t pix = texture->pixData[\
 			tileNum*texture->tileWidth*texture->tileHeight + \
-			(uint32_t)floor(((double)(offY + i)/(double)offH) * \
-			(texture->tileHeight)) * texture->tileWidth + column];
-		if (pix & 0xFF)
+			row * texture->tileWidth + column];
+		if (texel.material && (pix & 0xFF) == 0xFF)
+		{
+			texel.v = (uint16_t)row;
+			RayEngine_deferPix(buffer, x, i+y, depth, texel);
+		}
+		else if (pix & 0xFF)
 		{
 			pix = RayEngine_pixGradientShader(pix, fadePercent, targetColor);
-			RayEngine_drawPix(buffer, x, i+y, pix, alphaNum, depth);
+			if (spans)
+			{
+				RayEngine_paintPix(buffer, x, i+y, pix, alphaNum);
+			}
+			else
+			{
+				RayEngine_drawPix(buffer, x, i+y, pix, alphaNum, depth);
+			}
     	}
 	}
 }
 
+/** RayEngine_resolveKBuffer
+ * @brief Blends each pixel's KBuffer fragments and alpha layer far to near
+ * 
+ * @param buffer DepthBuffer with a KBuffer attached
+ */
+static void RayEngine_resolveKBuffer(DepthBuffer* buffer)
+{
+	KBuffer* kbuffer = buffer->kbuffer;
+	uint32_t width = kbuffer->width;
+	uint32_t height = kbuffer->height;
+	#pragma omp parallel for schedule(dynamic,8)
+	for (int y = 0; y < height; y++)
+	{
+		KBufferFragment sorted[KBUFFER_MAX_LAYERS + 1];
+		for (uint32_t x = 0; x < width; x++)
+		{
+			uint32_t index = x + y * width;
+			double baseDepth = buffer->pixelDepth[index];
+			double alphaDepth = buffer->alphaDepth[index];
+			uint8_t spilled = alphaDepth < baseDepth;
+			uint32_t numSorted = 0;
+			// Near to far, with whatever spilled to the alpha layer in its place
+			for (uint32_t f = kbuffer->heads[index]; f != KBUFFER_NONE && kbuffer->fragments[f].depth < baseDepth; f = kbuffer->fragments[f].next)
+			{
+				if (spilled && alphaDepth < kbuffer->fragments[f].depth)
+				{
+					KBufferFragment alpha = {alphaDepth, buffer->alphaBuffer->pixels[index], KBUFFER_NONE};
+					sorted[numSorted++] = alpha;
+					spilled = 0;
+				}
+				sorted[numSorted++] = kbuffer->fragments[f];
+			}
+			if (spilled)
+			{
+				KBufferFragment alpha = {alphaDepth, buffer->alphaBuffer->pixels[index], KBUFFER_NONE};
+				sorted[numSorted++] = alpha;
+			}
+			for (int32_t f = (int32_t)numSorted - 1; f >= 0; f--)
+			{
+				PixBuffer_drawPixAlpha(buffer->pixelBuffer, x, y, sorted[f].color, 1.0);
+			}
+		}
+	}
+}
+
 /** RayEngine_renderBuffer
  * @brief Merges opaque and alpha layers of buffer for rendering
  * 
@@ -183,6 +434,16 @@ void RayEngine_drawTexColumn(DepthBuffer* buffer, uint32_t x, int32_t y,
  */
 void RayEngine_renderBuffer(DepthBuffer* buffer)
 {
+	if (buffer->spans)
+	{
+		// Span clipping never draws to the alpha layer
+		return;
+	}
+	if (buffer->kbuffer)
+	{
+		RayEngine_resolveKBuffer(buffer);
+		return;
+	}
 	uint32_t width = buffer->pixelBuffer->width;
 	uint32_t height = buffer->pixelBuffer->height;
 	uint32_t pix;
@@ -203,14 +464,115 @@ void RayEngine_resetDepthBuffer(DepthBuffer* buffer)
 {
 	uint32_t width = buffer->pixelBuffer->width;
 	uint32_t height = buffer->pixelBuffer->height;
-	// Clear pixels
-	// Reset depths
-	for (uint64_t i = 0; i < (uint64_t)(width*height); i++)
+	if (buffer->spans)
+	{
+		// Depth and alpha layers go unused, only the spans need resetting
+		RaySpans* spans = buffer->spans;
+		memset(buffer->pixelBuffer->pixels, 0, sizeof(uint32_t) * width * height);
+		for (uint32_t x = 0; x < width; x++)
+		{
+			spans->top[x] = 0;
+			spans->bottom[x] = 0;
+			spans->depth[x] = INFINITY;
+			spans->numLayers[x] = 0;
+			spans->numDrawn[x] = 0;
+		}
+		spans->numSprites = 0;
+	}
+	else
+	{
+		// Clear pixels
+		// Reset depths
+		for (uint64_t i = 0; i < (uint64_t)(width*height); i++)
+		{
+			buffer->pixelBuffer->pixels[i] = 0;
+			buffer->alphaBuffer->pixels[i] = 0;
+			buffer->pixelDepth[i] = INFINITY;
+			buffer->alphaDepth[i] = INFINITY;
+		}
+	}
+	if (buffer->gbuffer)
+	{
+		for (uint64_t i = 0; i < (uint64_t)(width*height); i++)
+		{
+			buffer->gbuffer->pixels[i].material = 0;
+		}
+	}
+	if (buffer->kbuffer)
+	{
+		KBuffer* kbuffer = buffer->kbuffer;
+		memset(kbuffer->heads, 0xFF, sizeof(uint32_t) * width * height);
+		memset(kbuffer->counts, 0, width * height);
+		kbuffer->numFragments = 0;
+		kbuffer->numOverflow = 0;
+	}
+	if (buffer->stats)
+	{
+		RayEngine_resetRenderStats(buffer->stats);
+	}
+}
+
+/** RayEngine_resizeSpans
+ * @brief Reallocates the per-column arrays of RaySpans
+ * 
+ * @param spans RaySpans to resize
+ * @param width New width in columns
+ */
+static void RayEngine_resizeSpans(RaySpans* spans, uint32_t width)
+{
+	spans->width = width;
+	spans->top = (int32_t*)realloc(spans->top, sizeof(int32_t) * width);
+	spans->bottom = (int32_t*)realloc(spans->bottom, sizeof(int32_t) * width);
+	spans->depth = (double*)realloc(spans->depth, sizeof(double) * width);
+	spans->numLayers = (uint8_t*)realloc(spans->numLayers, width);
+	spans->numDrawn = (uint8_t*)realloc(spans->numDrawn, width);
+	spans->layers = (RaySpanLayer*)realloc(spans->layers, sizeof(RaySpanLayer) * RAY_SPAN_LAYERS * width);
+}
+
+/** RayEngine_resizeDepthBuffer
+ * @brief Reallocates a DepthBuffer (and attached stats) for a new size
+ * * For window resizes and resolution changes, reset before drawing
+ * @param buffer Buffer to resize
+ * @param width New width in pixels
+ * @param height New height in pixels
+ */
+void RayEngine_resizeDepthBuffer(DepthBuffer* buffer, uint32_t width, uint32_t height)
+{
+	PixBuffer_resizePixBuffer(buffer->pixelBuffer, width, height);
+	PixBuffer_resizePixBuffer(buffer->alphaBuffer, width, height);
+	free(buffer->pixelDepth);
+	free(buffer->alphaDepth);
+	buffer->pixelDepth = (double*)malloc(sizeof(double) * width * height);
+	buffer->alphaDepth = (double*)malloc(sizeof(double) * width * height);
+	if (buffer->stats)
 	{
-		buffer->pixelBuffer->pixels[i] = 0;
-		buffer->alphaBuffer->pixels[i] = 0;
-		buffer->pixelDepth[i] = INFINITY;
-		buffer->alphaDepth[i] = INFINITY;
+		RenderStats* stats = buffer->stats;
+		free(stats->pixWrites);
+		free(stats->columnSteps);
+		stats->width = width;
+		stats->height = height;
+		stats->pixWrites = (uint32_t*)calloc(width * height, sizeof(uint32_t));
+		stats->columnSteps = (uint32_t*)calloc(width, sizeof(uint32_t));
+	}
+	if (buffer->gbuffer)
+	{
+		GBuffer* gbuffer = buffer->gbuffer;
+		gbuffer->width = width;
+		gbuffer->height = height;
+		gbuffer->pixels = (GBufferPixel*)realloc(gbuffer->pixels, sizeof(GBufferPixel) * width * height);
+	}
+	if (buffer->spans)
+	{
+		RayEngine_resizeSpans(buffer->spans, width);
+	}
+	if (buffer->kbuffer)
+	{
+		// The fragment pool keeps its size, see KBuffer
+		KBuffer* kbuffer = buffer->kbuffer;
+		kbuffer->width = width;
+		kbuffer->height = height;
+		kbuffer->heads = (uint32_t*)realloc(kbuffer->heads, sizeof(uint32_t) * width * height);
+		kbuffer->counts = (uint8_t*)realloc(kbuffer->counts, width * height);
 	}
 }
 
@@ -228,492 +590,2120 @@ void RayEngine_delDepthBuffer(DepthBuffer* buffer)
 	free(buffer);
 }
 
-//! Old
-/** RayEngine_generateMap
- * @brief Generates new Map for game engine
- * TODO: Update generator, move to GameEngine
- * @param newMap Pointer to new Map
- * @param charList Map data formatted as string
- * TODO: Update map formatting, make real parser
- * @param width Width of map in grid units
- * @param height Height of map in grid units
- * @param border size of border in grid units (for tiles maps)
- * @param colorData Array of colors to render map tiles
- * ! Warning: depricated feature, pre-textures
- * @param numColor Number of colors in colorData
- * ! Warning: depricated feature, pre-textures
+/** RayEngine_initRenderStats
+ * @brief Allocates render counters for a buffer size
+ * * Attach with buffer->stats, counting needs a RAY_STATS build
+ * @param width Width of buffer in pixels
+ * @param height Height of buffer in pixels
+ * @return RenderStats* New zeroed counters
  */
-void RayEngine_generateMap(Map* newMap, unsigned char* charList, int width, int height, int border, SDL_Color* colorData, int numColor)
+RenderStats* RayEngine_initRenderStats(uint32_t width, uint32_t height)
 {
-	newMap->data = charList;
-	newMap->width = width;
-	newMap->height = height;
-	newMap->colorData = colorData;
-	newMap->numColor = numColor;
-	newMap->border = border;
+	RenderStats* newStats = (RenderStats*)calloc(1, sizeof(RenderStats));
+	newStats->width = width;
+	newStats->height = height;
+	newStats->pixWrites = (uint32_t*)calloc(width * height, sizeof(uint32_t));
+	newStats->columnSteps = (uint32_t*)calloc(width, sizeof(uint32_t));
+	return newStats;
 }
 
-/** RayEngine_initSprite
- * @brief Initializes new RaySprite for engine
- * TODO: Better integrate with 2D sprites, add more metadata
- * TODO: Consolidate w/ GameEngine
- * @param newSprite Pointer to new RaySprite
- * @param texture RayTex representing sprite frame data
- * @param scaleFactor Default sprite size
- * @param alphaNum Default sprite transparency
- * @param x Map x coordinate
- * @param y Map y coordinate
- * @param h Map h coordinate
+/** RayEngine_resetRenderStats
+ * @brief Zeroes all counters for a new frame
+ * 
+ * @param stats RenderStats to reset
  */
-void RayEngine_initSprite(RaySprite* newSprite, RayTex* texture, double scaleFactor, double alphaNum, double x, double y, double h)
+void RayEngine_resetRenderStats(RenderStats* stats)
 {
-	newSprite->texture = texture;
-	newSprite->scaleFactor = scaleFactor;
-	newSprite->alphaNum = alphaNum;
-	newSprite->x = x;
-	newSprite->y = y;
-	newSprite->h = h;
-	newSprite->frameNum = 0;
+	stats->rays = 0;
+	stats->rayHits = 0;
+	stats->cellsVisited = 0;
+	stats->pixWritten = 0;
+	stats->pixRejected = 0;
+	stats->alphaPix = 0;
+	stats->spritesDrawn = 0;
+	stats->spritesCulled = 0;
+	memset(stats->pixWrites, 0, sizeof(uint32_t) * stats->width * stats->height);
+	memset(stats->columnSteps, 0, sizeof(uint32_t) * stats->width);
 }
 
-/** RayEngine_draw2DSprite
- * @brief Renders a 2D sprite to the screen
- * TODO: Consolidate w/ PixBuffer
- * TODO: Better manage w/ 3D sprites
- * @param buffer PixBuffer to render to
- * @param sprite RaySprite to render
- * @param angle Angle (rad) to render sprite at
- * TODO: Add to sprite metadata
+/** RayEngine_delRenderStats
+ * @brief Deallocates RenderStats memory
+ * ! Detach from any DepthBuffer first
+ * @param stats RenderStats to free
  */
-void RayEngine_draw2DSprite(PixBuffer* buffer, RaySprite sprite, double angle)
+void RayEngine_delRenderStats(RenderStats* stats)
 {
-	// First, compute screen-space sprite dimensions
-	double scaleWidth = sprite.texture->tileWidth*sprite.scaleFactor;
-	double scaleHeight = sprite.texture->tileHeight*sprite.scaleFactor;
-	int32_t boundSize = (uint32_t)(scaleWidth > scaleHeight ? scaleWidth*1.5 : scaleHeight*1.5);
-	// Then render sprite based on dimensions
-	int32_t texX;
-	int32_t texY;
-	double pixX;
-	double pixY;
-	uint32_t pixColor;
-	// For all pixels in bounding box (yes, I know the box can be more dynamically sized but
-	// I'm lazy and this will have to cut it for now)
-	for (int32_t i = -boundSize/2; i < boundSize/2; i++)
+	free(stats->pixWrites);
+	free(stats->columnSteps);
+	free(stats);
+}
+
+/** RayEngine_heatColor
+ * @brief Maps 0-1 onto a black-blue-green-yellow-red ramp
+ * 
+ * @param heat Value to map (clamped)
+ * @return uint32_t Pixel color
+ */
+static uint32_t RayEngine_heatColor(double heat)
+{
+	const uint8_t ramp[5][3] = {
+		{0, 0, 0},
+		{0, 0, 255},
+		{0, 255, 0},
+		{255, 255, 0},
+		{255, 0, 0}
+	};
+	heat = heat < 0 ? 0 : (heat > 1 ? 1 : heat) * 4;
+	int32_t step = heat >= 4 ? 3 : (int32_t)heat;
+	double frac = heat - step;
+	return PixBuffer_toPixColor(
+		(uint8_t)(ramp[step][0] + (ramp[step+1][0] - ramp[step][0]) * frac),
+		(uint8_t)(ramp[step][1] + (ramp[step+1][1] - ramp[step][1]) * frac),
+		(uint8_t)(ramp[step][2] + (ramp[step+1][2] - ramp[step][2]) * frac),
+		255
+	);
+}
+
+/** RayEngine_drawStatsView
+ * @brief Replaces a buffer with a heatmap of the last frame's counters
+ * * RSV_OVERDRAW: writes per pixel, red is 8 or more
+ * * RSV_RAYSTEPS: cells visited per column, red is the frame's worst column
+ * ! Call after rendering, before the next RayEngine_resetDepthBuffer
+ * @param buffer PixBuffer to draw to (same size as stats)
+ * @param stats RenderStats to visualize
+ * @param view RenderStatsView to draw
+ */
+void RayEngine_drawStatsView(PixBuffer* buffer, RenderStats* stats, uint8_t view)
+{
+	if (view == RSV_OVERDRAW)
 	{
-		for (int32_t j = -boundSize/2; j < boundSize/2; j++)
+		for (uint32_t i = 0; i < stats->width * stats->height; i++)
 		{
-			texX = (int32_t)round((i * cos(angle) - j * sin(angle)) / sprite.scaleFactor + sprite.texture->tileWidth/2.0 - 0.5);
-			texY = (int32_t)round((i * sin(angle) + j * cos(angle)) / sprite.scaleFactor + sprite.texture->tileHeight/2.0 - 0.5);
-			pixX = sprite.x + i;
-			pixY = sprite.y + j;
-			if (pixX >= 0 && pixX < buffer->width && pixY >= 0 && pixY < buffer->height &&\
-				texX >= 0 && texX < sprite.texture->tileWidth && texY >=0 && texY < sprite.texture->tileHeight)
+			buffer->pixels[i] = RayEngine_heatColor(stats->pixWrites[i] / 8.0);
+		}
+	}
+	else
+	{
+		uint32_t maxSteps = 1;
+		for (uint32_t x = 0; x < stats->width; x++)
+		{
+			if (stats->columnSteps[x] > maxSteps)
 			{
-				pixColor = PixBuffer_getTex(sprite.texture, 0, texX, texY);
-				PixBuffer_drawPixAlpha(buffer, pixX, pixY, pixColor, sprite.alphaNum);
+				maxSteps = stats->columnSteps[x];
+			}
+		}
+		for (uint32_t x = 0; x < stats->width; x++)
+		{
+			uint32_t color = RayEngine_heatColor((double)stats->columnSteps[x] / maxSteps);
+			for (uint32_t y = 0; y < stats->height; y++)
+			{
+				buffer->pixels[y * stats->width + x] = color;
 			}
 		}
 	}
 }
 
-//! Old
-/** RayEngine_drawMinimap
- * @brief Renders minimap to screen
- * !! Very depricated code, does not work, cannot delete (???)
- * TODO: Please fix all of this
- * @param buffer PixBuffer to render minimap to
- * @param camera Active camera to render from
- * ! Also depricated, does not do anything
- * @param width Width of window
- * ! Redundant, pre-buffer size
- * @param height Height of window
- * ! Ditto
- * @param map Map to render
- * @param blockSize Size of tiles on rendered map
+/** RayEngine_initGBuffer
+ * @brief Allocates a GBuffer for a buffer size
+ * * Attach with buffer->gbuffer, before RayEngine_resetDepthBuffer
+ * @param width Width of buffer in pixels
+ * @param height Height of buffer in pixels
+ * @return GBuffer* New GBuffer with no materials
  */
-void RayEngine_drawMinimap(PixBuffer* buffer, Camera* camera, unsigned int width, unsigned int height, Map* map, int blockSize)
+GBuffer* RayEngine_initGBuffer(uint32_t width, uint32_t height)
 {
-	SDL_Rect mapRect;
-	mapRect.w = map->width * blockSize;
-	mapRect.h = map->height * blockSize;
-	mapRect.x = width - mapRect.w;
-	mapRect.y = 0;
-	SDL_Rect blockRect;
-	blockRect.w = blockSize;
-	blockRect.h = blockSize;
-	SDL_Color backColor = {0x00, 0x00, 0x00, 0x40};
-	PixBuffer_drawRect(buffer, &mapRect, backColor);
-	//SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
-	//SDL_RenderDrawRect(renderer, &mapRect);
-	for (int i = 0; i < map->height; i++)
+	GBuffer* newGBuffer = (GBuffer*)calloc(1, sizeof(GBuffer));
+	newGBuffer->width = width;
+	newGBuffer->height = height;
+	newGBuffer->fogColor = FOG_COLOR;
+	newGBuffer->fogScale = 1.0;
+	newGBuffer->pixels = (GBufferPixel*)calloc(width * height, sizeof(GBufferPixel));
+	return newGBuffer;
+}
+
+/** RayEngine_delGBuffer
+ * @brief Deallocates GBuffer memory
+ * ! Detach from any DepthBuffer first
+ * @param gbuffer GBuffer to free
+ */
+void RayEngine_delGBuffer(GBuffer* gbuffer)
+{
+	free(gbuffer->pixels);
+	free(gbuffer);
+}
+
+/** RayEngine_shadeGBuffer
+ * @brief Shades every stored GBuffer pixel into the opaque layer
+ * * Call after walls, sprites and RayEngine_deferFloor, before
+ * * RayEngine_renderBuffer. Pixels nothing was stored for keep
+ * * their color, so it can run again with other fog settings.
+ * * Works through GBUFFER_TILE square tiles so each one's
+ * * texels stay in cache
+ * @param buffer DepthBuffer with a GBuffer attached
+ */
+void RayEngine_shadeGBuffer(DepthBuffer* buffer)
+{
+	GBuffer* gbuffer = buffer->gbuffer;
+	uint32_t width = gbuffer->width;
+	uint32_t height = gbuffer->height;
+	uint32_t tilesX = (width + GBUFFER_TILE - 1) / GBUFFER_TILE;
+	uint32_t tilesY = (height + GBUFFER_TILE - 1) / GBUFFER_TILE;
+	#pragma omp parallel for schedule(dynamic,1)
+	for (int t = 0; t < tilesX * tilesY; t++)
+	{
+		uint32_t startX = (t % tilesX) * GBUFFER_TILE;
+		uint32_t startY = (t / tilesX) * GBUFFER_TILE;
+		uint32_t endX = startX + GBUFFER_TILE < width ? startX + GBUFFER_TILE : width;
+		uint32_t endY = startY + GBUFFER_TILE < height ? startY + GBUFFER_TILE : height;
+		for (uint32_t y = startY; y < endY; y++)
+		{
+			for (uint32_t x = startX; x < endX; x++)
+			{
+				GBufferPixel* texel = &gbuffer->pixels[x + y * width];
+				if (!texel->material)
+				{
+					continue;
+				}
+				RayTex* texture = gbuffer->materials[texel->material];
+				uint32_t pix = texture->pixData[texel->tile * texture->tileWidth * texture->tileHeight + \
+					texel->v * texture->tileWidth + texel->u];
+				double fade = texel->fog * gbuffer->fogScale;
+				// Stored pixels are all opaque
+				buffer->pixelBuffer->pixels[x + y * width] = \
+					RayEngine_pixGradientShader(pix, fade < 1 ? fade : 1, gbuffer->fogColor) | 0xFF;
+			}
+		}
+	}
+}
+
+/** RayEngine_initSpans
+ * @brief Allocates span clipping state for a buffer width
+ * * Attach with buffer->spans, before RayEngine_resetDepthBuffer
+ * @param width Width of buffer in pixels
+ * @return RaySpans* New RaySpans
+ */
+RaySpans* RayEngine_initSpans(uint32_t width)
+{
+	RaySpans* newSpans = (RaySpans*)calloc(1, sizeof(RaySpans));
+	RayEngine_resizeSpans(newSpans, width);
+	return newSpans;
+}
+
+/** RayEngine_delSpans
+ * @brief Deallocates RaySpans memory
+ * ! Detach from any DepthBuffer first
+ * @param spans RaySpans to free
+ */
+void RayEngine_delSpans(RaySpans* spans)
+{
+	free(spans->top);
+	free(spans->bottom);
+	free(spans->depth);
+	free(spans->numLayers);
+	free(spans->numDrawn);
+	free(spans->layers);
+	free(spans->sprites);
+	free(spans);
+}
+
+/** RayEngine_initKBuffer
+ * @brief Allocates a KBuffer for a buffer size and fragment budget
+ * * Attach with buffer->kbuffer, before RayEngine_resetDepthBuffer
+ * @param width Width of buffer in pixels
+ * @param height Height of buffer in pixels
+ * @param layers Fragments kept per pixel (1 to KBUFFER_MAX_LAYERS)
+ * @param capacity Fragments in the pool, shared by all pixels
+ * @return KBuffer* New KBuffer
+ */
+KBuffer* RayEngine_initKBuffer(uint32_t width, uint32_t height, uint8_t layers, uint32_t capacity)
+{
+	KBuffer* newKBuffer = (KBuffer*)calloc(1, sizeof(KBuffer));
+	newKBuffer->width = width;
+	newKBuffer->height = height;
+	newKBuffer->layers = layers < 1 ? 1 : (layers > KBUFFER_MAX_LAYERS ? KBUFFER_MAX_LAYERS : layers);
+	newKBuffer->heads = (uint32_t*)malloc(sizeof(uint32_t) * width * height);
+	newKBuffer->counts = (uint8_t*)malloc(width * height);
+	newKBuffer->fragments = (KBufferFragment*)malloc(sizeof(KBufferFragment) * capacity);
+	newKBuffer->capacity = capacity;
+	return newKBuffer;
+}
+
+/** RayEngine_delKBuffer
+ * @brief Deallocates KBuffer memory
+ * ! Detach from any DepthBuffer first
+ * @param kbuffer KBuffer to free
+ */
+void RayEngine_delKBuffer(KBuffer* kbuffer)
+{
+	free(kbuffer->heads);
+	free(kbuffer->counts);
+	free(kbuffer->fragments);
+	free(kbuffer);
+}
+
+// Shared chunk for empty and unloaded parts of every map
+static const MapTile emptyChunk[MAP_CHUNK_TILES] = {0};
+
+/** RayEngine_isTranslucentId
+ * @brief Looks up a tile id in map->translucentTiles
+ */
+static inline uint8_t RayEngine_isTranslucentId(Map* map, MapTile tile)
+{
+	return tile && (map->translucentTiles[tile >> 5] >> (tile & 31)) & 1;
+}
+
+/** RayEngine_getTexTile
+ * @brief Texture tile drawn for a (non-empty) map tile id
+ * * Tile id n uses texture tile n - 1, ids past the texture
+ *   set wrap around it.
+ */
+static inline uint8_t RayEngine_getTexTile(RayTex* texData, MapTile tile)
+{
+	return (uint8_t)((tile - 1) % texData->tileCount);
+}
+
+/** RayEngine_wrapCoord
+ * @brief Wraps any tile coordinate into -border to size + border - 1
+ */
+static int32_t RayEngine_wrapCoord(int32_t coord, int32_t size, int32_t border)
+{
+	int32_t period = size + border * 2;
+	int32_t wrapped = (coord + border) % period;
+	return (wrapped < 0 ? wrapped + period : wrapped) - border;
+}
+
+/** RayEngine_initWrapTable
+ * @brief Builds a wrap table, indexed from -border - 1 to size + border
+ * @return int32_t* Pointer to the entry for coordinate 0
+ */
+static int32_t* RayEngine_initWrapTable(int32_t size, int32_t border)
+{
+	int32_t* table = (int32_t*)malloc(sizeof(int32_t) * (size + border * 2 + 2)) + border + 1;
+	for (int32_t i = -border - 1; i <= size + border; i++)
+	{
+		table[i] = RayEngine_wrapCoord(i, size, border);
+	}
+	return table;
+}
+
+/** RayEngine_initMap
+ * @brief Initializes an empty chunked Map
+ * 
+ * @param newMap Pointer to new Map
+ * @param width Width of map in grid units
+ * @param height Height of map in grid units
+ * @param border size of border in grid units (for tiles maps)
+ */
+void RayEngine_initMap(Map* newMap, int width, int height, int border)
+{
+	memset(newMap, 0, sizeof(Map));
+	newMap->width = width;
+	newMap->height = height;
+	newMap->border = border;
+	newMap->chunksX = (width + MAP_CHUNK_MASK) >> MAP_CHUNK_SHIFT;
+	newMap->chunksY = (height + MAP_CHUNK_MASK) >> MAP_CHUNK_SHIFT;
+	uint32_t numChunks = newMap->chunksX * newMap->chunksY;
+	newMap->chunks = (MapTile**)malloc(sizeof(MapTile*) * numChunks);
+	newMap->chunkFlags = (uint8_t*)malloc(numChunks);
+	newMap->occupancy = (uint64_t*)calloc(numChunks, sizeof(uint64_t));
+	newMap->solidBits = (uint32_t*)calloc(numChunks * MAP_CHUNK_SIZE, sizeof(uint32_t));
+	newMap->alphaBits = (uint32_t*)calloc(numChunks * MAP_CHUNK_SIZE, sizeof(uint32_t));
+	// Until textures are known every tile may be translucent
+	memset(newMap->translucentTiles, 0xFF, sizeof(newMap->translucentTiles));
+	newMap->wrapX = RayEngine_initWrapTable(width, border);
+	newMap->wrapY = RayEngine_initWrapTable(height, border);
+	for (uint32_t c = 0; c < numChunks; c++)
+	{
+		newMap->chunks[c] = (MapTile*)emptyChunk;
+		newMap->chunkFlags[c] = MCF_LOADED;
+	}
+}
+
+//! Old
+/** RayEngine_generateMap
+ * @brief Generates new Map for game engine
+ * TODO: Update generator, move to GameEngine
+ * @param newMap Pointer to new Map
+ * @param charList Map data formatted as string
+ * * Copied into chunks, may be freed afterwards
+ * @param width Width of map in grid units
+ * @param height Height of map in grid units
+ * @param border size of border in grid units (for tiles maps)
+ * @param colorData Array of colors to render map tiles
+ * ! Warning: depricated feature, pre-textures
+ * @param numColor Number of colors in colorData
+ * ! Warning: depricated feature, pre-textures
+ */
+void RayEngine_generateMap(Map* newMap, unsigned char* charList, int width, int height, int border, SDL_Color* colorData, int numColor)
+{
+	RayEngine_initMap(newMap, width, height, border);
+	newMap->colorData = colorData;
+	newMap->numColor = numColor;
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			if (charList[y * width + x])
+			{
+				RayEngine_setTile(newMap, x, y, charList[y * width + x]);
+			}
+		}
+	}
+	RayEngine_compactMap(newMap);
+	for (int32_t c = 0; c < newMap->chunksX * newMap->chunksY; c++)
+	{
+		newMap->chunkFlags[c] &= ~MCF_DIRTY;
+	}
+	newMap->version = 0;
+}
+
+/** RayEngine_delMap
+ * @brief Frees chunk storage of a Map
+ * * Floor/ceiling layers and file backed chunks belong to their creator
+ * @param map Map to free
+ */
+void RayEngine_delMap(Map* map)
+{
+	for (int32_t c = 0; c < map->chunksX * map->chunksY; c++)
+	{
+		if (map->chunkFlags[c] & MCF_OWNED)
+		{
+			free(map->chunks[c]);
+		}
+	}
+	for (uint32_t f = 0; f < map->numFill; f++)
+	{
+		free(map->fillChunks[f]);
+	}
+	free(map->chunks);
+	free(map->chunkFlags);
+	free(map->occupancy);
+	free(map->solidBits);
+	free(map->alphaBits);
+	free(map->resident);
+	free(map->wrapX - map->border - 1);
+	free(map->wrapY - map->border - 1);
+	map->chunks = NULL;
+	map->chunkFlags = NULL;
+	map->occupancy = NULL;
+	map->solidBits = NULL;
+	map->alphaBits = NULL;
+	map->wrapX = NULL;
+	map->wrapY = NULL;
+	map->resident = NULL;
+}
+
+/** RayEngine_getFillChunk
+ * @brief Finds the shared chunk filled with a single tile
+ * 
+ * @param map Map to share chunk in
+ * @param tile Tile id to fill with (0 for the empty chunk)
+ * @return MapTile* Shared read-only chunk, NULL if the map
+ *         already shares MAP_MAX_FILL different tiles
+ */
+MapTile* RayEngine_getFillChunk(Map* map, MapTile tile)
+{
+	if (!tile)
+	{
+		return (MapTile*)emptyChunk;
+	}
+	for (uint32_t f = 0; f < map->numFill; f++)
+	{
+		if (map->fillTiles[f] == tile)
+		{
+			return map->fillChunks[f];
+		}
+	}
+	if (map->numFill == MAP_MAX_FILL)
+	{
+		return NULL;
+	}
+	MapTile* fill = (MapTile*)malloc(sizeof(MapTile) * MAP_CHUNK_TILES);
+	for (uint32_t t = 0; t < MAP_CHUNK_TILES; t++)
+	{
+		fill[t] = tile;
+	}
+	map->fillTiles[map->numFill] = tile;
+	map->fillChunks[map->numFill++] = fill;
+	return fill;
+}
+
+/** RayEngine_shareChunk
+ * @brief Swaps an owned uniform chunk for the shared fill chunk
+ */
+static void RayEngine_shareChunk(Map* map, uint32_t c)
+{
+	MapTile* chunk = map->chunks[c];
+	for (uint32_t t = 1; t < MAP_CHUNK_TILES; t++)
+	{
+		if (chunk[t] != chunk[0])
+		{
+			return;
+		}
+	}
+	MapTile* fill = RayEngine_getFillChunk(map, chunk[0]);
+	if (fill)
+	{
+		free(chunk);
+		map->chunks[c] = fill;
+		map->chunkFlags[c] &= ~(MCF_OWNED | MCF_WRITABLE);
+	}
+}
+
+/** RayEngine_loadChunk
+ * @brief Fills an unloaded chunk from map->loadChunk
+ * * The chunk is added to resident even if the loader fails, it is
+ * * flagged MCF_FAILED and not retried until evicted
+ * @return uint8_t 1 if the chunk was loaded
+ */
+static uint8_t RayEngine_loadChunk(Map* map, uint32_t c)
+{
+	map->resident[map->numResident++] = c;
+	MapTile* chunk = (MapTile*)calloc(MAP_CHUNK_TILES, sizeof(MapTile));
+	if (!map->loadChunk(map, c % map->chunksX, c / map->chunksX, chunk, map->loaderData))
+	{
+		free(chunk);
+		map->chunkFlags[c] |= MCF_FAILED;
+		return 0;
+	}
+	map->chunks[c] = chunk;
+	map->chunkFlags[c] = MCF_LOADED | MCF_OWNED | MCF_WRITABLE;
+	RayEngine_shareChunk(map, c);
+	RayEngine_updateOccupancy(map, c);
+	map->version++;
+	return 1;
+}
+
+/** RayEngine_setTile
+ * @brief Writes a map cell, copying shared chunks first
+ * * Unloaded chunks of a streamed map are loaded before the edit
+ * @param map Map to edit
+ * @param x Tile x coordinate (ignored if outside the map)
+ * @param y Tile y coordinate (ignored if outside the map)
+ * @param tile New tile id
+ */
+void RayEngine_setTile(Map* map, int32_t x, int32_t y, MapTile tile)
+{
+	if (x < 0 || y < 0 || x >= map->width || y >= map->height)
+	{
+		return;
+	}
+	uint32_t c = (y >> MAP_CHUNK_SHIFT) * map->chunksX + (x >> MAP_CHUNK_SHIFT);
+	if (map->loadChunk && !(map->chunkFlags[c] & (MCF_LOADED | MCF_FAILED)))
+	{
+		RayEngine_loadChunk(map, c);
+	}
+	if (!(map->chunkFlags[c] & MCF_WRITABLE))
+	{
+		MapTile* chunk = (MapTile*)malloc(sizeof(MapTile) * MAP_CHUNK_TILES);
+		memcpy(chunk, map->chunks[c], sizeof(MapTile) * MAP_CHUNK_TILES);
+		map->chunks[c] = chunk;
+		map->chunkFlags[c] = (map->chunkFlags[c] & ~MCF_FAILED) | MCF_LOADED | MCF_OWNED | MCF_WRITABLE;
+	}
+	map->chunks[c][((y & MAP_CHUNK_MASK) << MAP_CHUNK_SHIFT) | (x & MAP_CHUNK_MASK)] = tile;
+	map->chunkFlags[c] |= MCF_DIRTY;
+	map->version++;
+	uint32_t row = (c << MAP_CHUNK_SHIFT) | (y & MAP_CHUNK_MASK);
+	uint32_t bit = 1u << (x & MAP_CHUNK_MASK);
+	map->solidBits[row] = tile ? map->solidBits[row] | bit : map->solidBits[row] & ~bit;
+	map->alphaBits[row] = RayEngine_isTranslucentId(map, tile) ? map->alphaBits[row] | bit : map->alphaBits[row] & ~bit;
+	uint32_t block = (((y & MAP_CHUNK_MASK) >> MAP_BLOCK_SHIFT) << MAP_BLOCKS_SHIFT) | ((x & MAP_CHUNK_MASK) >> MAP_BLOCK_SHIFT);
+	if (tile)
+	{
+		map->occupancy[c] |= 1ull << block;
+	}
+	else if (map->occupancy[c] & (1ull << block))
+	{
+		// Block may have emptied, only its tiles need checking
+		MapTile* blockTiles = map->chunks[c] + ((y & MAP_CHUNK_MASK & ~(MAP_BLOCK_SIZE - 1)) << MAP_CHUNK_SHIFT) + (x & MAP_CHUNK_MASK & ~(MAP_BLOCK_SIZE - 1));
+		uint8_t used = 0;
+		for (uint32_t by = 0; by < MAP_BLOCK_SIZE; by++)
+		{
+			for (uint32_t bx = 0; bx < MAP_BLOCK_SIZE; bx++)
+			{
+				used |= blockTiles[(by << MAP_CHUNK_SHIFT) + bx] != 0;
+			}
+		}
+		if (!used)
+		{
+			map->occupancy[c] &= ~(1ull << block);
+		}
+	}
+}
+
+/** RayEngine_updateOccupancy
+ * @brief Rebuilds the occupancy bits and tile bitmaps of a chunk
+ * * Needed after writing map->chunks directly (setTile keeps them current)
+ * @param map Map holding the chunk
+ * @param chunk Chunk index (chunkY * chunksX + chunkX)
+ */
+void RayEngine_updateOccupancy(Map* map, uint32_t chunk)
+{
+	MapTile* tiles = map->chunks[chunk];
+	uint32_t* solidRows = map->solidBits + (chunk << MAP_CHUNK_SHIFT);
+	uint32_t* alphaRows = map->alphaBits + (chunk << MAP_CHUNK_SHIFT);
+	uint64_t bits = 0;
+	if (tiles == emptyChunk)
+	{
+		map->occupancy[chunk] = 0;
+		memset(solidRows, 0, sizeof(uint32_t) * MAP_CHUNK_SIZE);
+		memset(alphaRows, 0, sizeof(uint32_t) * MAP_CHUNK_SIZE);
+		return;
+	}
+	for (uint32_t f = 0; f < map->numFill; f++)
+	{
+		if (tiles == map->fillChunks[f])
+		{
+			map->occupancy[chunk] = ~0ull;
+			memset(solidRows, 0xFF, sizeof(uint32_t) * MAP_CHUNK_SIZE);
+			memset(alphaRows, RayEngine_isTranslucentId(map, map->fillTiles[f]) ? 0xFF : 0, sizeof(uint32_t) * MAP_CHUNK_SIZE);
+			return;
+		}
+	}
+	for (uint32_t y = 0; y < MAP_CHUNK_SIZE; y++)
+	{
+		uint32_t solidRow = 0;
+		uint32_t alphaRow = 0;
+		for (uint32_t x = 0; x < MAP_CHUNK_SIZE; x++)
+		{
+			MapTile tile = tiles[(y << MAP_CHUNK_SHIFT) | x];
+			if (tile)
+			{
+				solidRow |= 1u << x;
+				alphaRow |= (uint32_t)RayEngine_isTranslucentId(map, tile) << x;
+				bits |= 1ull << (((y >> MAP_BLOCK_SHIFT) << MAP_BLOCKS_SHIFT) | (x >> MAP_BLOCK_SHIFT));
+			}
+		}
+		solidRows[y] = solidRow;
+		alphaRows[y] = alphaRow;
+	}
+	map->occupancy[chunk] = bits;
+}
+
+/** RayEngine_updateAlphaBits
+ * @brief Rebuilds the alphaBits of a chunk from its solidBits
+ * * Only reads the ids of non-empty tiles, occupancy and solidBits must be current
+ * @param map Map holding the chunk
+ * @param chunk Chunk index (chunkY * chunksX + chunkX)
+ */
+static void RayEngine_updateAlphaBits(Map* map, uint32_t chunk)
+{
+	MapTile* tiles = map->chunks[chunk];
+	uint32_t* solidRows = map->solidBits + (chunk << MAP_CHUNK_SHIFT);
+	uint32_t* alphaRows = map->alphaBits + (chunk << MAP_CHUNK_SHIFT);
+	if (!map->occupancy[chunk])
+	{
+		memset(alphaRows, 0, sizeof(uint32_t) * MAP_CHUNK_SIZE);
+		return;
+	}
+	for (uint32_t f = 0; f < map->numFill; f++)
+	{
+		if (tiles == map->fillChunks[f])
+		{
+			memset(alphaRows, RayEngine_isTranslucentId(map, map->fillTiles[f]) ? 0xFF : 0, sizeof(uint32_t) * MAP_CHUNK_SIZE);
+			return;
+		}
+	}
+	for (uint32_t y = 0; y < MAP_CHUNK_SIZE; y++)
+	{
+		uint32_t alphaRow = 0;
+		for (uint32_t solid = solidRows[y]; solid; solid &= solid - 1)
+		{
+			uint32_t x = __builtin_ctz(solid);
+			alphaRow |= (uint32_t)RayEngine_isTranslucentId(map, tiles[(y << MAP_CHUNK_SHIFT) | x]) << x;
+		}
+		alphaRows[y] = alphaRow;
+	}
+}
+
+/** RayEngine_setTileTranslucency
+ * @brief Marks which tile ids have translucent textures
+ * * Rays stop at opaque tiles without checking texture columns.
+ * * Call again if the wall textures change, only alphaBits are rebuilt.
+ * @param map Map to update
+ * @param texData Wall texture set used to render map (NULL treats
+ *        every tile as translucent, the default)
+ */
+void RayEngine_setTileTranslucency(Map* map, RayTex* texData)
+{
+	// Scan each texture tile once, ids share them, see RayEngine_getTexTile
+	uint8_t tileAlpha[256] = {0};
+	for (uint32_t t = 0; texData && t < texData->tileCount; t++)
+	{
+		for (uint32_t p = 0; p < texData->tileWidth * texData->tileHeight; p++)
+		{
+			if ((texData->pixData[t * texData->tileWidth * texData->tileHeight + p] & 0xFF) < 0xFF)
+			{
+				tileAlpha[t] = 1;
+				break;
+			}
+		}
+	}
+	uint32_t table[MAP_TILE_IDS >> 5] = {0};
+	uint32_t numTranslucent = 0;
+	for (uint32_t id = 1; id < MAP_TILE_IDS; id++)
+	{
+		if (!texData || tileAlpha[RayEngine_getTexTile(texData, id)])
+		{
+			table[id >> 5] |= 1u << (id & 31);
+			numTranslucent++;
+		}
+	}
+	// Bit 0 is never read, see RayEngine_isTranslucentId
+	table[0] |= map->translucentTiles[0] & 1;
+	if (!memcmp(table, map->translucentTiles, sizeof(table)))
+	{
+		return;
+	}
+	memcpy(map->translucentTiles, table, sizeof(table));
+	// Only alphaBits depend on the table, solidBits and occupancy stay
+	uint32_t numRows = (uint32_t)(map->chunksX * map->chunksY) << MAP_CHUNK_SHIFT;
+	if (!numTranslucent)
+	{
+		memset(map->alphaBits, 0, sizeof(uint32_t) * numRows);
+		return;
+	}
+	if (numTranslucent == MAP_TILE_IDS - 1)
+	{
+		memcpy(map->alphaBits, map->solidBits, sizeof(uint32_t) * numRows);
+		return;
+	}
+	for (int32_t c = 0; c < map->chunksX * map->chunksY; c++)
+	{
+		RayEngine_updateAlphaBits(map, c);
+	}
+}
+
+/** RayEngine_compactMap
+ * @brief Frees owned chunks that are all empty or all one tile
+ * 
+ * @param map Map to compact
+ */
+void RayEngine_compactMap(Map* map)
+{
+	for (int32_t c = 0; c < map->chunksX * map->chunksY; c++)
+	{
+		if (map->chunkFlags[c] & MCF_OWNED)
+		{
+			RayEngine_shareChunk(map, c);
+		}
+	}
+}
+
+/** RayEngine_evictChunk
+ * @brief Drops a chunk's tiles, it reads as empty until loaded again
+ */
+static void RayEngine_evictChunk(Map* map, uint32_t c)
+{
+	if (map->chunkFlags[c] & MCF_OWNED)
+	{
+		free(map->chunks[c]);
+	}
+	map->chunks[c] = (MapTile*)emptyChunk;
+	map->chunkFlags[c] = 0;
+	map->occupancy[c] = 0;
+	memset(map->solidBits + (c << MAP_CHUNK_SHIFT), 0, sizeof(uint32_t) * MAP_CHUNK_SIZE);
+	memset(map->alphaBits + (c << MAP_CHUNK_SHIFT), 0, sizeof(uint32_t) * MAP_CHUNK_SIZE);
+	map->version++;
+}
+
+/** RayEngine_setMapLoader
+ * @brief Streams chunks in from a callback (procedural or paged worlds)
+ * * All chunks not edited so far are unloaded, RayEngine_streamMap
+ * * then loads the ones near the camera
+ * @param map Map to stream
+ * @param loadChunk Fills a zeroed MAP_CHUNK_TILES array for a chunk,
+ *        returns 0 if the chunk could not be loaded (it stays empty
+ *        and is only retried after streaming out of range)
+ * @param loaderData Passed through to loadChunk
+ */
+void RayEngine_setMapLoader(Map* map, MapChunkLoader loadChunk, void* loaderData)
+{
+	map->loadChunk = loadChunk;
+	map->loaderData = loaderData;
+	for (int32_t c = 0; c < map->chunksX * map->chunksY; c++)
+	{
+		if (!(map->chunkFlags[c] & MCF_DIRTY))
+		{
+			RayEngine_evictChunk(map, c);
+		}
+	}
+	map->numResident = 0;
+	if (!map->resident)
+	{
+		map->resident = (uint32_t*)malloc(sizeof(uint32_t) * map->chunksX * map->chunksY);
+	}
+}
+
+/** RayEngine_chunkDistance
+ * @brief Distance from a point to the nearest edge of a chunk
+ */
+static double RayEngine_chunkDistance(int32_t chunkX, int32_t chunkY, double x, double y)
+{
+	double dx = fmax(fmax(chunkX * MAP_CHUNK_SIZE - x, x - (chunkX + 1) * MAP_CHUNK_SIZE), 0);
+	double dy = fmax(fmax(chunkY * MAP_CHUNK_SIZE - y, y - (chunkY + 1) * MAP_CHUNK_SIZE), 0);
+	return sqrt(dx*dx + dy*dy);
+}
+
+/** RayEngine_streamMap
+ * @brief Loads chunks within radius of a point, evicts far ones
+ * * Chunks are kept until a chunk width past radius so moving back
+ * * and forth doesn't thrash. Edited chunks are never evicted.
+ * ! radius should cover the view distance, unloaded chunks are empty
+ * @param map Map with a loader (see RayEngine_setMapLoader)
+ * @param x Map x coordinate to stream around
+ * @param y Map y coordinate to stream around
+ * @param radius Load radius in tiles
+ * @return uint32_t Number of chunks loaded
+ */
+uint32_t RayEngine_streamMap(Map* map, double x, double y, double radius)
+{
+	if (!map->loadChunk)
+	{
+		return 0;
+	}
+	// Evict first, so resident never overflows
+	for (uint32_t r = 0; r < map->numResident; r++)
+	{
+		uint32_t c = map->resident[r];
+		if (!(map->chunkFlags[c] & MCF_DIRTY) && \
+			RayEngine_chunkDistance(c % map->chunksX, c / map->chunksX, x, y) > radius + MAP_CHUNK_SIZE)
+		{
+			RayEngine_evictChunk(map, c);
+			map->resident[r--] = map->resident[--map->numResident];
+		}
+	}
+	int32_t minX = (int32_t)floor((x - radius) / MAP_CHUNK_SIZE);
+	int32_t maxX = (int32_t)floor((x + radius) / MAP_CHUNK_SIZE);
+	int32_t minY = (int32_t)floor((y - radius) / MAP_CHUNK_SIZE);
+	int32_t maxY = (int32_t)floor((y + radius) / MAP_CHUNK_SIZE);
+	minX = minX < 0 ? 0 : minX;
+	minY = minY < 0 ? 0 : minY;
+	maxX = maxX >= map->chunksX ? map->chunksX - 1 : maxX;
+	maxY = maxY >= map->chunksY ? map->chunksY - 1 : maxY;
+	uint32_t numLoaded = 0;
+	for (int32_t cy = minY; cy <= maxY; cy++)
+	{
+		for (int32_t cx = minX; cx <= maxX; cx++)
+		{
+			uint32_t c = cy * map->chunksX + cx;
+			if (map->chunkFlags[c] & (MCF_LOADED | MCF_FAILED) || RayEngine_chunkDistance(cx, cy, x, y) > radius)
+			{
+				continue;
+			}
+			numLoaded += RayEngine_loadChunk(map, c);
+		}
+	}
+	return numLoaded;
+}
+
+/** RayEngine_initSprite
+ * @brief Initializes new RaySprite for engine
+ * TODO: Better integrate with 2D sprites, add more metadata
+ * TODO: Consolidate w/ GameEngine
+ * @param newSprite Pointer to new RaySprite
+ * @param texture RayTex representing sprite frame data
+ * @param scaleFactor Default sprite size
+ * @param alphaNum Default sprite transparency
+ * @param x Map x coordinate
+ * @param y Map y coordinate
+ * @param h Map h coordinate
+ */
+void RayEngine_initSprite(RaySprite* newSprite, RayTex* texture, double scaleFactor, double alphaNum, double x, double y, double h)
+{
+	newSprite->texture = texture;
+	newSprite->scaleFactor = scaleFactor;
+	newSprite->alphaNum = alphaNum;
+	newSprite->x = x;
+	newSprite->y = y;
+	newSprite->h = h;
+	newSprite->frameNum = 0;
+}
+
+/** RayEngine_draw2DSprite
+ * @brief Renders a 2D sprite to the screen
+ * TODO: Consolidate w/ PixBuffer
+ * TODO: Better manage w/ 3D sprites
+ * @param buffer PixBuffer to render to
+ * @param sprite RaySprite to render
+ * @param angle Angle (rad) to render sprite at
+ * TODO: Add to sprite metadata
+ */
+void RayEngine_draw2DSprite(PixBuffer* buffer, RaySprite sprite, double angle)
+{
+	// First, compute screen-space sprite dimensions
+	double scaleWidth = sprite.texture->tileWidth*sprite.scaleFactor;
+	double scaleHeight = sprite.texture->tileHeight*sprite.scaleFactor;
+	int32_t boundSize = (uint32_t)(scaleWidth > scaleHeight ? scaleWidth*1.5 : scaleHeight*1.5);
+	// Then render sprite based on dimensions
+	int32_t texX;
+	int32_t texY;
+	double pixX;
+	double pixY;
+	uint32_t pixColor;
+	// For all pixels in bounding box (yes, I know the box can be more dynamically sized but
+	// I'm lazy and this will have to cut it for now)
+	for (int32_t i = -boundSize/2; i < boundSize/2; i++)
+	{
+		for (int32_t j = -boundSize/2; j < boundSize/2; j++)
+		{
+			texX = (int32_t)round((i * cos(angle) - j * sin(angle)) / sprite.scaleFactor + sprite.texture->tileWidth/2.0 - 0.5);
+			texY = (int32_t)round((i * sin(angle) + j * cos(angle)) / sprite.scaleFactor + sprite.texture->tileHeight/2.0 - 0.5);
+			pixX = sprite.x + i;
+			pixY = sprite.y + j;
+			if (pixX >= 0 && pixX < buffer->width && pixY >= 0 && pixY < buffer->height &&\
+				texX >= 0 && texX < sprite.texture->tileWidth && texY >=0 && texY < sprite.texture->tileHeight)
+			{
+				pixColor = PixBuffer_getTex(sprite.texture, 0, texX, texY);
+				PixBuffer_drawPixAlpha(buffer, pixX, pixY, pixColor, sprite.alphaNum);
+			}
+		}
+	}
+}
+
+//! Old
+/** RayEngine_drawMinimap
+ * @brief Renders minimap to screen
+ * !! Very depricated code, does not work, cannot delete (???)
+ * TODO: Please fix all of this
+ * @param buffer PixBuffer to render minimap to
+ * @param camera Active camera to render from
+ * ! Also depricated, does not do anything
+ * @param width Width of window
+ * ! Redundant, pre-buffer size
+ * @param height Height of window
+ * ! Ditto
+ * @param map Map to render
+ * @param blockSize Size of tiles on rendered map
+ */
+void RayEngine_drawMinimap(PixBuffer* buffer, Camera* camera, unsigned int width, unsigned int height, Map* map, int blockSize)
+{
+	SDL_Rect mapRect;
+	mapRect.w = map->width * blockSize;
+	mapRect.h = map->height * blockSize;
+	mapRect.x = width - mapRect.w;
+	mapRect.y = 0;
+	SDL_Rect blockRect;
+	blockRect.w = blockSize;
+	blockRect.h = blockSize;
+	SDL_Color backColor = {0x00, 0x00, 0x00, 0x40};
+	PixBuffer_drawRect(buffer, &mapRect, backColor);
+	//SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
+	//SDL_RenderDrawRect(renderer, &mapRect);
+	for (int i = 0; i < map->height; i++)
+	{
+		for (int j = 0; j < map->width; j++)
+		{
+			if (RayEngine_getTile(map, j, i) != 0)
+			{
+				blockRect.x = mapRect.x + j * blockSize;
+				blockRect.y = mapRect.y + i * blockSize;
+				SDL_Color blockColor = map->colorData[RayEngine_getTile(map, j, i) - 1];
+				PixBuffer_drawRect(buffer, &blockRect, blockColor);
+			}
+		}
+	}
+}
+
+//! Old
+/** RayEngine_deleteMap
+ * @brief Destroy Map
+ * TODO: Update & move to GameEngine
+ * !!! Very very very depricated, pre-color, does not do anything
+ * @param map Pointer to map array (pre-color, no Map struct)
+ * ! Do not feed it a Map struct
+ * @param width Width of map (in tiles)
+ * @param height Height of map (in tiles)
+ */
+void RayEngine_deleteMap(unsigned char** map, int width, int height)
+{
+	for (int i = 0; i < height; i++)
+	{
+		free(map[i]);
+	}
+	free(map);
+}
+
+/** RayEngine_initCamera
+ * @brief Initializes a Camera with empty column tables
+ * 
+ * @param newCamera Pointer to new Camera
+ * @param x Map x coordinate
+ * @param y Map y coordinate
+ * @param angle View angle (rad)
+ * @param fov Horizontal field of view (rad)
+ * @param dist View distance
+ */
+void RayEngine_initCamera(Camera* newCamera, double x, double y, double angle, double fov, double dist)
+{
+	memset(newCamera, 0, sizeof(Camera));
+	newCamera->x = x;
+	newCamera->y = y;
+	newCamera->angle = angle;
+	newCamera->fov = fov;
+	newCamera->dist = dist;
+	newCamera->columnStep = 1;
+	newCamera->lodDepthRatio = 0.25;
+}
+
+/** RayEngine_delCamera
+ * @brief Frees the column tables of a Camera
+ * 
+ * @param camera Camera to free tables of
+ */
+void RayEngine_delCamera(Camera* camera)
+{
+	free(camera->columnTan);
+	free(camera->columnCos);
+	free(camera->columnHits);
+	camera->columnTan = NULL;
+	camera->columnCos = NULL;
+	camera->columnHits = NULL;
+	camera->columnWidth = 0;
+	camera->columnCapacity = 0;
+}
+
+/** RayEngine_updateCameraColumns
+ * @brief Builds the per-column ray tables of a Camera
+ * * Does nothing if width and fov match the last build, so
+ * * renderers call it every frame
+ * @param camera Camera to build tables for (see RayEngine_initCamera)
+ * @param width Width in pixels to build tables for
+ */
+void RayEngine_updateCameraColumns(Camera* camera, uint32_t width)
+{
+	if (camera->columnWidth == width && camera->columnFov == camera->fov)
+	{
+		return;
+	}
+	if (width > camera->columnCapacity)
+	{
+		camera->columnTan = (double*)realloc(camera->columnTan, sizeof(double) * width);
+		camera->columnCos = (double*)realloc(camera->columnCos, sizeof(double) * width);
+		camera->columnHits = (RayHit*)realloc(camera->columnHits, sizeof(RayHit) * width);
+		camera->columnCapacity = width;
+	}
+	camera->columnWidth = width;
+	camera->columnFov = camera->fov;
+	camera->focalLength = (double)width / (2 * tan(camera->fov / 2));
+	for (uint32_t i = 0; i < width; i++)
+	{
+		// Column i looks through the right edge of its pixel
+		camera->columnTan[i] = ((double)i + 1 - width / 2) / camera->focalLength;
+		camera->columnCos[i] = 1.0 / sqrt(1.0 + camera->columnTan[i] * camera->columnTan[i]);
+	}
+}
+
+//! RayBuffer dependent
+/** RayEngine_initCoherence
+ * @brief Creates an empty ray coherence cache (see RayCoherence)
+ * 
+ * @param maxMove Furthest the camera may move between frames (map units)
+ *        and still reuse the cache
+ * @return RayCoherence* Cache to attach to camera->coherence
+ */
+RayCoherence* RayEngine_initCoherence(double maxMove)
+{
+	RayCoherence* coherence = (RayCoherence*)calloc(1, sizeof(RayCoherence));
+	coherence->maxMove = maxMove;
+	return coherence;
+}
+
+/** RayEngine_delCoherence
+ * @brief Frees a ray coherence cache
+ * 
+ * @param coherence RayCoherence to free
+ */
+void RayEngine_delCoherence(RayCoherence* coherence)
+{
+	free(coherence->clearDist);
+	free(coherence->nextClear);
+	free(coherence);
+}
+
+/** RayEngine_initInterlace
+ * @brief Creates interlaced rendering state (see RayInterlace)
+ * * The first frame is drawn in full to start the history
+ * @param depthRatio Largest relative depth difference a reprojected
+ *        pixel may have and still be reused
+ * @return RayInterlace* State to attach to camera->interlace
+ */
+RayInterlace* RayEngine_initInterlace(double depthRatio)
+{
+	RayInterlace* interlace = (RayInterlace*)calloc(1, sizeof(RayInterlace));
+	interlace->depthRatio = depthRatio;
+	return interlace;
+}
+
+/** RayEngine_delInterlace
+ * @brief Frees interlaced rendering state
+ * 
+ * @param interlace RayInterlace to free
+ */
+void RayEngine_delInterlace(RayInterlace* interlace)
+{
+	free(interlace->pixels);
+	free(interlace->depth);
+	free(interlace);
+}
+
+/** RayEngine_drawSpanLayers
+ * @brief Draws a column's kept translucent wall slices that lie behind a depth
+ * * Back to front, so later (nearer) draws land on top
+ * @param buffer DepthBuffer with RaySpans attached
+ * @param column Screen column
+ * @param depth Depth of what is drawn next, -1 for all remaining
+ */
+static void RayEngine_drawSpanLayers(DepthBuffer* buffer, uint32_t column, double depth)
+{
+	RaySpans* spans = buffer->spans;
+	RaySpanLayer* layers = &spans->layers[column * RAY_SPAN_LAYERS];
+	while (spans->numDrawn[column] < spans->numLayers[column])
+	{
+		RaySpanLayer* layer = &layers[spans->numLayers[column] - 1 - spans->numDrawn[column]];
+		if (layer->depth <= depth)
+		{
+			break;
+		}
+		RayEngine_drawTexColumn(
+			buffer, column, layer->y, layer->h, layer->depth,
+			spans->wallTex, layer->tile, 1.0,
+			layer->texCoord, layer->fade, FOG_COLOR
+		);
+		spans->numDrawn[column]++;
+	}
+}
+
+/** RayEngine_drawSprite
+ * @brief Draws a 3D sprite's columns, see RayEngine_draw3DSprite
+ */
+static void RayEngine_drawSprite(DepthBuffer* buffer, Camera* camera, uint32_t width, uint32_t height, RaySprite sprite)
+{
+	double scaleFactor = (double)width / (double)height * 2.4;
+	RayEngine_updateCameraColumns(camera, width);
+	// Sprite position along the view direction and the camera plane
+	double dirX = cos(camera->angle);
+	double dirY = sin(camera->angle);
+	double forward = (sprite.x - camera->x) * dirX + (sprite.y - camera->y) * dirY;
+	double side = (sprite.y - camera->y) * dirX - (sprite.x - camera->x) * dirY;
+	double spriteDist = forward / scaleFactor;
+	// Depth check, can't be on or behind camera
+	if (spriteDist > 0)
+	{
+		// Project onto the camera plane
+		int32_t centerX = (int32_t)floor(width / 2 + (int32_t)(camera->focalLength * side / forward));
+		// Get width and height
+		int32_t screenHeight;
+		int32_t screenWidth;
+		if (sprite.texture->tileHeight >= sprite.texture->tileWidth)
+		{
+			screenHeight = (int32_t)((double)height / (spriteDist * 5) * sprite.scaleFactor);
+			screenWidth = (int32_t)((double)screenHeight * ((double)sprite.texture->tileWidth / (double)sprite.texture->tileHeight));
+		}
+		else
+		{
+			screenWidth = (int32_t)ceil((double)height / (spriteDist * 5) * sprite.scaleFactor);
+			screenHeight = (int32_t)ceil((double)screenWidth * ((double)sprite.texture->tileHeight / (double)sprite.texture->tileWidth));
+		}
+		
+		int32_t spriteHeight = (int32_t)((sprite.h - camera->h) * height / (spriteDist * 5)); // I dunno why it's 40
+		int32_t startX = centerX - screenWidth / 2;
+		int32_t endX = startX + screenWidth;
+		int32_t startY = (int32_t)ceil((height / 2) - ((double)screenHeight / 2) - spriteHeight);
+		// Write to buffer if in fulcrum
+		if (startX <= (int32_t)width && endX >= 0)
+		{
+			RAY_STAT_ADD(buffer->stats, spritesDrawn, 1);
+			// Iterate through screen columns
+			uint32_t spriteColumn = 0;
+			uint32_t texCoord;
+			for (int32_t i = startX; i < endX; i++)
+			{
+				if (i >= 0 && i < width && !RayEngine_isColumnSkipped(camera, i))
+				{
+					double colorGrad;
+					double fogConstant = 1.5/5;
+					if (spriteDist < (camera->dist*fogConstant))
+					{
+						colorGrad = (spriteDist) / (camera->dist*fogConstant);
+					}
+					else
+					{
+						colorGrad = 1.0;
+					}
+					texCoord = (uint32_t)floor(((double)spriteColumn / (double)screenWidth) * sprite.texture->tileWidth);
+					if (buffer->spans)
+					{
+						RayEngine_drawSpanLayers(buffer, i, spriteDist);
+					}
+					RayEngine_drawTexColumn(
+						buffer, i, startY, screenHeight, spriteDist,
+						sprite.texture, sprite.frameNum, sprite.alphaNum,
+						texCoord, colorGrad, FOG_COLOR
+					);
+				}
+				spriteColumn++;
+			}
+		}
+		else
+		{
+			RAY_STAT_ADD(buffer->stats, spritesCulled, 1);
+		}
+	}
+	else
+	{
+		RAY_STAT_ADD(buffer->stats, spritesCulled, 1);
+	}
+}
+
+/** RayEngine_draw3DSprite
+ * @brief Renders 3D RaySprites for raycaster
+ * TODO: Update w/ DepthBuffer, consolidate w/ sprite struct better
+ * @param rayBuffer RayBuffer to render to
+ * ! Depricated, see DepthBuffer
+ * @param camera Camera to render from
+ * TODO: Update to make less jank
+ * @param width Window width (in pixels)
+ * ! Redundant
+ * @param height Window height (in pixels)
+ * ! Redundant
+ * @param resolution Raycast stepsize
+ * TODO: Use camera or engine parameter instead 
+ * @param sprite RaySprite to draw
+ */
+void RayEngine_draw3DSprite(DepthBuffer* buffer, Camera* camera, uint32_t width, uint32_t height, double resolution, RaySprite sprite)
+{
+	RaySpans* spans = buffer->spans;
+	if (!spans)
+	{
+		RayEngine_drawSprite(buffer, camera, width, height, sprite);
+		return;
+	}
+	// Kept for RayEngine_drawSpans, nearest last
+	double scaleFactor = (double)width / (double)height * 2.4;
+	double forward = (sprite.x - camera->x) * cos(camera->angle) + (sprite.y - camera->y) * sin(camera->angle);
+	if (spans->numSprites == spans->spriteCapacity)
+	{
+		spans->spriteCapacity = spans->spriteCapacity ? spans->spriteCapacity * 2 : 64;
+		spans->sprites = (RaySpanSprite*)realloc(spans->sprites, sizeof(RaySpanSprite) * spans->spriteCapacity);
+	}
+	RaySpanSprite* kept = &spans->sprites[spans->numSprites];
+	kept->sprite = sprite;
+	kept->depth = forward / scaleFactor;
+	kept->order = spans->numSprites++;
+}
+
+/** RayEngine_compareSpanSprites
+ * @brief qsort comparator, furthest first, then latest drawn first
+ */
+static int RayEngine_compareSpanSprites(const void* a, const void* b)
+{
+	const RaySpanSprite* spriteA = (const RaySpanSprite*)a;
+	const RaySpanSprite* spriteB = (const RaySpanSprite*)b;
+	if (spriteA->depth != spriteB->depth)
+	{
+		return spriteA->depth < spriteB->depth ? 1 : -1;
+	}
+	// Earlier sprites win depth ties in the depth tested path
+	if (spriteA->order != spriteB->order)
+	{
+		return spriteA->order < spriteB->order ? 1 : -1;
+	}
+	return 0;
+}
+
+/** RayEngine_drawSpans
+ * @brief Paints the sprites and translucent wall slices RaySpans kept
+ * * Call after walls, sprites and RayEngine_deferFloor (or after
+ * * RayEngine_texRenderFloor), in place of RayEngine_renderBuffer.
+ * * Sprites are drawn furthest first, each column's translucent
+ * * slices just before the first sprite in front of them
+ * @param buffer DepthBuffer with RaySpans attached
+ * @param camera Camera rendered
+ * @param width Width of buffer in pixels
+ * @param height Height of buffer in pixels
+ */
+void RayEngine_drawSpans(DepthBuffer* buffer, Camera* camera, uint32_t width, uint32_t height)
+{
+	RaySpans* spans = buffer->spans;
+	// Still paint the wall slices without any sprites
+	if (spans->numSprites)
+	{
+		qsort(spans->sprites, spans->numSprites, sizeof(RaySpanSprite), RayEngine_compareSpanSprites);
+	}
+	for (uint32_t s = 0; s < spans->numSprites; s++)
+	{
+		RayEngine_drawSprite(buffer, camera, width, height, spans->sprites[s].sprite);
+	}
+	for (uint32_t x = 0; x < width; x++)
+	{
+		RayEngine_drawSpanLayers(buffer, x, -1);
+	}
+	spans->numSprites = 0;
+}
+
+/** RayEngine_initTrace
+ * @brief Starts a grid traversal along a ray
+ * Shared by the renderer and gameplay queries. Only reads the
+ * map, so traces may run on any number of threads at once
+ * @param trace RayTrace state to initialize
+ * @param map Map to trace through
+ * @param x Map x coordinate of ray origin
+ * @param y Map y coordinate of ray origin
+ * @param dirX x direction of ray (need not be normalized)
+ * @param dirY y direction of ray (need not be normalized)
+ * @param maxDist Furthest distance to trace, in map units
+ */
+void RayEngine_initTrace(RayTrace* trace, Map* map, double x, double y, double dirX, double dirY, double maxDist)
+{
+	// A zero direction stays zero (no NaN), only the origin cell is hit
+	double dirLen = dirX != 0 || dirY != 0 ? sqrt(dirX*dirX + dirY*dirY) : 1;
+	trace->dirX = dirX / dirLen;
+	trace->dirY = dirY / dirLen;
+	trace->originX = x;
+	trace->originY = y;
+	trace->maxDist = maxDist;
+	trace->steps = 0;
+	trace->started = 0;
+	// Wrap origin into the map + border area
+	int32_t cellX = (int32_t)floor(x);
+	int32_t cellY = (int32_t)floor(y);
+	trace->mapX = RayEngine_wrapCoord(cellX, map->width, map->border);
+	trace->mapY = RayEngine_wrapCoord(cellY, map->height, map->border);
+	trace->offX = trace->mapX - cellX;
+	trace->offY = trace->mapY - cellY;
+	trace->stepX = trace->dirX < 0 ? -1 : 1;
+	trace->stepY = trace->dirY < 0 ? -1 : 1;
+	trace->deltaX = trace->dirX != 0 ? fabs(1.0 / trace->dirX) : INFINITY;
+	trace->deltaY = trace->dirY != 0 ? fabs(1.0 / trace->dirY) : INFINITY;
+	double fracX = x + trace->offX - trace->mapX;
+	double fracY = y + trace->offY - trace->mapY;
+	trace->sideX = (trace->dirX < 0 ? fracX : 1.0 - fracX) * trace->deltaX;
+	trace->sideY = (trace->dirY < 0 ? fracY : 1.0 - fracY) * trace->deltaY;
+}
+
+/** RayEngine_skipEmpty
+ * @brief Moves a trace across an empty occupancy block in one step
+ * * Leaves the trace on the last cell it would have crossed inside
+ * * the block, so the next step exits it as stepping cell by cell
+ * * would (rays exactly through a tile corner may round to the other
+ * * side). Whole empty chunks are skipped the same way.
+ * ! Current cell must be inside the map
+ */
+static inline void RayEngine_skipEmpty(RayTrace* trace, Map* map)
+{
+	uint32_t c = (trace->mapY >> MAP_CHUNK_SHIFT) * map->chunksX + (trace->mapX >> MAP_CHUNK_SHIFT);
+	uint32_t block = (((trace->mapY & MAP_CHUNK_MASK) >> MAP_BLOCK_SHIFT) << MAP_BLOCKS_SHIFT) | ((trace->mapX & MAP_CHUNK_MASK) >> MAP_BLOCK_SHIFT);
+	int32_t size;
+	if (!map->occupancy[c])
+	{
+		size = MAP_CHUNK_SIZE;
+	}
+	else if (!(map->occupancy[c] & (1ull << block)))
+	{
+		size = MAP_BLOCK_SIZE;
+	}
+	else
+	{
+		return;
+	}
+	int32_t minX = trace->mapX & ~(size - 1);
+	int32_t minY = trace->mapY & ~(size - 1);
+	int32_t maxX = minX + size > map->width ? map->width - 1 : minX + size - 1;
+	int32_t maxY = minY + size > map->height ? map->height - 1 : minY + size - 1;
+	// Cells left to cross before the ray leaves the block on each axis
+	int32_t cellsX = trace->stepX > 0 ? maxX - trace->mapX : trace->mapX - minX;
+	int32_t cellsY = trace->stepY > 0 ? maxY - trace->mapY : trace->mapY - minY;
+	double exitX = cellsX ? trace->sideX + cellsX * trace->deltaX : trace->sideX;
+	double exitY = cellsY ? trace->sideY + cellsY * trace->deltaY : trace->sideY;
+	int32_t crossX;
+	int32_t crossY;
+	// Same tie rule as the stepping loop, x only when strictly closer
+	if (exitX < exitY)
+	{
+		crossX = cellsX;
+		crossY = exitX >= trace->sideY ? (int32_t)floor((exitX - trace->sideY) / trace->deltaY) + 1 : 0;
+		crossY = crossY > cellsY ? cellsY : crossY;
+	}
+	else
+	{
+		crossY = cellsY;
+		crossX = exitY > trace->sideX ? (int32_t)ceil((exitY - trace->sideX) / trace->deltaX) : 0;
+		crossX = crossX > cellsX ? cellsX : crossX;
+	}
+	if (crossX)
+	{
+		trace->mapX += crossX * trace->stepX;
+		trace->sideX += crossX * trace->deltaX;
+	}
+	if (crossY)
+	{
+		trace->mapY += crossY * trace->stepY;
+		trace->sideY += crossY * trace->deltaY;
+	}
+	trace->steps++;
+}
+
+/** RayEngine_nextHit
+ * @brief Advances a trace to the next non-empty tile
+ * * Call repeatedly to walk through translucent tiles
+ * @param trace RayTrace state from RayEngine_initTrace
+ * @param map Map being traced
+ * @param hit Filled with tile, face, distance and point of hit
+ * @return uint8_t 1 if a tile was hit before maxDist, 0 otherwise
+ */
+uint8_t RayEngine_nextHit(RayTrace* trace, Map* map, RayHit* hit)
+{
+	double dist = 0;
+	uint8_t face = RF_INSIDE;
+	if (trace->started)
+	{
+		face = RF_LEFT;
+	}
+	trace->started = 1;
+	while (1)
+	{
+		if (face != RF_INSIDE)
+		{
+			// Step into next tile along whichever edge is closer
+			trace->steps++;
+			if (trace->sideX < trace->sideY)
+			{
+				dist = trace->sideX;
+				trace->sideX += trace->deltaX;
+				face = trace->stepX > 0 ? RF_LEFT : RF_RIGHT;
+				int32_t mapX = RayEngine_wrapX(map, trace->mapX + trace->stepX);
+				trace->offX += mapX - trace->mapX - trace->stepX;
+				trace->mapX = mapX;
+			}
+			else
+			{
+				dist = trace->sideY;
+				trace->sideY += trace->deltaY;
+				face = trace->stepY > 0 ? RF_TOP : RF_BOTTOM;
+				int32_t mapY = RayEngine_wrapY(map, trace->mapY + trace->stepY);
+				trace->offY += mapY - trace->mapY - trace->stepY;
+				trace->mapY = mapY;
+			}
+			if (dist >= trace->maxDist)
+			{
+				return 0;
+			}
+		}
+		// Unsigned compare also rejects the negative border coordinates
+		uint8_t inMap = (uint32_t)trace->mapX < (uint32_t)map->width && (uint32_t)trace->mapY < (uint32_t)map->height;
+		if (inMap && RayEngine_isSolid(map, trace->mapX, trace->mapY))
+		{
+			hit->tileX = trace->mapX;
+			hit->tileY = trace->mapY;
+			hit->tile = RayEngine_getTile(map, trace->mapX, trace->mapY);
+			hit->face = face;
+			hit->dist = dist;
+			hit->x = trace->originX + trace->offX + trace->dirX * dist;
+			hit->y = trace->originY + trace->offY + trace->dirY * dist;
+			return 1;
+		}
+		if (inMap)
+		{
+			RayEngine_skipEmpty(trace, map);
+		}
+		face = RF_LEFT;
+	}
+}
+
+/** RayEngine_getHitTexCoord
+ * @brief Finds texture column of a wall hit
+ * 
+ * @param texData Wall texture set
+ * @param hit Hit to find column of
+ * @return uint32_t Texture column
+ */
+static uint32_t RayEngine_getHitTexCoord(RayTex* texData, RayHit* hit)
+{
+	double part = hit->face > RF_RIGHT ? hit->x - hit->tileX : hit->y - hit->tileY;
+	uint32_t texCoord = (uint32_t)floor(part * texData->tileWidth);
+	return texCoord < texData->tileWidth ? texCoord : texData->tileWidth - 1;
+}
+
+/** RayEngine_isColumnTranslucent
+ * @brief Checks if any pixel of a texture column has alpha
+ * 
+ * @param texData Texture set
+ * @param tileNum Tile of texture set
+ * @param texCoord Column of tile
+ * @return uint8_t 1 if translucent, 0 if opaque
+ */
+static uint8_t RayEngine_isColumnTranslucent(RayTex* texData, uint8_t tileNum, uint32_t texCoord)
+{
+	for (uint32_t p = 0; p < texData->tileHeight; p++)
+	{
+		if ((texData->pixData[tileNum*texData->tileWidth*texData->tileHeight+texCoord+(texData->tileWidth*p)] & 0xFF) < 0xFF)
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/** RayEngine_castRays
+ * @brief Traces a batch of rays against the map (hitscan, visibility)
+ * Uses the same traversal as RayEngine_raycastRender. Safe to call
+ * from several threads at once on separate query/hit arrays
+ * @param map Map to trace through
+ * @param texData Wall textures, translucent columns are passed
+ *        through if given (NULL treats every tile as solid)
+ * @param queries Array of ray origins, directions and max distances
+ * @param hits Array of results, tile is 0 if nothing was hit
+ *        (dist is then the query's maxDist, or 0 if the direction
+ *        is zero)
+ * @param numQueries Length of queries and hits
+ */
+void RayEngine_castRays(Map* map, RayTex* texData, RayQuery* queries, RayHit* hits, uint32_t numQueries)
+{
+	RayTrace trace;
+	for (uint32_t q = 0; q < numQueries; q++)
 	{
-		for (int j = 0; j < map->width; j++)
+		RayHit* hit = &hits[q];
+		if (queries[q].dirX == 0 && queries[q].dirY == 0)
+		{
+			hit->tile = 0;
+			hit->face = RF_INSIDE;
+			hit->dist = 0;
+			hit->x = queries[q].x;
+			hit->y = queries[q].y;
+			hit->tileX = (int32_t)floor(hit->x);
+			hit->tileY = (int32_t)floor(hit->y);
+			continue;
+		}
+		RayEngine_initTrace(&trace, map, queries[q].x, queries[q].y, queries[q].dirX, queries[q].dirY, queries[q].maxDist);
+		uint8_t found = 0;
+		while (RayEngine_nextHit(&trace, map, hit))
 		{
-			if (map->data[i * map->width + j] != 0)
+			if (!texData || hit->face == RF_INSIDE || !RayEngine_isTranslucent(map, hit->tileX, hit->tileY) || \
+				!RayEngine_isColumnTranslucent(texData, RayEngine_getTexTile(texData, hit->tile), RayEngine_getHitTexCoord(texData, hit)))
 			{
-				blockRect.x = mapRect.x + j * blockSize;
-				blockRect.y = mapRect.y + i * blockSize;
-				SDL_Color blockColor = map->colorData[map->data[i * map->width + j] - 1];
-				PixBuffer_drawRect(buffer, &blockRect, blockColor);
+				found = 1;
+				break;
 			}
 		}
+		if (!found)
+		{
+			hit->tile = 0;
+			hit->face = RF_INSIDE;
+			hit->dist = queries[q].maxDist;
+			hit->x = queries[q].x + trace.dirX * queries[q].maxDist;
+			hit->y = queries[q].y + trace.dirY * queries[q].maxDist;
+			hit->tileX = (int32_t)floor(hit->x);
+			hit->tileY = (int32_t)floor(hit->y);
+		}
 	}
 }
 
-//! Old
-/** RayEngine_deleteMap
- * @brief Destroy Map
- * TODO: Update & move to GameEngine
- * !!! Very very very depricated, pre-color, does not do anything
- * @param map Pointer to map array (pre-color, no Map struct)
- * ! Do not feed it a Map struct
- * @param width Width of map (in tiles)
- * @param height Height of map (in tiles)
+/** RayEngine_lineOfSight
+ * @brief Checks whether two points can see each other
+ * 
+ * @param map Map to trace through
+ * @param texData Wall textures (see RayEngine_castRays)
+ * @param x0 Map x coordinate of viewer
+ * @param y0 Map y coordinate of viewer
+ * @param x1 Map x coordinate of target
+ * @param y1 Map y coordinate of target
+ * @return uint8_t 1 if nothing blocks the line, 0 otherwise
  */
-void RayEngine_deleteMap(unsigned char** map, int width, int height)
+uint8_t RayEngine_lineOfSight(Map* map, RayTex* texData, double x0, double y0, double x1, double y1)
 {
-	for (int i = 0; i < height; i++)
+	RayQuery query = {x0, y0, x1 - x0, y1 - y0, sqrt((x1-x0)*(x1-x0) + (y1-y0)*(y1-y0))};
+	RayHit hit;
+	if (query.maxDist == 0)
 	{
-		free(map[i]);
+		return 1;
 	}
-	free(map);
+	RayEngine_castRays(map, texData, &query, &hit, 1);
+	return hit.tile == 0;
+}
+
+/** RayEngine_drawWallHit
+ * @brief Draws the wall slice of one hit into a screen column
+ * 
+ * @param buffer DepthBuffer to draw to
+ * @param camera Camera the column was cast from
+ * @param column Screen column
+ * @param height Screen height
+ * @param scaleFactor Ray length to view distance factor
+ * @param hit Hit to draw
+ * @param texData Wall texture set
+ * @param texCoord Texture column of the hit
+ * @param opaque 1 if the slice hides everything behind it
+ */
+static void RayEngine_drawWallHit(DepthBuffer* buffer, Camera* camera, uint32_t column, uint32_t height, double scaleFactor, RayHit* hit, RayTex* texData, uint32_t texCoord, uint8_t opaque)
+{
+	uint8_t tileNum = RayEngine_getTexTile(texData, hit->tile);
+	double rayLen = hit->dist / scaleFactor;
+	double depth = rayLen * camera->columnCos[column];
+	//* Note: This is an awful mess but it is a temporary fix to get around rounding issues
+	int32_t drawHeight = (int32_t)ceil((double)height / (depth * 5));
+	int32_t wallHeight = (int32_t)round(-camera->h * drawHeight);
+	int32_t startY = height / 2 - drawHeight / 2 - wallHeight;
+	int32_t offsetStartY = height / 2 - drawHeight / 2;
+	int32_t deltaY = height - offsetStartY * 2;
+	double colorGrad;
+	double fogConstant = 1.5/5;
+	if (rayLen < (camera->dist*fogConstant))
+	{
+		colorGrad = (rayLen) / (camera->dist*fogConstant);
+	}
+	else
+	{
+		colorGrad = 1.0;
+	}
+	RaySpans* spans = buffer->spans;
+	if (spans && !opaque)
+	{
+		// Kept for RayEngine_drawSpans, nearest first
+		if (spans->numLayers[column] < RAY_SPAN_LAYERS)
+		{
+			RaySpanLayer layer = {depth, colorGrad, startY, deltaY, texCoord, tileNum};
+			spans->layers[column * RAY_SPAN_LAYERS + spans->numLayers[column]++] = layer;
+		}
+		return;
+	}
+	RayEngine_drawTexColumn(
+		buffer, column, startY, deltaY, depth,
+		texData, tileNum, 1.0, 
+		texCoord, colorGrad, FOG_COLOR
+	);
+	if (spans)
+	{
+		spans->top[column] = startY > 0 ? startY : 0;
+		spans->bottom[column] = startY + deltaY < (int32_t)height ? startY + deltaY : (int32_t)height;
+		spans->depth[column] = depth;
+	}
+}
+
+/** RayEngine_coherentStart
+ * @brief Finds how far a column's ray may jump through last frame's empty space
+ * * The ray is within `window` of its direction as seen from last
+ * * frame's camera once past nearDist (about RAY_COHERENCE_NEAR
+ * * for big moves), so it is clear up to the
+ * * smallest wedge radius over that window less the distance moved
+ * ! camera->coherence must be valid for this frame
+ * @param camera Camera to cast from
+ * @param column Screen column
+ * @param nearDist Set to the distance that has to be traced normally first
+ * @return double Distance to restart the trace from, 0 to trace it all
+ */
+static double RayEngine_coherentStart(Camera* camera, uint32_t column, double* nearDist)
+{
+	RayCoherence* coherence = camera->coherence;
+	double moveX = camera->x - coherence->x;
+	double moveY = camera->y - coherence->y;
+	double move = sqrt(moveX*moveX + moveY*moveY);
+	// Widen the window for big moves so the part traced normally stays short
+	double window = RAY_COHERENCE_WINDOW / camera->focalLength;
+	window = move / RAY_COHERENCE_NEAR > window ? move / RAY_COHERENCE_NEAR : window;
+	*nearDist = move > 0 ? move / sin(window) + move : 0;
+	double rayAngle = remainder(camera->angle - coherence->angle + atan(camera->columnTan[column]), 2 * M_PI);
+	if (fabs(rayAngle) + window >= M_PI / 2)
+	{
+		return 0;
+	}
+	// Last frame's columns either side of the window
+	double centre = 1 - (double)(camera->columnWidth / 2);
+	double lo = tan(rayAngle - window) * camera->focalLength - centre;
+	double hi = tan(rayAngle + window) * camera->focalLength - centre;
+	if (lo < 0 || hi > camera->columnWidth - 1)
+	{
+		return 0;
+	}
+	double clear = INFINITY;
+	for (int32_t j = (int32_t)floor(lo); j < (int32_t)ceil(hi); j++)
+	{
+		clear = coherence->clearDist[j] < clear ? coherence->clearDist[j] : clear;
+	}
+	double start = clear - move;
+	// Not worth a second trace for less than a tile
+	return start > *nearDist + 1 ? start : 0;
 }
 
-/** RayEngine_generateAngleValues
- * @brief Creates a pregenerated list of angle offsets for Camera
- * TODO: Consolidate w/ Camera struct and GameEngine code 
- * @param width Width in pixels to generate offsets for
- * @param camera Camera for offsets
+/** RayEngine_updateCoherence
+ * @brief Turns this frame's clear distances into wedge radii for the next
+ * * A tile can't fit inside the wedge between two rays nearer than
+ * * 1/angle, and one poking in through its far side reaches in at
+ * * most half the wedge's width, so (1 - angle) of the nearer ray's
+ * * clear distance is safe
+ * @param camera Camera that was rendered, with coherence attached
+ * @param map Map that was rendered
+ * @param width Screen width
  */
-void RayEngine_generateAngleValues(uint32_t width, Camera* camera)
+static void RayEngine_updateCoherence(Camera* camera, Map* map, uint32_t width)
 {
-	double adjFactor = (double)width / (2 * tan(camera->fov / 2));
-	camera->angleValues[0] = atan((width / 2) / adjFactor) - atan((width / 2 - 1) / adjFactor);
-	for (uint32_t i = 1; i < width; i++)
+	RayCoherence* coherence = camera->coherence;
+	// Nothing is known outside the first and last traced columns
+	int32_t a = -1;
+	for (int32_t b = 0; b < (int32_t)width; b++)
 	{
-		if(i < width / 2)
+		if (coherence->nextClear[b] < 0)
 		{
-			camera->angleValues[i] = camera->angleValues[i-1] + atan((width / 2 - i) / adjFactor) - atan((width / 2 - i - 1) / adjFactor);
+			continue;
 		}
-		else
+		if (a < 0)
 		{
-			camera->angleValues[i] = camera->angleValues[i-1] + atan((i + 1 - width / 2) / adjFactor) - atan((i - width / 2) / adjFactor);
+			for (int32_t j = 0; j < b; j++)
+			{
+				coherence->clearDist[j] = 0;
+			}
+			a = b;
+			continue;
+		}
+		double angle = atan(camera->columnTan[b]) - atan(camera->columnTan[a]);
+		double radius = coherence->nextClear[a] < coherence->nextClear[b] ? coherence->nextClear[a] : coherence->nextClear[b];
+		radius = radius < 1 / angle ? radius : 1 / angle;
+		double clear = radius * (1 - angle) - RAY_COHERENCE_EPSILON;
+		for (int32_t j = a; j < b; j++)
+		{
+			coherence->clearDist[j] = clear > 0 ? clear : 0;
 		}
+		a = b;
 	}
+	for (int32_t j = a > 0 ? a : 0; j < (int32_t)width; j++)
+	{
+		coherence->clearDist[j] = 0;
+	}
+	coherence->x = camera->x;
+	coherence->y = camera->y;
+	coherence->angle = camera->angle;
+	coherence->fov = camera->fov;
+	coherence->width = width;
+	coherence->map = map;
+	coherence->version = map->version;
+	coherence->valid = 1;
 }
 
-//! RayBuffer dependent
-/** RayEngine_draw3DSprite
- * @brief Renders 3D RaySprites for raycaster
- * TODO: Update w/ DepthBuffer, consolidate w/ sprite struct better
- * @param rayBuffer RayBuffer to render to
- * ! Depricated, see DepthBuffer
- * @param camera Camera to render from
- * TODO: Update to make less jank
- * @param width Window width (in pixels)
- * ! Redundant
- * @param height Window height (in pixels)
- * ! Redundant
- * @param resolution Raycast stepsize
- * TODO: Use camera or engine parameter instead 
- * @param sprite RaySprite to draw
+/** RayEngine_traceColumn
+ * @brief Traces and draws one screen column
+ * 
+ * @param buffer DepthBuffer to draw to
+ * @param camera Camera to cast from
+ * @param column Screen column
+ * @param height Screen height
+ * @param scaleFactor Ray length to view distance factor
+ * @param map Map to trace through
+ * @param texData Wall texture set
+ * @param first Filled with the column's LOD record: the hit if the
+ *        ray stopped at an opaque tile, tile 0 with dist INFINITY if
+ *        nothing was hit, tile 0 otherwise (can't be interpolated)
  */
-void RayEngine_draw3DSprite(DepthBuffer* buffer, Camera* camera, uint32_t width, uint32_t height, double resolution, RaySprite sprite)
+static void RayEngine_traceColumn(DepthBuffer* buffer, Camera* camera, uint32_t column, uint32_t height, double scaleFactor, Map* map, RayTex* texData, RayHit* first)
 {
-	double scaleFactor = (double)width / (double)height * 2.4;
-	// Generate screenspace angle mapping constant
-	const double angleMapConstant = (double)(width) / (2*tan(camera->fov/2));
-	// Render sprite to buffer
-	double spriteAngle = atan2(sprite.y - camera->y, sprite.x - camera->x);
-	double screenAngle = spriteAngle - camera->angle;
-	//printf("Sprite %d screen angle: %f\n", s, screenAngle);
-	double spriteDist = cos(screenAngle) * (sqrt((camera->x - sprite.x)*(camera->x - sprite.x) + (camera->y - sprite.y)*(camera->y - sprite.y))/scaleFactor);
-	// Depth check, can't be on or behind camera
-	if (spriteDist > 0)
+	double rayCos = camera->columnCos[column];
+	double dirX = cos(camera->angle);
+	double dirY = sin(camera->angle);
+	double rayDirX = (dirX - dirY * camera->columnTan[column]) * rayCos;
+	double rayDirY = (dirY + dirX * camera->columnTan[column]) * rayCos;
+	double maxDist = camera->dist * scaleFactor;
+	RayTrace trace;
+	RayHit hit;
+	uint32_t steps = 0;
+	double start = 0;
+	double nearDist;
+	if (camera->coherence && camera->coherence->valid)
 	{
-		// Compute column from screen angle
-		int32_t centerX = (int32_t)floor(width / 2 + (int32_t)(angleMapConstant * tan(screenAngle)));
-		// Get width and height
-		int32_t screenHeight;
-		int32_t screenWidth;
-		if (sprite.texture->tileHeight >= sprite.texture->tileWidth)
+		start = RayEngine_coherentStart(camera, column, &nearDist);
+	}
+	if (start > 0)
+	{
+		// Trace the cells around the camera, then jump ahead
+		RayEngine_initTrace(&trace, map, camera->x, camera->y, rayDirX, rayDirY, nearDist);
+		start = RayEngine_nextHit(&trace, map, &hit) ? 0 : start;
+		steps = trace.steps;
+	}
+	RayEngine_initTrace(&trace, map, camera->x + rayDirX * start, camera->y + rayDirY * start, rayDirX, rayDirY, maxDist - start);
+	int collisions = 0;
+	// Deeper KBuffers get to see through more translucent walls
+	int maxCollisions = buffer->kbuffer && buffer->kbuffer->layers > RAY_SPAN_LAYERS ? buffer->kbuffer->layers : RAY_SPAN_LAYERS;
+	uint32_t numHits = 0;
+	double clear = maxDist;
+	first->tile = 0;
+	first->dist = 0;
+	while (collisions < maxCollisions && RayEngine_nextHit(&trace, map, &hit))
+	{
+		RAY_STAT_ADD(buffer->stats, rayHits, 1);
+		hit.dist += start;
+		if (!numHits++)
 		{
-			screenHeight = (int32_t)((double)height / (spriteDist * 5) * sprite.scaleFactor);
-			screenWidth = (int32_t)((double)screenHeight * ((double)sprite.texture->tileWidth / (double)sprite.texture->tileHeight));
+			clear = hit.dist;
 		}
-		else
+		if (hit.face == RF_INSIDE)
 		{
-			screenWidth = (int32_t)ceil((double)height / (spriteDist * 5) * sprite.scaleFactor);
-			screenHeight = (int32_t)ceil((double)screenWidth * ((double)sprite.texture->tileHeight / (double)sprite.texture->tileWidth));
+			// Camera is inside a wall, nothing to see
+			break;
 		}
-		
-		int32_t spriteHeight = (int32_t)((sprite.h - camera->h) * height / (spriteDist * 5)); // I dunno why it's 40
-		int32_t startX = centerX - screenWidth / 2;
-		int32_t endX = startX + screenWidth;
-		int32_t startY = (int32_t)ceil((height / 2) - ((double)screenHeight / 2) - spriteHeight);
-		// Write to buffer if in fulcrum
-		if (startX <= (int32_t)width && endX >= 0)
+		uint32_t texCoord = RayEngine_getHitTexCoord(texData, &hit);
+		uint8_t translucent = RayEngine_isTranslucent(map, hit.tileX, hit.tileY);
+		uint8_t ends = !translucent || !RayEngine_isColumnTranslucent(texData, RayEngine_getTexTile(texData, hit.tile), texCoord);
+		RayEngine_drawWallHit(buffer, camera, column, height, scaleFactor, &hit, texData, texCoord, ends);
+		// Carry on through translucent columns
+		if (!translucent)
 		{
-			// Iterate through screen columns
-			uint32_t spriteColumn = 0;
-			uint32_t texCoord;
-			for (int32_t i = startX; i < endX; i++)
+			if (!collisions)
 			{
-				if (i >= 0 && i < width)
-				{
-					double colorGrad;
-					double fogConstant = 1.5/5;
-					if (spriteDist < (camera->dist*fogConstant))
-					{
-						colorGrad = (spriteDist) / (camera->dist*fogConstant);
-					}
-					else
-					{
-						colorGrad = 1.0;
-					}
-					texCoord = (uint32_t)floor(((double)spriteColumn / (double)screenWidth) * sprite.texture->tileWidth);
-					RayEngine_drawTexColumn(
-						buffer, i, startY, screenHeight, spriteDist,
-						sprite.texture, sprite.frameNum, sprite.alphaNum,
-						texCoord, colorGrad, FOG_COLOR
-					);
-				}
-				spriteColumn++;
+				*first = hit;
 			}
+			break;
+		}
+		if (ends)
+		{
+			break;
 		}
+		collisions++;
+	}
+	if (!numHits)
+	{
+		first->dist = INFINITY;
+	}
+	if (camera->coherence)
+	{
+		camera->coherence->nextClear[column] = clear;
+	}
+	steps += trace.steps;
+	RAY_STAT_ADD(buffer->stats, rays, 1);
+	RAY_STAT_ADD(buffer->stats, cellsVisited, steps);
+	RAY_STAT_ADD(buffer->stats, columnSteps[column], steps);
+}
+
+/** RayEngine_fillColumn
+ * @brief Draws a skipped LOD column from the traced columns either side
+ * * Walls are planes, so 1/depth and position/depth are linear across
+ * * the screen and the filled hit matches what a ray would find,
+ * * unless something narrower than the gap hides between the two
+ * @param buffer DepthBuffer to draw to
+ * @param camera Camera with traced columnHits
+ * @param column Screen column to fill
+ * @param left Traced column left of column
+ * @param right Traced column right of column
+ * @param height Screen height
+ * @param scaleFactor Ray length to view distance factor
+ * @param texData Wall texture set
+ * @return uint8_t 1 if filled, 0 if the column must be traced
+ */
+static uint8_t RayEngine_fillColumn(DepthBuffer* buffer, Camera* camera, uint32_t column, uint32_t left, uint32_t right, uint32_t height, double scaleFactor, RayTex* texData)
+{
+	RayHit* a = &camera->columnHits[left];
+	RayHit* b = &camera->columnHits[right];
+	if (!a->tile || !b->tile)
+	{
+		// Both rays missed everything, so does this one
+		return !a->tile && !b->tile && a->dist == INFINITY && b->dist == INFINITY;
+	}
+	uint8_t alongX = a->face > RF_RIGHT;
+	if (a->tile != b->tile || a->face != b->face || \
+		(alongX ? a->tileY != b->tileY || abs(a->tileX - b->tileX) > 1 : a->tileX != b->tileX || abs(a->tileY - b->tileY) > 1))
+	{
+		return 0;
+	}
+	// Perpendicular depths of both ends
+	double depthA = a->dist * camera->columnCos[left];
+	double depthB = b->dist * camera->columnCos[right];
+	if (fabs(depthA - depthB) > camera->lodDepthRatio * (depthA < depthB ? depthA : depthB))
+	{
+		return 0;
+	}
+	double f = (double)(column - left) / (double)(right - left);
+	double posA = alongX ? a->x : a->y;
+	double posB = alongX ? b->x : b->y;
+	double invDepth = (1 - f) / depthA + f / depthB;
+	double pos = ((1 - f) * posA / depthA + f * posB / depthB) / invDepth;
+	// Keep rounding from stepping outside the two tiles
+	int32_t minTile = alongX ? (a->tileX < b->tileX ? a->tileX : b->tileX) : (a->tileY < b->tileY ? a->tileY : b->tileY);
+	int32_t maxTile = alongX ? (a->tileX > b->tileX ? a->tileX : b->tileX) : (a->tileY > b->tileY ? a->tileY : b->tileY);
+	pos = pos < minTile ? minTile : (pos > maxTile + 0.999999 ? maxTile + 0.999999 : pos);
+	RayHit hit = *a;
+	hit.dist = 1 / invDepth / camera->columnCos[column];
+	if (alongX)
+	{
+		hit.x = pos;
+		hit.tileX = (int32_t)floor(pos);
+	}
+	else
+	{
+		hit.y = pos;
+		hit.tileY = (int32_t)floor(pos);
 	}
+	RayEngine_drawWallHit(buffer, camera, column, height, scaleFactor, &hit, texData, RayEngine_getHitTexCoord(texData, &hit), 1);
+	return 1;
 }
 
 //! RayBuffer dependent
 void RayEngine_raycastRender(DepthBuffer* buffer, Camera* camera, uint32_t width, uint32_t height, Map* map, double resolution, RayTex* texData)
 {
-	// Establish starting angle and sweep per column
-	double startAngle = camera->angle - camera->fov / 2.0;
-	double adjFactor = width / (2 * tan(camera->fov / 2));
+	if (buffer->spans)
+	{
+		buffer->spans->wallTex = texData;
+	}
+	// Establish view direction, columns offset along the camera plane
 	double scaleFactor = (double)width / (double)height * 2.4;
-	double rayAngle = startAngle;
-	// Sweeeeep for each column
-	#pragma omp parallel for schedule(dynamic,1) private(rayAngle)
-	for (int i = 0; i < width; i++)
+	RayEngine_updateCameraColumns(camera, width);
+	int step = camera->columnStep > 1 ? (int)camera->columnStep : 1;
+	RayCoherence* coherence = camera->coherence;
+	if (coherence)
 	{
-		rayAngle = startAngle + camera->angleValues[i];
-		double rayX = camera->x;
-		double rayY = camera->y;
-		double rayStepX = (resolution) * cos(rayAngle);
-		double rayStepY = (resolution) * sin(rayAngle);
-		double stepLen = (resolution) / scaleFactor;
-		double rayLen = 0;
-		int rayStep = 0;
-		int rayOffX = 0;
-		int rayOffY = 0;
-		int collisions = 0;
-		while (rayLen < camera->dist && collisions < 3)
-		{
-			int coordX = (int)floor(rayX+rayOffX);
-			int coordY = (int)floor(rayY+rayOffY);
-			if ((coordX >= 0.0 && coordY >= 0.0) && (coordX < map->width && coordY < map->height) && (map->data[coordY * map->width + coordX] != 0))
-			{
-				uint8_t mapTile = map->data[coordY * map->width + coordX];
-				uint32_t texCoord;
-				SDL_Color colorDat = {0,0,0,255};
-				if (rayLen != 0)
-				{
-					uint8_t side;
-					double newX;
-					double newY;
-					double rayLen = sqrt(getInterDist(rayStepX, rayStepY, camera->x + rayOffX, camera->y + rayOffY, (double)coordX, (double)coordY, &newX, &newY, &side))/scaleFactor;
-					uint32_t texCoord;
-					if (side > 1)
-					{
-						texCoord = (uint32_t)floor((newX - coordX) * texData->tileWidth);
-					}
-					else
-					{
-						texCoord = (uint32_t)floor((newY - coordY) * texData->tileWidth);
-					}
-					double depth = (double)(rayLen * cos(rayAngle - camera->angle));
-					//double colorGrad = (depth) / camera->dist;
-					//* Note: This is an awful mess but it is a temporary fix to get around rounding issues
-					int32_t drawHeight = (int32_t)ceil((double)height / (depth * 5));
-					int32_t wallHeight = (int32_t)round(-camera->h * drawHeight);
-					int32_t startY = height / 2 - drawHeight / 2 - wallHeight;
-					int32_t offsetStartY = height / 2 - drawHeight / 2;
-					int32_t deltaY = height - offsetStartY * 2;
-					//SDL_Color fadeColor = {77,150,154,255};
-					double colorGrad;
-					double fogConstant = 1.5/5;
-					if (rayLen < (camera->dist*fogConstant))
-					{
-						colorGrad = (rayLen) / (camera->dist*fogConstant);
-					}
-					else
-					{
-						colorGrad = 1.0;
-					}
-					RayEngine_drawTexColumn(
-						buffer, i, startY, deltaY, depth,
-						texData, mapTile - 1, 1.0, 
-						texCoord, colorGrad, FOG_COLOR
-					);
-					// Check for texture column transparency
-					uint8_t hasAlpha = 0;
-					for (int p = 0; p < texData->tileHeight; p++)
-					{
-						if ((texData->pixData[(mapTile-1)*texData->tileWidth*texData->tileHeight+texCoord+(texData->tileWidth*p)] & 0xFF) < 0xFF)
-						{
-							collisions++;
-							if (side == 0) // Hit from left
-							{
-								rayX += 1;
-								rayY += rayStepY * (1.0/rayStepX);
-							}
-							else if (side == 1) // Hit from right
-							{
-								rayX -= 1;
-								rayY -= rayStepY * (1.0/rayStepX);
-							}
-							else if (side == 2) // Hit from top
-							{
-								rayX += rayStepX * (1.0/rayStepY);
-								rayY += 1;
-							}
-							else // Hit from bottom
-							{
-								rayX -= rayStepX * (1.0/rayStepY);
-								rayY -= 1;
-							}
-							if (rayX+rayOffX < -map->border)
-							{
-								rayOffX += map->width + map->border * 2;
-							}
-							else if (rayX+rayOffX >= map->width + map->border)
-							{
-								rayOffX -= map->width + map->border * 2;
-							}
-							if (rayY+rayOffY < -map->border)
-							{
-								rayOffY += map->height + map->border*2;
-							}
-							else if (rayY+rayOffY >= map->height + map->border)
-							{
-								rayOffY -= map->height + map->border*2;
-							}
-							rayLen = sqrt((rayX-camera->x)*(rayX-camera->x) + (rayY-camera->y)*(rayY-camera->y));
-							rayStep++;
-							hasAlpha = 1;
-							break;
-						}
-					}
-					if (hasAlpha)
-					{
-						continue;
-					}
-				}
-				break;
-			}
-			rayX += rayStepX;
-			rayY += rayStepY;
-			if (rayX+rayOffX < -map->border)
-			{
-				rayOffX += map->width + map->border * 2;
-			}
-			else if (rayX+rayOffX >= map->width + map->border)
+		if (coherence->capacity < width)
+		{
+			coherence->clearDist = (double*)realloc(coherence->clearDist, sizeof(double) * width);
+			coherence->nextClear = (double*)realloc(coherence->nextClear, sizeof(double) * width);
+			coherence->capacity = width;
+			coherence->valid = 0;
+		}
+		double moveX = camera->x - coherence->x;
+		double moveY = camera->y - coherence->y;
+		coherence->valid = coherence->valid && coherence->width == width && coherence->fov == camera->fov && \
+			coherence->map == map && coherence->version == map->version && \
+			moveX*moveX + moveY*moveY <= coherence->maxMove * coherence->maxMove;
+	}
+	if (camera->interlace && camera->interlace->active)
+	{
+		// Sweeeeep for each column of this field (no LOD, the gaps would be too wide)
+		int field = (int)camera->interlace->field;
+		#pragma omp parallel for schedule(dynamic,1)
+		for (int i = field; i < width; i += 2)
+		{
+			RayEngine_traceColumn(buffer, camera, i, height, scaleFactor, map, texData, &camera->columnHits[i]);
+		}
+		if (coherence)
+		{
+			for (int i = !field; i < width; i += 2)
 			{
-				rayOffX -= map->width + map->border * 2;
+				coherence->nextClear[i] = -1;
 			}
-			if (rayY+rayOffY < -map->border)
+			RayEngine_updateCoherence(camera, map, width);
+		}
+		return;
+	}
+	// Sweeeeep for each column (every step-th column and the last one first)
+	#pragma omp parallel for schedule(dynamic,1)
+	for (int i = 0; i < width + step - 1; i += step)
+	{
+		int column = i < width ? i : width - 1;
+		RayEngine_traceColumn(buffer, camera, column, height, scaleFactor, map, texData, &camera->columnHits[column]);
+	}
+	if (step > 1)
+	{
+		// Fill in between traced columns, tracing where they disagree
+		#pragma omp parallel for schedule(dynamic,16)
+		for (int i = 0; i < width - 1; i++)
+		{
+			int left = i - i % step;
+			int right = left + step < width ? left + step : width - 1;
+			if (i == left)
 			{
-				rayOffY += map->height + map->border*2;
+				continue;
 			}
-			else if (rayY+rayOffY >= map->height + map->border)
+			if (RayEngine_fillColumn(buffer, camera, i, left, right, height, scaleFactor, texData))
 			{
-				rayOffY -= map->height + map->border*2;
+				if (coherence)
+				{
+					// Nothing known about the filled ray's path
+					coherence->nextClear[i] = -1;
+				}
+				continue;
 			}
-			rayStep++;
-			rayLen += stepLen;
+			RayHit first;
+			RayEngine_traceColumn(buffer, camera, i, height, scaleFactor, map, texData, &first);
 		}
 	}
+	if (coherence)
+	{
+		RayEngine_updateCoherence(camera, map, width);
+	}
 }
 
-/** getInterDist
- * @brief Compute linear interpolation of ray intersect with wall
+/** RayEngine_rowDepth
+ * @brief Depth of pixels in a row that show no wall or sprite
+ * * Below the horizon they are floor (see RayEngine_texRenderFloor),
+ * * above it sky
+ */
+static double RayEngine_rowDepth(Camera* camera, uint32_t height, uint32_t y)
+{
+	if (y > height / 2 + 1)
+	{
+		return (double)height * (1 + 2 * camera->h) / (10.0 * (y - height / 2 - 1));
+	}
+	return INFINITY;
+}
+
+/** RayEngine_reprojectPixel
+ * @brief Looks a pixel up in the last interlaced frame, given its depth
  * 
- * @param dx x displacement along ray step
- * @param dy y displacement along ray step
- * @param xi Initial x coordinate
- * @param yi Initial y coordinate
- * @param coordX Grid tile x coordinate
- * @param coordY Grid tile y coordinate
- * @param newX Interpolated x coordinate
- * @param newY Interpolated y coordinate
- * @param side Numerical representation of side of intersect
- * @return double Adjusted distance to intersect
- */
-double getInterDist(double dx, double dy, double xi, double yi, double coordX, double coordY, double* newX, double* newY, uint8_t* side)
-{
-	// Check side intercepts first
-	double slope = (dy/dx);
-	double leftCoord = slope * (coordX - xi) + yi;
-	double rightCoord = slope * (coordX + 1 - xi) + yi;
-	slope = (dx/dy);
-	double topCoord = slope * (coordY - yi) + xi;
-	double bottomCoord = slope * (coordY + 1 - yi) + xi;
-	double dist;
-	double minDist = -1;
-	
-	if ((int)floor(leftCoord) == (int)coordY) // Left side
+ * @param interlace RayInterlace holding the last frame
+ * @param camera Camera being rendered
+ * @param y Screen row
+ * @param depth Depth the pixel is assumed to have
+ * @param stepX World x moved per unit of depth along the pixel's column
+ * @param stepY World y moved per unit of depth along the pixel's column
+ * @param scaleFactor Ray length to view distance factor
+ * @param color Set to the last frame's color if found
+ * @return uint8_t 1 if found with a matching depth, 0 otherwise
+ */
+static uint8_t RayEngine_reprojectPixel(RayInterlace* interlace, Camera* camera, uint32_t y, double depth, double stepX, double stepY, double scaleFactor, uint32_t* color)
+{
+	if (depth == INFINITY)
+	{
+		return 0;
+	}
+	// World point, then into the last frame's camera space
+	double relX = camera->x + stepX * depth - interlace->x;
+	double relY = camera->y + stepY * depth - interlace->y;
+	double forward = relX * interlace->dirX + relY * interlace->dirY;
+	double side = relY * interlace->dirX - relX * interlace->dirY;
+	if (forward <= 0)
+	{
+		return 0;
+	}
+	double invForward = 1.0 / forward;
+	double lastDepth = forward / scaleFactor;
+	double halfHeight = (double)(interlace->height / 2);
+	// Column i looks along tan = (i + 1 - width / 2) / focalLength
+	double lastX = side * invForward * camera->focalLength + (double)(interlace->width / 2) - 0.5;
+	double lastY = halfHeight + (((double)y - halfHeight) * depth + \
+		(interlace->h - camera->h) * interlace->height / 5) * scaleFactor * invForward + 0.5;
+	// Range checked first, so truncating rounds down
+	if (lastX < 0 || lastX >= interlace->width || lastY < 0 || lastY >= interlace->height)
+	{
+		return 0;
+	}
+	uint32_t index = (uint32_t)lastX + (uint32_t)lastY * interlace->width;
+	if (fabs(interlace->depth[index] - lastDepth) > interlace->depthRatio * lastDepth)
+	{
+		return 0;
+	}
+	*color = interlace->pixels[index];
+	return 1;
+}
+
+/** RayEngine_reconstructInterlace
+ * @brief Fills the columns interlacing skipped and keeps the frame
+ * * Call after RayEngine_renderBuffer, before post processing. Each
+ * * skipped pixel tries the depths of its left and right neighbours,
+ * * reprojected into the last frame, and averages the neighbours if
+ * * neither lands on a matching depth. Moving sprites reproject as if
+ * * still, the depth check catches most of them.
+ * @param buffer Composited DepthBuffer
+ * @param camera Camera rendered, with interlace attached
+ */
+void RayEngine_reconstructInterlace(DepthBuffer* buffer, Camera* camera)
+{
+	RayInterlace* interlace = camera->interlace;
+	PixBuffer* pixels = buffer->pixelBuffer;
+	uint32_t width = pixels->width;
+	uint32_t height = pixels->height;
+	double scaleFactor = (double)width / (double)height * 2.4;
+	uint8_t sameView = interlace->width == width && interlace->height == height && interlace->fov == camera->fov;
+	double dirX = cos(camera->angle);
+	double dirY = sin(camera->angle);
+	RayEngine_updateCameraColumns(camera, width);
+	if (interlace->active && width > 1)
 	{
-		minDist = (xi - coordX)*(xi - coordX) + (yi - leftCoord)*(yi - leftCoord);
-		*side = 0;
-		*newX = coordX;
-		*newY = leftCoord;
+		#pragma omp parallel for schedule(dynamic,8)
+		for (int y = 0; y < height; y++)
+		{
+			uint32_t* row = pixels->pixels + y * width;
+			double* rowDepth = buffer->pixelDepth + y * width;
+			double floorDepth = RayEngine_rowDepth(camera, height, y);
+			for (uint32_t x = !interlace->field; x < width; x += 2)
+			{
+				uint32_t left = x > 0 ? x - 1 : x + 1;
+				uint32_t right = x + 1 < width ? x + 1 : x - 1;
+				double leftDepth = rowDepth[left] == INFINITY ? floorDepth : rowDepth[left];
+				double rightDepth = rowDepth[right] == INFINITY ? floorDepth : rowDepth[right];
+				// Depth to world, see RayEngine_traceColumn
+				double stepX = (dirX - dirY * camera->columnTan[x]) * scaleFactor;
+				double stepY = (dirY + dirX * camera->columnTan[x]) * scaleFactor;
+				uint32_t color;
+				double depth = leftDepth;
+				uint8_t found = sameView && RayEngine_reprojectPixel(interlace, camera, y, leftDepth, stepX, stepY, scaleFactor, &color);
+				if (!found && sameView && rightDepth != leftDepth)
+				{
+					depth = rightDepth;
+					found = RayEngine_reprojectPixel(interlace, camera, y, rightDepth, stepX, stepY, scaleFactor, &color);
+				}
+				if (!found)
+				{
+					// Spatial fallback, halfway between the neighbours
+					uint32_t a = row[left];
+					uint32_t b = row[right];
+					color = ((a >> 1) & 0x7F7F7F7F) + ((b >> 1) & 0x7F7F7F7F) + (a & b & 0x01010101);
+					depth = leftDepth < rightDepth ? leftDepth : rightDepth;
+				}
+				row[x] = color;
+				rowDepth[x] = depth;
+			}
+		}
 	}
-	dist = (coordX + 1 - xi)*(coordX + 1 - xi) + (rightCoord - yi)*(rightCoord - yi);
-	if ((int)floor(rightCoord) == (int)coordY && (dist < minDist || minDist == -1)) // Right side
+	// Keep this frame for the next one
+	if (!sameView)
 	{
-		minDist = dist;
-		*side = 1;
-		*newX = coordX + 1;
-		*newY = rightCoord;
+		interlace->pixels = (uint32_t*)realloc(interlace->pixels, sizeof(uint32_t) * width * height);
+		interlace->depth = (double*)realloc(interlace->depth, sizeof(double) * width * height);
 	}
-	dist = (xi - topCoord)*(xi - topCoord) + (yi - coordY)*(yi - coordY);
-	if ((int)floor(topCoord) == (int)coordX && (dist < minDist || minDist == -1)) // Top side
+	memcpy(interlace->pixels, pixels->pixels, sizeof(uint32_t) * width * height);
+	#pragma omp parallel for
+	for (int y = 0; y < height; y++)
 	{
-		minDist = dist;
-		*side = 2;
-		*newX = topCoord;
-		*newY = coordY;
+		double* rowDepth = buffer->pixelDepth + y * width;
+		double floorDepth = RayEngine_rowDepth(camera, height, y);
+		for (uint32_t x = 0; x < width; x++)
+		{
+			interlace->depth[x + y * width] = rowDepth[x] == INFINITY ? floorDepth : rowDepth[x];
+		}
 	}
-	dist = (xi - bottomCoord)*(xi - bottomCoord) + (yi - coordY - 1)*(yi - coordY - 1);
-	if ((int)floor(bottomCoord) == (int)coordX && (dist < minDist || minDist == -1)) // Bottom side
+	interlace->width = width;
+	interlace->height = height;
+	interlace->fov = camera->fov;
+	interlace->x = camera->x;
+	interlace->y = camera->y;
+	interlace->h = camera->h;
+	interlace->angle = camera->angle;
+	interlace->dirX = dirX;
+	interlace->dirY = dirY;
+	interlace->field = !interlace->field;
+	// A single column has no neighbours to rebuild from
+	interlace->active = width > 1;
+}
+
+/** RayEngine_getLayerTile
+ * @brief Looks up the texture tile of a floor or ceiling layer
+ * 
+ * @param map Map owning the layer (may be NULL)
+ * @param layer Map floorData or ceilingData (may be NULL)
+ * @param x Map x coordinate
+ * @param y Map y coordinate
+ * @param defaultTile Tile to use where the layer is empty or missing
+ * @return uint8_t Texture tile number
+ */
+static uint8_t RayEngine_getLayerTile(Map* map, unsigned char* layer, double x, double y, uint8_t defaultTile)
+{
+	if (!map || !layer || x < 0 || y < 0 || x >= map->width || y >= map->height)
 	{
-		minDist = dist;
-		*side = 3;
-		*newX = bottomCoord;
-		*newY = coordY + 1;
+		return defaultTile;
 	}
-	return minDist;
+	unsigned char tile = layer[(int32_t)y * map->width + (int32_t)x];
+	return tile ? tile - 1 : defaultTile;
 }
 
 /** RayEngine_texRenderFloor
  * @brief Renders raycasted floor
  * TODO: Add depth
- * TODO: Make mappable
  * TODO: Make multilayer
  * TODO: Consolidate w/ floor renderer
  * @param buffer PixBuffer to render to
  * @param camera Camera to render from
  * @param width Width of pixbuffer in pixels
  * @param height Height of pixbuffer in pixels
- * @param groundMap Tile map to render from
- * ! Doesn't do anything atm
- * TODO: Integrate with main map
+ * @param groundMap Map whose floorData picks the tile (NULL for tileNum everywhere)
  * @param resolution ???
  * TODO: Remove, does nothing
  * @param texData Texture to render to floor
- * @param tileNum Number of tile from texture set to render
- * TODO: Placeholder, remove when mapping added
+ * @param tileNum Tile to render where floorData is empty
  */
 void RayEngine_texRenderFloor(PixBuffer* buffer, Camera* camera, uint32_t width, uint32_t height, Map* groundMap, double resolution, RayTex* texData, uint8_t tileNum)
 {
@@ -732,18 +2722,26 @@ void RayEngine_texRenderFloor(PixBuffer* buffer, Camera* camera, uint32_t width,
 	uint32_t texX;
 	uint32_t texY;
 
-	double startAngle = camera->angle - camera->fov / 2.0;
-	double rayAngle;
+	RayEngine_updateCameraColumns(camera, width);
+	double dirX = cos(camera->angle);
+	double dirY = sin(camera->angle);
 	double rayCos;
+	double rayDirX;
+	double rayDirY;
 
 	SDL_Color fadeColor = FOG_COLOR;
 	
 	// iterate through *all* pixels...
 	for (int x = startX; x < width; x++)
 	{
-		// Establish angle of column...
-		rayAngle = startAngle + camera->angleValues[x];
-		rayCos = cos(rayAngle - camera->angle);
+		if (RayEngine_isColumnSkipped(camera, x))
+		{
+			continue;
+		}
+		// Establish direction of column...
+		rayCos = camera->columnCos[x];
+		rayDirX = (dirX - dirY * camera->columnTan[x]) * rayCos;
+		rayDirY = (dirY + dirX * camera->columnTan[x]) * rayCos;
 
 		for (int y = startY + 1; y < height; y++)
 		{
@@ -752,8 +2750,8 @@ void RayEngine_texRenderFloor(PixBuffer* buffer, Camera* camera, uint32_t width,
 			double fogConstant = 4.0/5;
 			pixelDepth = (pixelDist * rayCos);
 			fadePercent = pixelDist / (camera->dist * fogConstant);
-			pixelX = camera->x + pixelDist * cos(rayAngle);
-			pixelY = camera->y + pixelDist * sin(rayAngle);
+			pixelX = camera->x + pixelDist * rayDirX;
+			pixelY = camera->y + pixelDist * rayDirY;
 			// Wow, is that really it? The math says so...
 			int r;
 			int g;
@@ -764,7 +2762,7 @@ void RayEngine_texRenderFloor(PixBuffer* buffer, Camera* camera, uint32_t width,
 				// TODO: some grid code...
 				texX = (uint32_t)floor((double)texData->tileWidth * (pixelX - floor(pixelX)));
 				texY = (uint32_t)floor((double)texData->tileHeight * (pixelY - floor(pixelY)));
-				uint32_t pixColor = texData->pixData[tileNum * texData->tileWidth * texData->tileHeight + texX + texY * texData->tileWidth];
+				uint32_t pixColor = texData->pixData[RayEngine_getLayerTile(groundMap, groundMap ? groundMap->floorData : NULL, pixelX, pixelY, tileNum) * texData->tileWidth * texData->tileHeight + texX + texY * texData->tileWidth];
 				r = (int)(pixColor >> 3*8);
 				g = (int)((pixColor >> 2*8) & 0xFF);
 				b = (int)((pixColor >> 8) & 0xFF);
@@ -786,6 +2784,70 @@ void RayEngine_texRenderFloor(PixBuffer* buffer, Camera* camera, uint32_t width,
 	}
 }
 
+/** RayEngine_deferFloor
+ * @brief Stores the floor in the GBuffer wherever nothing opaque was drawn
+ * * Deferred RayEngine_texRenderFloor, call after walls and sprites
+ * * so covered floor is never sampled, then RayEngine_shadeGBuffer.
+ * * With RaySpans attached the floor is drawn straight away below
+ * * each column's wall, call before RayEngine_drawSpans
+ * @param buffer DepthBuffer with a GBuffer or RaySpans attached
+ * @param camera Camera to render from
+ * @param width Width of buffer in pixels
+ * @param height Height of buffer in pixels
+ * @param groundMap Map whose floorData picks the tile (NULL for tileNum everywhere)
+ * @param texData Texture to render to floor
+ * @param tileNum Tile to render where floorData is empty
+ */
+void RayEngine_deferFloor(DepthBuffer* buffer, Camera* camera, uint32_t width, uint32_t height, Map* groundMap, RayTex* texData, uint8_t tileNum)
+{
+	double scaleFactor = (double)width / (double)height * 2.4;
+	double fogConstant = 4.0/5;
+	uint32_t startY = height / 2;
+	RaySpans* spans = buffer->spans;
+	uint8_t material = spans ? 1 : buffer->gbuffer ? RayEngine_getMaterial(buffer->gbuffer, texData) : 0;
+	if (!material)
+	{
+		return;
+	}
+	RayEngine_updateCameraColumns(camera, width);
+	double dirX = cos(camera->angle);
+	double dirY = sin(camera->angle);
+	#pragma omp parallel for schedule(dynamic,8)
+	for (int y = startY + 1; y < height; y++)
+	{
+		for (uint32_t x = 0; x < width; x++)
+		{
+			uint32_t index = x + y * width;
+			uint8_t covered = spans ? y >= spans->top[x] && y < spans->bottom[x] : buffer->pixelDepth[index] != INFINITY;
+			if (covered || RayEngine_isColumnSkipped(camera, x))
+			{
+				continue;
+			}
+			// Same sampling as RayEngine_texRenderFloor
+			double rayCos = camera->columnCos[x];
+			double pixelDist = (double)height * (1 + 2 * camera->h) / (10.0 * (y-startY-1) * rayCos) * scaleFactor;
+			GBufferPixel texel = {1.0f, 0, 0, material, tileNum};
+			if (pixelDist < camera->dist * fogConstant)
+			{
+				double pixelX = camera->x + pixelDist * ((dirX - dirY * camera->columnTan[x]) * rayCos);
+				double pixelY = camera->y + pixelDist * ((dirY + dirX * camera->columnTan[x]) * rayCos);
+				texel.fog = (float)(pixelDist / (camera->dist * fogConstant));
+				texel.u = (uint16_t)floor((double)texData->tileWidth * (pixelX - floor(pixelX)));
+				texel.v = (uint16_t)floor((double)texData->tileHeight * (pixelY - floor(pixelY)));
+				texel.tile = RayEngine_getLayerTile(groundMap, groundMap ? groundMap->floorData : NULL, pixelX, pixelY, tileNum);
+			}
+			if (spans)
+			{
+				uint32_t pix = texData->pixData[texel.tile * texData->tileWidth * texData->tileHeight + \
+					texel.v * texData->tileWidth + texel.u];
+				buffer->pixelBuffer->pixels[index] = RayEngine_pixGradientShader(pix, texel.fog, FOG_COLOR) | 0xFF;
+				continue;
+			}
+			buffer->gbuffer->pixels[index] = texel;
+		}
+	}
+}
+
 /** RayEngine_texRenderCeiling
  * @brief Renders raycasted ceiling
  * TODO: See above (RayEngine_texRenderFloor)
@@ -793,12 +2855,9 @@ void RayEngine_texRenderFloor(PixBuffer* buffer, Camera* camera, uint32_t width,
  * @param camera Camera to render from
  * @param width Width of pixbuffer in pixels
  * @param height Height of pixbuffer in pixels
- * @param groundMap Tile map to render from
- * ! Doesn't do anything atm
- * TODO: Integrate with main map
+ * @param ceilingMap Map whose ceilingData picks the tile (NULL for tileNum everywhere)
  * @param texData Texture to render to floor
- * @param tileNum Number of tile from texture set to render
- * TODO: Placeholder, remove when mapping added
+ * @param tileNum Tile to render where ceilingData is empty
  */
 void RayEngine_texRenderCeiling(PixBuffer* buffer, Camera* camera, uint32_t width, uint32_t height, Map* ceilingMap, RayTex* texData, uint8_t tileNum)
 {
@@ -817,18 +2876,26 @@ void RayEngine_texRenderCeiling(PixBuffer* buffer, Camera* camera, uint32_t widt
 	uint32_t texX;
 	uint32_t texY;
 
-	double startAngle = camera->angle - camera->fov / 2.0;
-	double rayAngle;
+	RayEngine_updateCameraColumns(camera, width);
+	double dirX = cos(camera->angle);
+	double dirY = sin(camera->angle);
 	double rayCos;
+	double rayDirX;
+	double rayDirY;
 
 	SDL_Color fadeColor = FOG_COLOR;
 	
 	// iterate through *all* pixels...
 	for (int x = startX; x < width; x++)
 	{
-		// Establish angle of column...
-		rayAngle = startAngle + camera->angleValues[x];
-		rayCos = cos(rayAngle - camera->angle);
+		if (RayEngine_isColumnSkipped(camera, x))
+		{
+			continue;
+		}
+		// Establish direction of column...
+		rayCos = camera->columnCos[x];
+		rayDirX = (dirX - dirY * camera->columnTan[x]) * rayCos;
+		rayDirY = (dirY + dirX * camera->columnTan[x]) * rayCos;
 
 		for (int y = startY; y < height / 2; y++)
 		{
@@ -837,8 +2904,8 @@ void RayEngine_texRenderCeiling(PixBuffer* buffer, Camera* camera, uint32_t widt
 			pixelDepth = (pixelDist * rayCos);
 			double fogConstant = 4.0/5;
 			fadePercent = pixelDist / (camera->dist * fogConstant);
-			pixelX = camera->x + pixelDist * cos(rayAngle);
-			pixelY = camera->y + pixelDist * sin(rayAngle);
+			pixelX = camera->x + pixelDist * rayDirX;
+			pixelY = camera->y + pixelDist * rayDirY;
 			// Wow, is that really it? The math says so...
 			int r;
 			int g;
@@ -849,7 +2916,7 @@ void RayEngine_texRenderCeiling(PixBuffer* buffer, Camera* camera, uint32_t widt
 				// TODO: some grid code...
 				texX = (uint32_t)floor((double)texData->tileWidth * (pixelX - floor(pixelX)));
 				texY = (uint32_t)floor((double)texData->tileHeight * (pixelY - floor(pixelY)));
-				uint32_t pixColor = texData->pixData[tileNum * texData->tileWidth * texData->tileHeight + texX + texY * texData->tileWidth];
+				uint32_t pixColor = texData->pixData[RayEngine_getLayerTile(ceilingMap, ceilingMap ? ceilingMap->ceilingData : NULL, pixelX, pixelY, tileNum) * texData->tileWidth * texData->tileHeight + texX + texY * texData->tileWidth];
 				r = (int)(pixColor >> 3*8);
 				g = (int)((pixColor >> 2*8) & 0xFF);
 				b = (int)((pixColor >> 8) & 0xFF);
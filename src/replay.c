@@ -0,0 +1,221 @@
+/**
+ * Input recording and deterministic playback.
+ * 
+ * File layout (little endian):
+ *   char[4]  magic "RREC"
+ *   uint16   version
+ *   uint16   number of keys per tick (LEN_PK)
+ *   uint32   simulation steps per second
+ *   uint32   random seed
+ *   uint32   number of ticks
+ *   per tick: uint16 key bits, int16 mouse x motion
+ * 
+ * @date 19/10/2026
+ **/
+
+#include <string.h>
+#include "replay.h"
+
+#define REPLAY_HEADER_SIZE 20
+
+/** Replay_init
+ * @brief Creates an empty replay to record into
+ * 
+ * @param seed Seed the recorded session was started with
+ * @param stepRate Simulation steps per second of the session
+ * @return Replay* New replay
+ */
+Replay* Replay_init(uint32_t seed, uint32_t stepRate)
+{
+	Replay* newReplay = (Replay*)calloc(1, sizeof(Replay));
+	newReplay->seed = seed;
+	newReplay->stepRate = stepRate;
+	return newReplay;
+}
+
+/** Replay_del
+ * @brief Deallocates Replay memory
+ * 
+ * @param replay Replay to free
+ */
+void Replay_del(Replay* replay)
+{
+	free(replay->keyBits);
+	free(replay->mouseX);
+	free(replay);
+}
+
+/** Replay_reserve
+ * @brief Grows tick arrays to hold at least capacity ticks
+ */
+static void Replay_reserve(Replay* replay, uint32_t capacity)
+{
+	if (capacity > replay->capacity)
+	{
+		replay->capacity = capacity;
+		replay->keyBits = (uint16_t*)realloc(replay->keyBits, sizeof(uint16_t) * capacity);
+		replay->mouseX = (int16_t*)realloc(replay->mouseX, sizeof(int16_t) * capacity);
+	}
+}
+
+/** Replay_record
+ * @brief Appends one simulation step of input
+ * * Call right before GameEngine_updatePlayer. Mouse motion is
+ * * clamped to 16 bits in the KeyMap too, so the live session
+ * * sees exactly what playback will
+ * @param replay Replay to record into
+ * @param keyMap KeyMap about to be used for this step
+ */
+void Replay_record(Replay* replay, KeyMap* keyMap)
+{
+	if (replay->numTicks == replay->capacity)
+	{
+		Replay_reserve(replay, replay->capacity ? replay->capacity * 2 : 1024);
+	}
+	uint16_t bits = 0;
+	for (int i = 0; i < LEN_PK; i++)
+	{
+		bits |= (keyMap->state[i] ? 1 : 0) << i;
+	}
+	if (keyMap->mouseX > INT16_MAX)
+	{
+		keyMap->mouseX = INT16_MAX;
+	}
+	else if (keyMap->mouseX < INT16_MIN)
+	{
+		keyMap->mouseX = INT16_MIN;
+	}
+	replay->keyBits[replay->numTicks] = bits;
+	replay->mouseX[replay->numTicks] = (int16_t)keyMap->mouseX;
+	replay->numTicks++;
+}
+
+/** Replay_play
+ * @brief Loads the next recorded step of input into a KeyMap
+ * * Use instead of GameEngine_updateKeys, once per simulation step
+ * @param replay Replay to play back
+ * @param keyMap KeyMap to fill
+ * @return uint8_t 1 if a step was loaded, 0 once the replay is over
+ */
+uint8_t Replay_play(Replay* replay, KeyMap* keyMap)
+{
+	if (replay->tick >= replay->numTicks)
+	{
+		return 0;
+	}
+	for (int i = 0; i < LEN_PK; i++)
+	{
+		keyMap->state[i] = (replay->keyBits[replay->tick] >> i) & 1;
+	}
+	keyMap->mouseX = replay->mouseX[replay->tick];
+	replay->tick++;
+	return 1;
+}
+
+static void Replay_putU16(uint8_t* out, uint16_t value)
+{
+	out[0] = value & 0xFF;
+	out[1] = value >> 8;
+}
+
+static void Replay_putU32(uint8_t* out, uint32_t value)
+{
+	Replay_putU16(out, value & 0xFFFF);
+	Replay_putU16(out + 2, value >> 16);
+}
+
+static uint16_t Replay_getU16(uint8_t* in)
+{
+	return (uint16_t)(in[0] | (in[1] << 8));
+}
+
+static uint32_t Replay_getU32(uint8_t* in)
+{
+	return Replay_getU16(in) | ((uint32_t)Replay_getU16(in + 2) << 16);
+}
+
+/** Replay_save
+ * @brief Writes a replay to disk
+ * 
+ * @param replay Replay to save
+ * @param path File path to write to
+ * @return int 0 on success, -1 if the file could not be written
+ */
+int Replay_save(Replay* replay, const char* path)
+{
+	FILE* replayFile = fopen(path, "wb");
+	if (!replayFile)
+	{
+		return -1;
+	}
+	uint8_t header[REPLAY_HEADER_SIZE];
+	memcpy(header, REPLAY_MAGIC, 4);
+	Replay_putU16(header + 4, REPLAY_VERSION);
+	Replay_putU16(header + 6, LEN_PK);
+	Replay_putU32(header + 8, replay->stepRate);
+	Replay_putU32(header + 12, replay->seed);
+	Replay_putU32(header + 16, replay->numTicks);
+	uint8_t* ticks = (uint8_t*)malloc(4 * (size_t)replay->numTicks + 1);
+	for (uint32_t t = 0; t < replay->numTicks; t++)
+	{
+		Replay_putU16(ticks + 4*t, replay->keyBits[t]);
+		Replay_putU16(ticks + 4*t + 2, (uint16_t)replay->mouseX[t]);
+	}
+	int status = 0;
+	if (fwrite(header, 1, REPLAY_HEADER_SIZE, replayFile) != REPLAY_HEADER_SIZE || \
+		fwrite(ticks, 4, replay->numTicks, replayFile) != replay->numTicks)
+	{
+		status = -1;
+	}
+	free(ticks);
+	if (fclose(replayFile))
+	{
+		status = -1;
+	}
+	return status;
+}
+
+/** Replay_load
+ * @brief Reads a replay from disk for playback
+ * 
+ * @param path File path to read
+ * @return Replay* Loaded replay, NULL if missing or not a
+ *         compatible replay file
+ */
+Replay* Replay_load(const char* path)
+{
+	FILE* replayFile = fopen(path, "rb");
+	if (!replayFile)
+	{
+		return NULL;
+	}
+	uint8_t header[REPLAY_HEADER_SIZE];
+	if (fread(header, 1, REPLAY_HEADER_SIZE, replayFile) != REPLAY_HEADER_SIZE || \
+		memcmp(header, REPLAY_MAGIC, 4) || \
+		Replay_getU16(header + 4) != REPLAY_VERSION || \
+		Replay_getU16(header + 6) != LEN_PK)
+	{
+		fclose(replayFile);
+		return NULL;
+	}
+	Replay* replay = Replay_init(Replay_getU32(header + 12), Replay_getU32(header + 8));
+	uint32_t numTicks = Replay_getU32(header + 16);
+	uint8_t* ticks = (uint8_t*)malloc(4 * (size_t)numTicks + 1);
+	if (fread(ticks, 4, numTicks, replayFile) != numTicks)
+	{
+		free(ticks);
+		fclose(replayFile);
+		Replay_del(replay);
+		return NULL;
+	}
+	fclose(replayFile);
+	Replay_reserve(replay, numTicks);
+	for (uint32_t t = 0; t < numTicks; t++)
+	{
+		replay->keyBits[t] = Replay_getU16(ticks + 4*t);
+		replay->mouseX[t] = (int16_t)Replay_getU16(ticks + 4*t + 2);
+	}
+	replay->numTicks = numTicks;
+	free(ticks);
+	return replay;
+}
@@ -0,0 +1,394 @@
+/**
+ * Tile-aligned spatial hash for entity queries.
+ * Buckets match Map tiles one to one (border
+ * included), so gameplay and render code can ask
+ * "what is near here" without touching every
+ * entity in the pool.
+ * 
+ * @date 19/10/2026
+ **/
+
+#include "spatialhash.h"
+
+/** SpatialHash_cellIndex
+ * @brief Finds bucket index of a map position, clamped to the grid
+ * 
+ * @param hash SpatialHash to index
+ * @param x Map x coordinate
+ * @param y Map y coordinate
+ * @return uint32_t Bucket index
+ */
+static uint32_t SpatialHash_cellIndex(SpatialHash* hash, double x, double y)
+{
+	int32_t cx = (int32_t)floor(x) + hash->border;
+	int32_t cy = (int32_t)floor(y) + hash->border;
+	cx = cx < 0 ? 0 : (cx >= hash->width ? hash->width - 1 : cx);
+	cy = cy < 0 ? 0 : (cy >= hash->height ? hash->height - 1 : cy);
+	return (uint32_t)(cy * hash->width + cx);
+}
+
+/** SpatialHash_nextStamp
+ * @brief Starts a new query so each bucket is only visited once
+ * 
+ * @param hash SpatialHash being queried
+ */
+static void SpatialHash_nextStamp(SpatialHash* hash)
+{
+	hash->stamp++;
+	if (!hash->stamp)
+	{
+		memset(hash->cellStamp, 0, sizeof(uint32_t) * hash->width * hash->height);
+		hash->stamp = 1;
+	}
+}
+
+/** SpatialHash_init
+ * @brief Creates a spatial hash covering a Map and its border
+ * 
+ * @param map Map to cover
+ * @param capacity Number of entity handles to reserve space for
+ * @return SpatialHash* New hash
+ */
+SpatialHash* SpatialHash_init(Map* map, uint32_t capacity)
+{
+	SpatialHash* hash = (SpatialHash*)calloc(1, sizeof(SpatialHash));
+	hash->border = map->border;
+	hash->width = map->width + map->border * 2;
+	hash->height = map->height + map->border * 2;
+	hash->cellHead = (uint32_t*)malloc(sizeof(uint32_t) * hash->width * hash->height);
+	hash->cellStamp = (uint32_t*)calloc(hash->width * hash->height, sizeof(uint32_t));
+	for (int32_t i = 0; i < hash->width * hash->height; i++)
+	{
+		hash->cellHead[i] = HASH_NONE;
+	}
+	SpatialHash_reserve(hash, capacity);
+	return hash;
+}
+
+/** SpatialHash_del
+ * @brief Deallocates SpatialHash memory
+ * ! Will destroy hash
+ * @param hash Hash to free
+ */
+void SpatialHash_del(SpatialHash* hash)
+{
+	free(hash->cellHead);
+	free(hash->cellStamp);
+	free(hash->next);
+	free(hash->prev);
+	free(hash->cell);
+	free(hash->x);
+	free(hash->y);
+	free(hash);
+}
+
+/** SpatialHash_reserve
+ * @brief Grows per-handle storage to hold at least capacity handles
+ * 
+ * @param hash SpatialHash to grow
+ * @param capacity New handle capacity
+ */
+void SpatialHash_reserve(SpatialHash* hash, uint32_t capacity)
+{
+	if (capacity <= hash->capacity)
+	{
+		return;
+	}
+	hash->next = (uint32_t*)realloc(hash->next, sizeof(uint32_t) * capacity);
+	hash->prev = (uint32_t*)realloc(hash->prev, sizeof(uint32_t) * capacity);
+	hash->cell = (uint32_t*)realloc(hash->cell, sizeof(uint32_t) * capacity);
+	hash->x = (double*)realloc(hash->x, sizeof(double) * capacity);
+	hash->y = (double*)realloc(hash->y, sizeof(double) * capacity);
+	for (uint32_t i = hash->capacity; i < capacity; i++)
+	{
+		hash->cell[i] = HASH_NONE;
+	}
+	hash->capacity = capacity;
+}
+
+/** SpatialHash_insert
+ * @brief Adds an entity handle to the bucket under its position
+ * 
+ * @param hash SpatialHash to insert into
+ * @param handle Entity handle (see EntityPool)
+ * @param x Map x coordinate
+ * @param y Map y coordinate
+ */
+void SpatialHash_insert(SpatialHash* hash, uint32_t handle, double x, double y)
+{
+	if (handle >= hash->capacity)
+	{
+		SpatialHash_reserve(hash, handle * 2 + 1);
+	}
+	uint32_t cell = SpatialHash_cellIndex(hash, x, y);
+	hash->x[handle] = x;
+	hash->y[handle] = y;
+	hash->cell[handle] = cell;
+	hash->prev[handle] = HASH_NONE;
+	hash->next[handle] = hash->cellHead[cell];
+	if (hash->cellHead[cell] != HASH_NONE)
+	{
+		hash->prev[hash->cellHead[cell]] = handle;
+	}
+	hash->cellHead[cell] = handle;
+}
+
+/** SpatialHash_remove
+ * @brief Takes an entity handle out of its bucket
+ * 
+ * @param hash SpatialHash to remove from
+ * @param handle Entity handle
+ */
+void SpatialHash_remove(SpatialHash* hash, uint32_t handle)
+{
+	uint32_t cell = hash->cell[handle];
+	if (cell == HASH_NONE)
+	{
+		return;
+	}
+	if (hash->prev[handle] != HASH_NONE)
+	{
+		hash->next[hash->prev[handle]] = hash->next[handle];
+	}
+	else
+	{
+		hash->cellHead[cell] = hash->next[handle];
+	}
+	if (hash->next[handle] != HASH_NONE)
+	{
+		hash->prev[hash->next[handle]] = hash->prev[handle];
+	}
+	hash->cell[handle] = HASH_NONE;
+}
+
+/** SpatialHash_move
+ * @brief Updates entity position, relinking only if it changed tiles
+ * 
+ * @param hash SpatialHash to update
+ * @param handle Entity handle
+ * @param x New map x coordinate
+ * @param y New map y coordinate
+ */
+void SpatialHash_move(SpatialHash* hash, uint32_t handle, double x, double y)
+{
+	if (hash->cell[handle] != SpatialHash_cellIndex(hash, x, y))
+	{
+		SpatialHash_remove(hash, handle);
+		SpatialHash_insert(hash, handle, x, y);
+	}
+	else
+	{
+		hash->x[handle] = x;
+		hash->y[handle] = y;
+	}
+}
+
+/** SpatialHash_queryTiles
+ * @brief Collects every entity inside an inclusive tile rectangle
+ * 
+ * @param hash SpatialHash to query
+ * @param x0 Left tile
+ * @param y0 Top tile
+ * @param x1 Right tile
+ * @param y1 Bottom tile
+ * @param out Array to write entity handles to
+ * @param maxOut Length of out
+ * @return uint32_t Number of handles written
+ */
+uint32_t SpatialHash_queryTiles(SpatialHash* hash, int32_t x0, int32_t y0, int32_t x1, int32_t y1, uint32_t* out, uint32_t maxOut)
+{
+	uint32_t count = 0;
+	x0 = x0 + hash->border < 0 ? 0 : x0 + hash->border;
+	y0 = y0 + hash->border < 0 ? 0 : y0 + hash->border;
+	x1 = x1 + hash->border >= hash->width ? hash->width - 1 : x1 + hash->border;
+	y1 = y1 + hash->border >= hash->height ? hash->height - 1 : y1 + hash->border;
+	for (int32_t cy = y0; cy <= y1; cy++)
+	{
+		for (int32_t cx = x0; cx <= x1; cx++)
+		{
+			for (uint32_t h = hash->cellHead[cy * hash->width + cx]; h != HASH_NONE; h = hash->next[h])
+			{
+				if (count == maxOut)
+				{
+					return count;
+				}
+				out[count++] = h;
+			}
+		}
+	}
+	return count;
+}
+
+/** SpatialHash_queryRadius
+ * @brief Collects every entity within a distance of a point
+ * 
+ * @param hash SpatialHash to query
+ * @param x Map x coordinate of center
+ * @param y Map y coordinate of center
+ * @param radius Search radius in map units
+ * @param out Array to write entity handles to
+ * @param maxOut Length of out
+ * @return uint32_t Number of handles written
+ */
+uint32_t SpatialHash_queryRadius(SpatialHash* hash, double x, double y, double radius, uint32_t* out, uint32_t maxOut)
+{
+	uint32_t count = SpatialHash_queryTiles(hash,
+		(int32_t)floor(x - radius), (int32_t)floor(y - radius),
+		(int32_t)floor(x + radius), (int32_t)floor(y + radius),
+		out, maxOut);
+	// Trim corners of the tile square
+	uint32_t kept = 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		double dx = hash->x[out[i]] - x;
+		double dy = hash->y[out[i]] - y;
+		if (dx*dx + dy*dy <= radius*radius)
+		{
+			out[kept++] = out[i];
+		}
+	}
+	return kept;
+}
+
+/** SpatialHash_queryCorridor
+ * @brief Collects every entity within a distance of a line segment
+ * Walks the tiles under the segment rather than its bounding box
+ * @param hash SpatialHash to query
+ * @param x Map x coordinate of segment start
+ * @param y Map y coordinate of segment start
+ * @param dirX x direction of segment
+ * @param dirY y direction of segment
+ * @param length Length of segment in map units
+ * @param halfWidth Corridor half width in map units
+ * @param out Array to write entity handles to
+ * @param maxOut Length of out
+ * @return uint32_t Number of handles written
+ */
+uint32_t SpatialHash_queryCorridor(SpatialHash* hash, double x, double y, double dirX, double dirY, double length, double halfWidth, uint32_t* out, uint32_t maxOut)
+{
+	uint32_t count = 0;
+	double dirLen = sqrt(dirX*dirX + dirY*dirY);
+	if (dirLen == 0)
+	{
+		return SpatialHash_queryRadius(hash, x, y, halfWidth, out, maxOut);
+	}
+	dirX /= dirLen;
+	dirY /= dirLen;
+	int32_t reach = (int32_t)ceil(halfWidth);
+	SpatialHash_nextStamp(hash);
+	// Grid walk along segment
+	int32_t tileX = (int32_t)floor(x);
+	int32_t tileY = (int32_t)floor(y);
+	int32_t stepX = dirX < 0 ? -1 : 1;
+	int32_t stepY = dirY < 0 ? -1 : 1;
+	double deltaX = dirX != 0 ? fabs(1.0 / dirX) : INFINITY;
+	double deltaY = dirY != 0 ? fabs(1.0 / dirY) : INFINITY;
+	double sideX = dirX < 0 ? (x - tileX) * deltaX : (tileX + 1 - x) * deltaX;
+	double sideY = dirY < 0 ? (y - tileY) * deltaY : (tileY + 1 - y) * deltaY;
+	double t = 0;
+	while (t <= length)
+	{
+		// Visit tiles around this one that the corridor can reach
+		for (int32_t cy = tileY - reach + hash->border; cy <= tileY + reach + hash->border; cy++)
+		{
+			for (int32_t cx = tileX - reach + hash->border; cx <= tileX + reach + hash->border; cx++)
+			{
+				if (cx < 0 || cy < 0 || cx >= hash->width || cy >= hash->height || hash->cellStamp[cy * hash->width + cx] == hash->stamp)
+				{
+					continue;
+				}
+				hash->cellStamp[cy * hash->width + cx] = hash->stamp;
+				for (uint32_t h = hash->cellHead[cy * hash->width + cx]; h != HASH_NONE; h = hash->next[h])
+				{
+					double ex = hash->x[h] - x;
+					double ey = hash->y[h] - y;
+					double along = ex * dirX + ey * dirY;
+					double across = fabs(ex * dirY - ey * dirX);
+					if (along >= -halfWidth && along <= length + halfWidth && across <= halfWidth)
+					{
+						if (count == maxOut)
+						{
+							return count;
+						}
+						out[count++] = h;
+					}
+				}
+			}
+		}
+		if (sideX < sideY)
+		{
+			t = sideX;
+			sideX += deltaX;
+			tileX += stepX;
+		}
+		else
+		{
+			t = sideY;
+			sideY += deltaY;
+			tileY += stepY;
+		}
+	}
+	return count;
+}
+
+/** SpatialHash_queryView
+ * @brief Collects entities in tiles inside a camera's view wedge
+ * Used for sprite culling, entities outside are never considered
+ * @param hash SpatialHash to query
+ * @param camera Camera to test against
+ * @param viewDist View distance in map units
+ * @param margin Extra distance (map units) to keep wide sprites on screen
+ * @param out Array to write entity handles to
+ * @param maxOut Length of out
+ * @return uint32_t Number of handles written
+ */
+uint32_t SpatialHash_queryView(SpatialHash* hash, Camera* camera, double viewDist, double margin, uint32_t* out, uint32_t maxOut)
+{
+	uint32_t count = 0;
+	// Tile half diagonal, so any part of a tile in view counts
+	double reach = M_SQRT1_2 + margin;
+	int32_t x0 = (int32_t)floor(camera->x - viewDist - reach) + hash->border;
+	int32_t y0 = (int32_t)floor(camera->y - viewDist - reach) + hash->border;
+	int32_t x1 = (int32_t)floor(camera->x + viewDist + reach) + hash->border;
+	int32_t y1 = (int32_t)floor(camera->y + viewDist + reach) + hash->border;
+	x0 = x0 < 0 ? 0 : x0;
+	y0 = y0 < 0 ? 0 : y0;
+	x1 = x1 >= hash->width ? hash->width - 1 : x1;
+	y1 = y1 >= hash->height ? hash->height - 1 : y1;
+	double halfFov = camera->fov / 2;
+	for (int32_t cy = y0; cy <= y1; cy++)
+	{
+		for (int32_t cx = x0; cx <= x1; cx++)
+		{
+			uint32_t head = hash->cellHead[cy * hash->width + cx];
+			if (head == HASH_NONE)
+			{
+				continue;
+			}
+			double dx = cx - hash->border + 0.5 - camera->x;
+			double dy = cy - hash->border + 0.5 - camera->y;
+			double dist = sqrt(dx*dx + dy*dy);
+			if (dist > viewDist + reach)
+			{
+				continue;
+			}
+			if (dist > reach)
+			{
+				double offAngle = fabs(remainder(atan2(dy, dx) - camera->angle, 2 * M_PI));
+				if (offAngle > halfFov + asin(reach / dist))
+				{
+					continue;
+				}
+			}
+			for (uint32_t h = head; h != HASH_NONE; h = hash->next[h])
+			{
+				if (count == maxOut)
+				{
+					return count;
+				}
+				out[count++] = h;
+			}
+		}
+	}
+	return count;
+}
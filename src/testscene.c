@@ -0,0 +1,111 @@
+/**
+ * Procedural fixtures shared by the benchmark and the
+ * golden-frame harness: a seeded random generator, wall,
+ * glass, floor and sprite textures and the sky backdrop.
+ * Keeps both tools independent of asset files and
+ * rendering the same kind of scene.
+ * 
+ * @date 19/10/2026
+ **/
+
+#include <stdlib.h>
+#include "testscene.h"
+
+static uint32_t rngState = TEST_SCENE_SEED;
+
+/** TestScene_seedRandom
+ * @brief Restarts TestScene_random from a seed
+ * 
+ * @param seed Seed value (non-zero, TEST_SCENE_SEED for the default)
+ */
+void TestScene_seedRandom(uint32_t seed)
+{
+	rngState = seed;
+}
+
+/** TestScene_random
+ * @brief xorshift32, fixed seed so every run builds identical scenes
+ * 
+ * @return uint32_t Next random value
+ */
+uint32_t TestScene_random(void)
+{
+	rngState ^= rngState << 13;
+	rngState ^= rngState >> 17;
+	rngState ^= rngState << 5;
+	return rngState;
+}
+
+/** TestScene_generateTextures
+ * @brief Builds wall, glass, floor and sprite textures procedurally
+ * * Patterns scale with size, so any size draws the same scene
+ * @param wallTex RayTex for map tiles, see TestTile
+ * @param spriteTex RayTex for sprites (one round tile)
+ * @param size Tile width and height in pixels (a multiple of 8)
+ */
+void TestScene_generateTextures(RayTex* wallTex, RayTex* spriteTex, uint32_t size)
+{
+	wallTex->tileWidth = size;
+	wallTex->tileHeight = size;
+	wallTex->tileCount = 4;
+	wallTex->pixData = (uint32_t*)malloc(sizeof(uint32_t) * size * size * 4);
+	uint32_t brick = size / 4;
+	for (uint32_t y = 0; y < size; y++)
+	{
+		for (uint32_t x = 0; x < size; x++)
+		{
+			uint32_t* tile = wallTex->pixData + y * size + x;
+			// Brick
+			uint8_t mortar = (y % brick == 0) || ((x + (y / brick % 2) * brick) % (brick * 2) == 0);
+			tile[0] = mortar ? PixBuffer_toPixColor(90, 90, 90, 255) : PixBuffer_toPixColor(150 + x * 80 / size, 60 + y * 48 / size, 40, 255);
+			// Stripes
+			tile[size * size] = (x / (size / 8)) % 2 ? PixBuffer_toPixColor(40, 120, 160, 255) : PixBuffer_toPixColor(220, 220, 200, 255);
+			// Glass, opaque frame with translucent pane
+			uint8_t frame = x < 2 || y < 2 || x >= size - 2 || y >= size - 2;
+			tile[size * size * 2] = frame ? PixBuffer_toPixColor(60, 60, 70, 255) : PixBuffer_toPixColor(120, 200, 230, 96);
+			// Floor
+			tile[size * size * 3] = ((x / brick) + (y / brick)) % 2 ? PixBuffer_toPixColor(70, 90, 60, 255) : PixBuffer_toPixColor(50, 70, 45, 255);
+		}
+	}
+	spriteTex->tileWidth = size;
+	spriteTex->tileHeight = size;
+	spriteTex->tileCount = 1;
+	spriteTex->pixData = (uint32_t*)malloc(sizeof(uint32_t) * size * size);
+	for (uint32_t y = 0; y < size; y++)
+	{
+		for (uint32_t x = 0; x < size; x++)
+		{
+			double dx = x - size / 2 + 0.5;
+			double dy = y - size / 2 + 0.5;
+			uint8_t inside = dx*dx + dy*dy < (size / 2) * (size / 2);
+			spriteTex->pixData[y * size + x] = inside ? PixBuffer_toPixColor(230, 40 + y * 160 / size, 80, 255) : 0;
+		}
+	}
+}
+
+/** TestScene_delTextures
+ * @brief Frees textures made by TestScene_generateTextures
+ */
+void TestScene_delTextures(RayTex* wallTex, RayTex* spriteTex)
+{
+	free(wallTex->pixData);
+	free(spriteTex->pixData);
+}
+
+/** TestScene_initBackground
+ * @brief Allocates a backdrop with a sky gradient over its top half
+ * 
+ * @param width Width of backdrop in pixels
+ * @param height Height of backdrop in pixels
+ * @return PixBuffer* New backdrop, free with PixBuffer_delPixBuffer
+ */
+PixBuffer* TestScene_initBackground(uint32_t width, uint32_t height)
+{
+	PixBuffer* background = PixBuffer_initPixBuffer(width, height);
+	SDL_Rect skyRect = {0, 0, width, height / 2};
+	SDL_Color skyTop = {0x5c, 0x57, 0xff, 255};
+	SDL_Color skyBottom = {0xff, 0x40, 0x00, 255};
+	PixBuffer_clearBuffer(background);
+	PixBuffer_drawHorizGradient(background, &skyRect, skyTop, skyBottom);
+	return background;
+}